@@ -0,0 +1,25 @@
+#version 130
+// Texture coordinates of packed chunks are computed from the position in the cell,
+// the matters are the layers of the chunkMatters texture array
+
+uniform sampler2DArray matters;
+
+varying vec3 cellPos;
+varying float faceIndex;
+varying float layer;
+
+void main()
+{
+	int face = int(faceIndex + 0.5);
+	vec2 facePos;
+	if (face == 0 || face == 2) {
+		facePos = cellPos.xz; //top, bottom
+	} else if (face == 1 || face == 4) {
+		facePos = cellPos.zy; //left, right
+	} else {
+		facePos = cellPos.xy; //back, front
+	}
+	vec2 uv = vec2(fract(facePos.x), 1.0 - fract(facePos.y));
+	//mipmap chosen from the unwrapped position, fract jumps at the edges of the cells
+	gl_FragColor = textureGrad(matters, vec3(uv, floor(layer + 0.5)), dFdx(facePos), dFdy(facePos));
+}
@@ -0,0 +1,24 @@
+#version 130
+// Expand the packed chunk vertices built by ChunkMesher (see chunkMesher.h)
+// vertex.x: cell x (6 bits) + bits 0-1 of the face index
+// vertex.y: cell y (6 bits) + bit 2 of the face index
+// vertex.z: cell z
+// vertex.w: layer of the matter in the texture array (its atlas row - 1)
+
+attribute vec4 vertex;
+uniform mat4 worldViewProj;
+uniform float cubeSize;
+
+varying vec3 cellPos;
+varying float faceIndex;
+varying float layer;
+
+void main()
+{
+	float highX = floor(vertex.x / 64.0);
+	float highY = floor(vertex.y / 64.0);
+	cellPos = vec3(vertex.x - highX*64.0, vertex.y - highY*64.0, vertex.z);
+	faceIndex = highX + highY*4.0;
+	layer = vertex.w;
+	gl_Position = worldViewProj * vec4(cellPos*cubeSize, 1.0);
+}
@@ -1,80 +1,42 @@
-
-function generateMap(x, y)
-	print("Generating a new map: "..x.."*"..y)
-	
-	newMap = {}
-	for i=1, x do
-		newMap[i] = {}
-		for j=1, y do
-			newMap[i][j] = "water"
-		end
-	end
-
-	--~ change to earth if not on the border
-	for xi,xv in ipairs(newMap) do
-		for yi,yv in ipairs(xv) do
-			if ((xi > 1) and (yi > 1)) and ((next(xv, yi) ~= nil) and (next(newMap, xi))) then
-				newMap[xi][yi] = "earth"
+--~ Square map: ocean on the border, plain inside, with a small lake.
+--~ Load it from the editor, it works directly on the world map
+--~ (see src/luaWorldMap.h for the world object).
+
+function generateMap(x, z)
+	print("Generating a new map: "..x.."*"..z)
+	world:resize(x, 1, z)
+
+	--~ whole boxes at once, no table per cube
+	world:fill(0, 0, 0, x-1, 0, z-1, "ocean")
+	world:fill(1, 0, 1, x-2, 0, z-2, "plain")
+
+	--~ a round lake in the middle, written as one region
+	local radius = math.floor(math.min(x, z) / 8)
+	local cx, cz = math.floor(x/2), math.floor(z/2)
+	local x0, z0 = cx-radius, cz-radius
+	local size = 2*radius+1
+	local lake = world:getRegion(x0, 0, z0, x0+size-1, 0, z0+size-1)
+	local sea = world:matterId("sea")
+	for dz=0, size-1 do
+		for dx=0, size-1 do
+			if (dx-radius)^2 + (dz-radius)^2 <= radius^2 then
+				lake[1 + dx + dz*size] = sea
 			end
-			--~ print("["..xi.."]["..yi.."]", newMap[xi][yi])
 		end
 	end
-	
-	return reformat(newMap)
-end
-
-function reformat(map)
-	mapDef = {}	
-	for xi,xv in ipairs(newMap) do
-		for yi,yv in ipairs(xv) do
-			mapDef[xi..":"..yi] = {}
-			mapDef[xi..":"..yi]["x"] = xi-1
-			mapDef[xi..":"..yi]["y"] = 0
-			mapDef[xi..":"..yi]["z"] = yi-1
-			mapDef[xi..":"..yi]["id"] = "matter"
-			mapDef[xi..":"..yi]["properties"] = {}
-			local matttype
-			if map[xi][yi] == "water" then
-				matttype = "ocean"
-			elseif map[xi][yi] == "earth" then
-				matttype = "plain"
+	world:setRegion(x0, 0, z0, x0+size-1, 0, z0+size-1, lake)
+
+	--~ count the cubes chunk by chunk
+	local plain = world:matterId("plain")
+	local nbPlain = 0
+	for cubes in world:chunks() do
+		for i=1, #cubes do
+			if cubes[i] == plain then
+				nbPlain = nbPlain + 1
 			end
-			mapDef[xi..":"..yi]["properties"]["matterType"] = matttype
 		end
-	end	
-	
-	return mapDef
-end
-
-function serialize (o, f, indent)
-  if type(o) == "number" then
-	f:write(o)
-  elseif type(o) == "string" then
-	f:write(string.format("%q", o))
-  elseif type(o) == "table" then
-	f:write("{\n")
-	for k,v in pairs(o) do
-	  f:write(indent.."  [")
-	  serialize(k, f, indent.."  ")
-	  f:write("] = ")
-	  
-	  serialize(v, f, indent.."  ")
-	  f:write(",\n")
 	end
-	f:write(indent.."}")
-  else
-	error("cannot serialize a " .. type(o))
-  end
-end
-
-
-function saveToFile(filename, mapDef)
-	file = assert(io.open(filename, "w"))
-	file:write("--~A new generated map \n\n")
-	file:write("mapDef = ")
-	serialize(mapDef, file, "")
+	print(nbPlain.." plain cubes")
 end
 
-
-local genMap = generateMap(50, 50)
-saveToFile("newMap.lua", genMap)
+generateMap(50, 50)
@@ -0,0 +1,18 @@
+--~ Matter types of the world map
+--~ The order of the list gives the id of each matter (starting at 0 with "unknown").
+--~ atlasRow: row of the matter in textures/atlas_test.png (starting at 1)
+--~ material: Ogre material used to draw a single cube (defaults to the name)
+--~ editable: shown in the editor's matter list (defaults to true)
+
+atlasRows = 8
+
+materials = {
+	{ name = "unknown", atlasRow = 1, material = "default", editable = false },
+	{ name = "sea", atlasRow = 2, material = "ocean" },
+	{ name = "ocean", atlasRow = 6 },
+	{ name = "plain", atlasRow = 3 },
+	{ name = "mountain", atlasRow = 4 },
+	{ name = "desert", atlasRow = 5 },
+	{ name = "forest", atlasRow = 7, material = "plain" },
+	{ name = "ice", atlasRow = 8, material = "default" },
+}
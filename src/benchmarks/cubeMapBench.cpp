@@ -0,0 +1,262 @@
+////////////////////////////////////////
+// Microbenchmarks of CubeMap<Voxel>
+// with the access patterns of the game
+////////////////////////////////////////
+//use:
+//
+//cubeMapBench [--sizes 64,256,1024,4096] [--repeat 3] [--out results.json]
+//
+//Each pattern runs on flat maps (sizeY = 1) of each size, the best of the
+//repeats is kept. Results are written as JSON (stdout by default):
+//{"benchmark": "cubeMap", "results": [{"pattern": ..., "size": ..., "ops": ...,
+//"seconds": ..., "nsPerOp": ..., "memoryBytes": ...}, ...]}
+
+#include <glog/logging.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../cubeMap.h"
+#include "../voxel.h"
+#include "../materialRegistry.h"
+#include "../brush.h"
+
+namespace {
+
+struct Result {
+	std::string pattern;
+	int size;
+	size_t ops;
+	double seconds;
+	size_t memoryBytes;
+};
+
+//deterministic and cheap, the same positions for every run
+struct Random {
+	std::uint32_t state;
+	explicit Random(std::uint32_t seed) : state{seed} {}
+	int next(int max) {
+		state = state*1664525u + 1013904223u;
+		return static_cast<int>((state >> 8) % static_cast<std::uint32_t>(max));
+	}
+};
+
+volatile size_t sink; //keeps the reads from being optimized out
+
+class Bench
+{
+	public:
+		Bench(int repeats) : repeats_{repeats}, infos_{}, voxels_{}, results_{}
+		{
+			static const char *names[] = { "ocean", "plain", "mountain", "desert", "forest" };
+			for (int i=0; i<5; ++i) {
+				MatterInfos infos;
+				infos.id = i;
+				infos.name = names[i];
+				infos.atlasRow = i+1;
+				infos.material = names[i];
+				infos.editable = true;
+				infos_.push_back(infos);
+			}
+			//voxels keep a pointer on their infos, which don't move anymore
+			for (const MatterInfos &infos : infos_) {
+				voxels_.push_back(Voxel::createMatterVoxel(&infos));
+			}
+		}
+
+		void run(int size)
+		{
+			CubeMap<Voxel> map(size, 1, size);
+			fillStripes(map);
+			size_t nbCells = static_cast<size_t>(size)*size;
+
+			measure("randomGet", size, 1 << 20, map, [&]() {
+				Random random(42);
+				size_t found = 0;
+				for (int i=0; i<(1 << 20); ++i) {
+					found += map.getVoxel(random.next(size), 0, random.next(size)) != nullptr;
+				}
+				sink = found;
+			});
+			//visible faces test of drawChunk: the cube and its 6 neighbours
+			measure("neighbourScan", size, nbCells*7, map, [&]() {
+				size_t faces = 0;
+				for (int z=0; z<size; ++z) {
+					for (int x=0; x<size; ++x) {
+						if (!map.getVoxel(x, 0, z)) {
+							continue;
+						}
+						faces += !map.getVoxel(x-1, 0, z) + !map.getVoxel(x+1, 0, z)
+							+ !map.getVoxel(x, -1, z) + !map.getVoxel(x, 1, z)
+							+ !map.getVoxel(x, 0, z-1) + !map.getVoxel(x, 0, z+1);
+					}
+				}
+				sink = faces;
+			});
+			//saveWorldMapToLua order: x, then y, then z
+			measure("sequentialSweep", size, nbCells, map, [&]() {
+				size_t found = 0;
+				for (int x=0; x<size; ++x) {
+					for (int z=0; z<size; ++z) {
+						found += map.getVoxel(x, 0, z) != nullptr;
+					}
+				}
+				sink = found;
+			});
+			measure("indexSweep", size, nbCells, map, [&]() {
+				size_t sum = 0;
+				for (int z=0; z<size; ++z) {
+					for (int x=0; x<size; ++x) {
+						sum += map.getIndex(x, 0, z);
+					}
+				}
+				sink = sum;
+			});
+			//changeVoxelType: brush strokes of radius 5
+			measure("brushWrite", size, 10000, map, [&]() {
+				Brush brush(BrushShape::Diamond, 5);
+				Random random(7);
+				for (int i=0; i<10000; ++i) {
+					brush.paint(map, voxels_[i % voxels_.size()], random.next(size), 0, random.next(size));
+				}
+			});
+			measure("setVoxel", size, 1 << 20, map, [&]() {
+				Random random(3);
+				for (int i=0; i<(1 << 20); ++i) {
+					map.setVoxel(voxels_[i % voxels_.size()], random.next(size), 0, random.next(size));
+				}
+			});
+			//resizeWorldMap: grow from half the size by steps of 1/8, filling the new cells
+			CubeMap<Voxel> growing(size/2, 1, size/2);
+			measure("resizeGrowth", size, 4, growing, [&]() {
+				growing.resize(size/2, 1, size/2);
+				growing.fillBox(voxels_[0], 0, 0, 0, size/2-1, 0, size/2-1);
+				for (int step=1; step<=4; ++step) {
+					int newSize = size/2 + step*size/8;
+					growing.resize(newSize, 1, newSize, 0, 0, 0, voxels_[0]);
+				}
+			});
+			//same growth westwards and northwards: the old cubes are moved
+			measure("resizeAnchored", size, 4, growing, [&]() {
+				growing.resize(size/2, 1, size/2);
+				growing.fillBox(voxels_[0], 0, 0, 0, size/2-1, 0, size/2-1);
+				for (int step=1; step<=4; ++step) {
+					int newSize = size/2 + step*size/8;
+					growing.resize(newSize, 1, newSize, size/8, 0, size/8, voxels_[0]);
+				}
+			});
+			//cold chunks: every cube read (decoding the compressed chunks), then every chunk compressed,
+			//the memory reported is the compressed one
+			CubeMap<Voxel> cold(size, 1, size);
+			fillStripes(cold);
+			measure("compressCold", size, nbCells, cold, [&]() {
+				size_t sum = 0;
+				for (int z=0; z<size; ++z) {
+					for (int x=0; x<size; ++x) {
+						sum += cold.getIndex(x, 0, z);
+					}
+				}
+				sink = sum;
+				cold.compressColdChunks(0);
+			});
+			measure("fillBox", size, nbCells, map, [&]() {
+				map.fillBox(voxels_[1], 0, 0, 0, size-1, 0, size-1);
+			});
+		}
+
+		void writeJson(std::ostream &out) const
+		{
+			out << "{\"benchmark\": \"cubeMap\", \"results\": [\n";
+			for (size_t i=0; i<results_.size(); ++i) {
+				const Result &result = results_[i];
+				out << "  {\"pattern\": \"" << result.pattern << "\", \"size\": " << result.size
+					<< ", \"ops\": " << result.ops << ", \"seconds\": " << result.seconds
+					<< ", \"nsPerOp\": " << result.seconds*1e9/result.ops
+					<< ", \"memoryBytes\": " << result.memoryBytes << "}"
+					<< (i+1 < results_.size() ? ",\n" : "\n");
+			}
+			out << "]}\n";
+		}
+
+	private:
+		//ocean with bands of other matters, so chunks are not all uniform
+		void fillStripes(CubeMap<Voxel> &map)
+		{
+			map.fillBox(voxels_[0], 0, 0, 0, map.getSizeX()-1, 0, map.getSizeZ()-1);
+			for (int z=0; z<map.getSizeZ(); z+=7) {
+				map.fillBox(voxels_[1 + z % 4], 0, 0, z, map.getSizeX()-1, 0, z+2);
+			}
+		}
+
+		void measure(const std::string &pattern, int size, size_t ops, const CubeMap<Voxel> &map, const std::function<void()> &code)
+		{
+			double best = 0;
+			for (int r=0; r<repeats_; ++r) {
+				auto start = std::chrono::steady_clock::now();
+				code();
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				best = (r == 0) ? seconds : std::min(best, seconds);
+			}
+			results_.push_back(Result{pattern, size, ops, best, map.getMemoryUsage()});
+			LOG(INFO) << pattern << " " << size << "x" << size << ": " << best*1e9/ops << " ns/op";
+		}
+
+		int repeats_;
+		std::vector<MatterInfos> infos_;
+		std::vector<std::shared_ptr<Voxel>> voxels_;
+		std::vector<Result> results_;
+};
+
+}
+
+int main(int argc, char* argv[])
+{
+	FLAGS_logtostderr = true;
+	google::InitGoogleLogging(argv[0]);
+	std::vector<int> sizes = {64, 256, 1024, 4096};
+	int repeats = 3;
+	std::string output;
+	for (int i=1; i<argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--sizes" && i+1 < argc) {
+			sizes.clear();
+			std::istringstream list(argv[++i]);
+			std::string size;
+			while (std::getline(list, size, ',')) {
+				sizes.push_back(std::atoi(size.c_str()));
+			}
+		} else if (arg == "--repeat" && i+1 < argc) {
+			repeats = std::max(1, std::atoi(argv[++i]));
+		} else if (arg == "--out" && i+1 < argc) {
+			output = argv[++i];
+		} else {
+			std::cerr << "Usage: " << argv[0] << " [--sizes 64,256,1024,4096] [--repeat 3] [--out results.json]\n";
+			return 1;
+		}
+	}
+
+	Bench bench(repeats);
+	for (int size : sizes) {
+		if (size < 2) {
+			LOG(WARNING) << "Ignoring map size: " << size;
+			continue;
+		}
+		bench.run(size);
+	}
+	if (output.empty()) {
+		bench.writeJson(std::cout);
+	} else {
+		std::ofstream file(output.c_str());
+		if (!file.is_open()) {
+			LOG(ERROR) << "Unable to open file: " << output;
+			return 1;
+		}
+		bench.writeJson(file);
+	}
+	return 0;
+}
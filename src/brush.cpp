@@ -0,0 +1,201 @@
+#include "brush.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+
+///////////////////////////////////////
+//	ChangeSet
+///////////////////////////////////////
+
+ChangeSet::ChangeSet():
+	minX{INT_MAX},
+	minY{INT_MAX},
+	minZ{INT_MAX},
+	maxX{INT_MIN},
+	maxY{INT_MIN},
+	maxZ{INT_MIN},
+	nbCubes{0}
+{
+
+}
+
+void ChangeSet::add(int x0, int y0, int z0, int x1, int y1, int z1, size_t cubes)
+{
+	if (cubes == 0) {
+		return;
+	}
+	minX = std::min(minX, x0);
+	minY = std::min(minY, y0);
+	minZ = std::min(minZ, z0);
+	maxX = std::max(maxX, x1);
+	maxY = std::max(maxY, y1);
+	maxZ = std::max(maxZ, z1);
+	nbCubes += cubes;
+}
+
+///////////////////////////////////////
+//	Brush
+///////////////////////////////////////
+
+const int Brush::maxRadius;
+
+Brush::Brush(BrushShape shape, int radius):
+	shape_{shape},
+	radius_{1},
+	seeds_{}
+{
+	setRadius(radius);
+}
+
+Brush::~Brush()
+{
+
+}
+
+void Brush::setRadius(int radius)
+{
+	radius_ = std::max(1, std::min(radius, maxRadius));
+}
+
+int Brush::getHalfWidth(int dy, int dz) const
+{
+	int extent = radius_-1;
+	if (std::abs(dz) > extent || std::abs(dy) > getHeightExtent()) {
+		return -1;
+	}
+	//round shapes use radius-0.5 so small brushes are not reduced to a cross
+	float limit = (extent+0.5f)*(extent+0.5f);
+	switch (shape_) {
+		case BrushShape::Diamond:
+			return extent - std::abs(dz);
+		case BrushShape::Square:
+			return extent;
+		case BrushShape::Circle:
+			return static_cast<int>(std::sqrt(limit - dz*dz));
+		case BrushShape::Sphere: {
+			float rest = limit - dz*dz - dy*dy;
+			return (rest < 0) ? -1 : static_cast<int>(std::sqrt(rest));
+		}
+	}
+	return -1;
+}
+
+int Brush::getHeightExtent() const
+{
+	return (shape_ == BrushShape::Sphere) ? radius_-1 : 0;
+}
+
+ChangeSet Brush::paint(CubeMap<Voxel> &map, const std::shared_ptr<Voxel> &voxel, int x, int y, int z) const
+{
+	ChangeSet changes;
+	int height = getHeightExtent();
+	for (int dy=-height; dy<=height; ++dy) {
+		for (int dz=-(radius_-1); dz<=radius_-1; ++dz) {
+			int halfWidth = getHalfWidth(dy, dz);
+			if (halfWidth < 0) {
+				continue;
+			}
+			//one row of the brush, clamped to the map
+			int x0 = std::max(x-halfWidth, 0);
+			int x1 = std::min(x+halfWidth, map.getSizeX()-1);
+			changes.add(x0, y+dy, z+dz, x1, y+dy, z+dz, map.fillBox(voxel, x0, y+dy, z+dz, x1, y+dy, z+dz));
+		}
+	}
+	return changes;
+}
+
+ChangeSet Brush::floodFill(CubeMap<Voxel> &map, const std::shared_ptr<Voxel> &voxel, int x, int y, int z)
+{
+	ChangeSet changes;
+	if (x < 0 || y < 0 || z < 0 || x >= map.getSizeX() || y >= map.getSizeY() || z >= map.getSizeZ()) {
+		return changes;
+	}
+	//cubes are compared by palette index, no voxel is dereferenced
+	CubeMap<Voxel>::PaletteIndex target = map.getIndex(x, y, z);
+	if (map.getPaletteVoxel(target) == voxel.get()) {
+		return changes;
+	}
+	//scanline fill: each seed is extended to the whole row along x, then the rows
+	//around it (y-1, y+1, z-1, z+1) get one seed per run of target cubes
+	seeds_.clear();
+	seeds_.push_back(Seed{x, y, z});
+	while (!seeds_.empty()) {
+		Seed seed = seeds_.back();
+		seeds_.pop_back();
+		if (map.getIndex(seed.x, seed.y, seed.z) != target) {
+			continue;
+		}
+		int x0 = seed.x;
+		int x1 = seed.x;
+		while (x0 > 0 && map.getIndex(x0-1, seed.y, seed.z) == target) {
+			--x0;
+		}
+		while (x1 < map.getSizeX()-1 && map.getIndex(x1+1, seed.y, seed.z) == target) {
+			++x1;
+		}
+		size_t nbCubes = map.fillBox(voxel, x0, seed.y, seed.z, x1, seed.y, seed.z);
+		if (nbCubes == 0) {
+			//the palette is full, stop here
+			break;
+		}
+		changes.add(x0, seed.y, seed.z, x1, seed.y, seed.z, nbCubes);
+		static const int neighbours[4][2] = { {-1,0}, {1,0}, {0,-1}, {0,1} };
+		for (const int *n : neighbours) {
+			int ny = seed.y + n[0];
+			int nz = seed.z + n[1];
+			if (ny < 0 || nz < 0 || ny >= map.getSizeY() || nz >= map.getSizeZ()) {
+				continue;
+			}
+			bool inRun = false;
+			for (int i=x0; i<=x1; ++i) {
+				bool isTarget = map.getIndex(i, ny, nz) == target;
+				if (isTarget && !inRun) {
+					seeds_.push_back(Seed{i, ny, nz});
+				}
+				inRun = isTarget;
+			}
+		}
+	}
+	return changes;
+}
+
+ChangeSet Brush::fillBox(CubeMap<Voxel> &map, const std::shared_ptr<Voxel> &voxel, int x0, int y0, int z0, int x1, int y1, int z1)
+{
+	ChangeSet changes;
+	if (x0 > x1) std::swap(x0, x1);
+	if (y0 > y1) std::swap(y0, y1);
+	if (z0 > z1) std::swap(z0, z1);
+	x0 = std::max(x0, 0); y0 = std::max(y0, 0); z0 = std::max(z0, 0);
+	x1 = std::min(x1, map.getSizeX()-1); y1 = std::min(y1, map.getSizeY()-1); z1 = std::min(z1, map.getSizeZ()-1);
+	changes.add(x0, y0, z0, x1, y1, z1, map.fillBox(voxel, x0, y0, z0, x1, y1, z1));
+	return changes;
+}
+
+bool Brush::stringToShape(const std::string &name, BrushShape &shape)
+{
+	if (name == "diamond") {
+		shape = BrushShape::Diamond;
+	} else if (name == "square") {
+		shape = BrushShape::Square;
+	} else if (name == "circle") {
+		shape = BrushShape::Circle;
+	} else if (name == "sphere") {
+		shape = BrushShape::Sphere;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+std::string Brush::shapeToString(BrushShape shape)
+{
+	switch (shape) {
+		case BrushShape::Diamond: return "diamond";
+		case BrushShape::Square: return "square";
+		case BrushShape::Circle: return "circle";
+		case BrushShape::Sphere: return "sphere";
+	}
+	return "diamond";
+}
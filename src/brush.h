@@ -0,0 +1,83 @@
+#ifndef BRUSH_H
+#define BRUSH_H
+
+////////////////////////////////////////
+// Edit tools of the world map: shaped
+// brushes, box fill and flood fill
+////////////////////////////////////////
+//use:
+//
+//Brush brush(BrushShape::Circle, 5);
+//ChangeSet changes = brush.paint(map, voxel, x, y, z);
+//changes = Brush::fillBox(map, voxel, x0, y0, z0, x1, y1, z1);
+//changes = brush.floodFill(map, voxel, x, y, z);
+//
+//Cubes are written by rows along x with CubeMap::fillBox, so big areas
+//cost one fill per chunk row instead of one setVoxel per cube.
+//A brush of radius 1 covers one cube, radius r reaches r-1 cubes away from
+//its center. Only the sphere spreads vertically, the other shapes are flat.
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "cubeMap.h"
+#include "voxel.h"
+
+enum class BrushShape {
+	Diamond,
+	Square,
+	Circle,
+	Sphere
+};
+
+//bounding box of the cubes modified by one edit
+struct ChangeSet {
+	int minX;
+	int minY;
+	int minZ;
+	int maxX;
+	int maxY;
+	int maxZ;
+	size_t nbCubes;
+
+	ChangeSet();
+	void add(int x0, int y0, int z0, int x1, int y1, int z1, size_t cubes);
+	bool empty() const { return nbCubes == 0; }
+};
+
+class Brush
+{
+	public:
+		Brush(BrushShape shape=BrushShape::Diamond, int radius=1);
+		~Brush();
+
+		void setShape(BrushShape shape) { shape_ = shape; }
+		BrushShape getShape() const { return shape_; }
+		void setRadius(int radius);
+		int getRadius() const { return radius_; }
+		//half length of the row of the brush at the given offsets from its center, -1 if there is none
+		int getHalfWidth(int dy, int dz) const;
+		int getHeightExtent() const;
+
+		ChangeSet paint(CubeMap<Voxel> &map, const std::shared_ptr<Voxel> &voxel, int x, int y, int z) const;
+		//replace the cubes connected to x, y, z (by their faces) that have the same voxel
+		ChangeSet floodFill(CubeMap<Voxel> &map, const std::shared_ptr<Voxel> &voxel, int x, int y, int z);
+		static ChangeSet fillBox(CubeMap<Voxel> &map, const std::shared_ptr<Voxel> &voxel, int x0, int y0, int z0, int x1, int y1, int z1);
+
+		static bool stringToShape(const std::string &name, BrushShape &shape);
+		static std::string shapeToString(BrushShape shape);
+		static const int maxRadius = 256;
+
+	private:
+		struct Seed {
+			int x;
+			int y;
+			int z;
+		};
+
+		BrushShape shape_;
+		int radius_;
+		std::vector<Seed> seeds_; //reused by each flood fill
+};
+
+#endif /* BRUSH_H */
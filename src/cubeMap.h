@@ -1,38 +1,151 @@
 #ifndef CUBEMAP_H
 #define CUBEMAP_H
 
+////////////////////////////////////////
+// 3D grid of voxels, stored by chunks of
+// chunkSize^3 cubes
+////////////////////////////////////////
+//Each different voxel is stored once in a palette, the chunks only keep
+//16 bits palette indices (index 0 is the empty cube). A chunk whose cubes all
+//have the same index doesn't allocate its cubes at all, the others only
+//allocate their layers that are inside the map (flat maps stay small).
+//Inside a chunk cubes are ordered x first, then z, then y: a row along x or a
+//whole horizontal layer of a chunk is contiguous, which fillBox uses.
+//resize can move the map by whole chunks: the chunks are then moved, not
+//copied, and only the cubes out of the old map are filled.
+//Chunks can also be read and written whole, and know if they were modified
+//since, so a map bigger than the memory can be paged (see PagedMap).
+//Chunks not accessed during maxAge calls of compressColdChunks keep their
+//cubes run-length encoded (pairs of run length and index), and are decoded
+//again by the first access. Decoding happens in const accesses too: a map
+//with compressed chunks must not be read by several threads at once.
+
 #include <glog/logging.h>
 #include <vector>
 #include <memory>
 #include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
 
 template <typename T>
 class CubeMap
 {
 	public:
+		typedef std::uint16_t PaletteIndex;
+		static const PaletteIndex emptyIndex = 0;
+		static const int chunkBits = 4;
+		static const int chunkSize = 1 << chunkBits;
+		static const int chunkVolume = chunkSize*chunkSize*chunkSize;
+
 		CubeMap(int x, int y, int z);
 
 		bool resize (int x, int y, int z);
+		//the old cubes are moved by the offsets (a positive offset grows the map on its low side,
+		//a negative one cuts it), the cubes out of the old map are set to fill
+		bool resize(int x, int y, int z, int offsetX, int offsetY, int offsetZ, const std::shared_ptr<T> &fill);
+		bool resize(int x, int y, int z, int offsetX, int offsetY, int offsetZ, PaletteIndex fill);
 		T* getVoxel (int x, int y, int z) const;
 		bool setVoxel(const std::shared_ptr<T> voxel, int x, int y, int z);
 		bool setVoxel(T *voxel, int x, int y, int z);
+		//set every cube of the box (bounds included, clamped to the map), returns the number of cubes set
+		size_t fillBox(const std::shared_ptr<T> &voxel, int x0, int y0, int z0, int x1, int y1, int z1);
+		//same with a voxel already in the palette: the palette isn't modified, so
+		//different threads can fill boxes that don't share any chunk
+		size_t fillBox(PaletteIndex index, int x0, int y0, int z0, int x1, int y1, int z1);
 		int getSizeX() const { return x_; }
 		int getSizeY() const { return y_; }
 		int getSizeZ() const { return z_; }
 		bool writeToFile(std::string filename);
-		
+
+		//palette access, emptyIndex outside of the map
+		PaletteIndex getIndex(int x, int y, int z) const;
+		//index of a voxel in the palette, added if needed (emptyIndex if the palette is full)
+		PaletteIndex getPaletteIndex(const std::shared_ptr<T> &voxel);
+		T* getPaletteVoxel(PaletteIndex index) const { return palette_[index].get(); }
+		size_t getPaletteSize() const { return palette_.size(); }
+
+		//storage statistics: chunks not uniform (decoded or compressed), and bytes used (approximation)
+		size_t getNbChunks() const { return chunks_.size(); }
+		size_t getNbAllocatedChunks() const;
+		size_t getMemoryUsage() const;
+		//chunks with compressed cubes, bytes of the decoded cubes and of the compressed ones
+		size_t getNbCompressedChunks() const;
+		size_t getResidentBytes() const;
+		size_t getCompressedBytes() const;
+		//compresses the chunks not accessed since maxAge calls (at most 65535), returns their number
+		size_t compressColdChunks(unsigned int maxAge);
+
+		//whole chunks, for paging (coordinates in chunks, cubes ordered as inside a chunk)
+		int getNbChunksX() const { return nbChunksX_; }
+		int getNbChunksY() const { return nbChunksY_; }
+		int getNbChunksZ() const { return nbChunksZ_; }
+		int getChunkLayers(int chunkY) const { return std::min(chunkSize, y_ - (chunkY << chunkBits)); }
+		//modified since it was written by writeChunk (or since the map was created)
+		bool isChunkDirty(int chunkX, int chunkY, int chunkZ) const { return chunkAt(chunkX, chunkY, chunkZ).dirty; }
+		void setChunkClean(int chunkX, int chunkY, int chunkZ) { chunkAt(chunkX, chunkY, chunkZ).dirty = false; } //once written back
+		bool isChunkEmpty(int chunkX, int chunkY, int chunkZ) const;
+		size_t getChunkBytes(int chunkX, int chunkY, int chunkZ) const;
+		void readChunk(int chunkX, int chunkY, int chunkZ, std::vector<PaletteIndex> &cubes) const;
+		void writeChunk(int chunkX, int chunkY, int chunkZ, const std::vector<PaletteIndex> &cubes, bool dirty = false);
+		void clearChunk(int chunkX, int chunkY, int chunkZ);
+
 	private:
-		std::vector<std::vector<std::vector <std::shared_ptr<T>>>> cubeMap_;
+		struct Chunk {
+			PaletteIndex uniform; //index of every cube while cubes and packed are empty
+			mutable std::vector<PaletteIndex> cubes; //one index per cube of the layers inside the map, or nothing
+			mutable std::vector<PaletteIndex> packed; //run-length encoded cubes while cubes is empty
+			mutable bool accessed; //cubes accessed since the last call of compressColdChunks
+			std::uint16_t coldAge; //calls of compressColdChunks without any access
+			bool dirty;
+		};
+
+		std::vector<Chunk> chunks_;
+		int nbChunksX_;
+		int nbChunksY_;
+		int nbChunksZ_;
+		std::vector<std::shared_ptr<T>> palette_;
+		std::unordered_map<const T*, PaletteIndex> paletteIndices_;
 		int x_;
 		int y_;
 		int z_;
 
 		bool validCoord(int x, int y, int z) const;
+		Chunk& getChunk(int x, int y, int z) { return chunks_[(x >> chunkBits) + nbChunksX_*((y >> chunkBits) + nbChunksY_*(z >> chunkBits))]; }
+		const Chunk& getChunk(int x, int y, int z) const { return chunks_[(x >> chunkBits) + nbChunksX_*((y >> chunkBits) + nbChunksY_*(z >> chunkBits))]; }
+		Chunk& chunkAt(int i, int j, int k) { return chunks_[i + nbChunksX_*(j + nbChunksY_*k)]; }
+		const Chunk& chunkAt(int i, int j, int k) const { return chunks_[i + nbChunksX_*(j + nbChunksY_*k)]; }
+		static int cubeOffset(int x, int y, int z) { return (x & (chunkSize-1)) | (z & (chunkSize-1)) << chunkBits | (y & (chunkSize-1)) << (2*chunkBits); }
+		void setIndex(PaletteIndex index, int x, int y, int z);
+		static void touch(const Chunk &chunk);
+		static void decode(const Chunk &chunk);
+		static void pack(const std::vector<PaletteIndex> &cubes, std::vector<PaletteIndex> &packed);
+		static void unpack(const std::vector<PaletteIndex> &packed, std::vector<PaletteIndex> &cubes);
+		void fillChunk(Chunk &chunk, int layers, PaletteIndex index, int x0, int y0, int z0, int x1, int y1, int z1);
+		bool compactPalette();
 
 };
 
 template <typename T>
-CubeMap<T>::CubeMap(int x, int y, int z)
+const typename CubeMap<T>::PaletteIndex CubeMap<T>::emptyIndex;
+template <typename T>
+const int CubeMap<T>::chunkBits;
+template <typename T>
+const int CubeMap<T>::chunkSize;
+template <typename T>
+const int CubeMap<T>::chunkVolume;
+
+template <typename T>
+CubeMap<T>::CubeMap(int x, int y, int z):
+	chunks_{},
+	nbChunksX_{0},
+	nbChunksY_{0},
+	nbChunksZ_{0},
+	palette_(1, std::shared_ptr<T>()),
+	paletteIndices_{},
+	x_{0},
+	y_{0},
+	z_{0}
 {
 	if (!resize(x, y, z)) {
 			x_ = 0;
@@ -43,6 +156,22 @@ CubeMap<T>::CubeMap(int x, int y, int z)
 
 template <typename T>
 bool CubeMap<T>::resize(int x, int y, int z)
+{
+	return resize(x, y, z, 0, 0, 0, emptyIndex);
+}
+
+template <typename T>
+bool CubeMap<T>::resize(int x, int y, int z, int offsetX, int offsetY, int offsetZ, const std::shared_ptr<T> &fill)
+{
+	PaletteIndex index = getPaletteIndex(fill);
+	if (index == emptyIndex && fill) {
+		return false;
+	}
+	return resize(x, y, z, offsetX, offsetY, offsetZ, index);
+}
+
+template <typename T>
+bool CubeMap<T>::resize(int x, int y, int z, int offsetX, int offsetY, int offsetZ, PaletteIndex fill)
 {
 	//check if new sizes are corrects
 	if (x <= 0 || y <= 0 || z<= 0) {
@@ -50,18 +179,87 @@ bool CubeMap<T>::resize(int x, int y, int z)
 		return false;
 	}
 
-	cubeMap_.resize(x);
-	for (auto &yVal : cubeMap_) {
-		yVal.resize(y);
-		for (auto &zVal : yVal) {
-			zVal.resize(z);
+	int nbX = (x+chunkSize-1) >> chunkBits;
+	int nbY = (y+chunkSize-1) >> chunkBits;
+	int nbZ = (z+chunkSize-1) >> chunkBits;
+	std::vector<Chunk> chunks(nbX*nbY*nbZ, Chunk{emptyIndex, {}, {}, false, 0, false});
+	const int last = chunkSize-1;
+	size_t nbMoved = 0;
+	for (int k=0; k<nbZ; ++k) {
+		for (int j=0; j<nbY; ++j) {
+			for (int i=0; i<nbX; ++i) {
+				Chunk &chunk = chunks[i + nbX*(j + nbY*k)];
+				//cubes of the chunk inside the new map, and where they were in the old one
+				int x0 = i << chunkBits;
+				int y0 = j << chunkBits;
+				int z0 = k << chunkBits;
+				int x1 = std::min(x0+last, x-1);
+				int layers = std::min(chunkSize, y-y0);
+				int z1 = std::min(z0+last, z-1);
+				int oldX0 = x0-offsetX;
+				int oldY0 = y0-offsetY;
+				int oldZ0 = z0-offsetZ;
+				//a whole old chunk with the same layers is moved without copying its cubes
+				if (((oldX0 | oldY0 | oldZ0) & last) == 0 && oldX0 >= 0 && oldY0 >= 0 && oldZ0 >= 0
+					&& x1 == x0+last && z1 == z0+last && oldX0+last < x_ && oldZ0+last < z_
+					&& std::min(chunkSize, y_-oldY0) == layers) {
+					chunk = std::move(chunks_[(oldX0 >> chunkBits) + nbChunksX_*((oldY0 >> chunkBits) + nbChunksY_*(oldZ0 >> chunkBits))]);
+					++nbMoved;
+					continue;
+				}
+				//otherwise the new cubes are filled, then the old ones are copied by rows
+				fillChunk(chunk, layers, fill, 0, 0, 0, x1-x0, layers-1, z1-z0);
+				int ox0 = std::max(oldX0, 0);
+				int oy0 = std::max(oldY0, 0);
+				int oz0 = std::max(oldZ0, 0);
+				int ox1 = std::min(x1-offsetX, x_-1);
+				int oy1 = std::min(oldY0+layers-1, y_-1);
+				int oz1 = std::min(z1-offsetZ, z_-1);
+				if (ox0 > ox1 || oy0 > oy1 || oz0 > oz1) {
+					continue;
+				}
+				for (int ok=oz0 >> chunkBits; ok<=oz1 >> chunkBits; ++ok) {
+					for (int oj=oy0 >> chunkBits; oj<=oy1 >> chunkBits; ++oj) {
+						for (int oi=ox0 >> chunkBits; oi<=ox1 >> chunkBits; ++oi) {
+							const Chunk &old = chunks_[oi + nbChunksX_*(oj + nbChunksY_*ok)];
+							touch(old);
+							//part of the old chunk copied, in old map coordinates
+							int px0 = std::max(ox0, oi << chunkBits);
+							int py0 = std::max(oy0, oj << chunkBits);
+							int pz0 = std::max(oz0, ok << chunkBits);
+							int px1 = std::min(ox1, (oi << chunkBits) + last);
+							int py1 = std::min(oy1, (oj << chunkBits) + last);
+							int pz1 = std::min(oz1, (ok << chunkBits) + last);
+							if (old.cubes.empty()) {
+								fillChunk(chunk, layers, old.uniform, px0+offsetX-x0, py0+offsetY-y0, pz0+offsetZ-z0,
+									px1+offsetX-x0, py1+offsetY-y0, pz1+offsetZ-z0);
+								continue;
+							}
+							if (chunk.cubes.empty()) {
+								chunk.cubes.assign(layers*chunkSize*chunkSize, chunk.uniform);
+							}
+							for (int py=py0; py<=py1; ++py) {
+								for (int pz=pz0; pz<=pz1; ++pz) {
+									const PaletteIndex *row = &old.cubes[cubeOffset(px0, py, pz)];
+									std::copy(row, row + (px1-px0+1), &chunk.cubes[cubeOffset(px0+offsetX, py+offsetY, pz+offsetZ)]);
+								}
+							}
+						}
+					}
+				}
+			}
 		}
 	}
-	
+	chunks_.swap(chunks);
+	nbChunksX_ = nbX;
+	nbChunksY_ = nbY;
+	nbChunksZ_ = nbZ;
 	x_ = x;
 	y_ = y;
 	z_ = z;
-	LOG(INFO) << "cubeMap resized to size: x=" << x << " y=" << y << " z=" << z;
+
+	LOG(INFO) << "cubeMap resized to size: x=" << x << " y=" << y << " z=" << z
+		<< " (offset " << offsetX << "," << offsetY << "," << offsetZ << ", " << nbMoved << " chunks moved)";
 	return true;
 }
 
@@ -72,11 +270,7 @@ T* CubeMap<T>::getVoxel(int x, int y, int z) const
 		//~ LOG(WARNING) << "Coordinates out of range: x=" << x << " y=" << y << " z=" << z;
 		return nullptr;
 	}
-	if (cubeMap_[x][y][z] == nullptr) {
-		//~ LOG(WARNING) << "Trying to access a non-initialized voxel at: x=" << x << " y=" << y << " z=" << z;
-		return nullptr;
-	}
-	return cubeMap_[x][y][z].get();
+	return palette_[getIndex(x, y, z)].get();
 }
 
 template <typename T>
@@ -86,7 +280,11 @@ bool CubeMap<T>::setVoxel(const std::shared_ptr<T> voxel, int x, int y, int z)
 		LOG(WARNING) << "Cannot set voxel at the given coord: x=" << x << " y=" << y << " z=" << z;
 		return false;
 	}
-	cubeMap_[x][y][z] = voxel;
+	PaletteIndex index = getPaletteIndex(voxel);
+	if (index == emptyIndex && voxel) {
+		return false;
+	}
+	setIndex(index, x, y, z);
 	return true;
 }
 
@@ -97,9 +295,312 @@ bool CubeMap<T>::setVoxel(T *voxel, int x, int y, int z)
 		LOG(WARNING) << "Cannot set voxel at the given coord: x=" << x << " y=" << y << " z=" << z;
 		return false;
 	}
+	//a voxel already in the palette keeps its owner
+	auto it = paletteIndices_.find(voxel);
+	if (it != paletteIndices_.end()) {
+		setIndex(it->second, x, y, z);
+		return true;
+	}
 	auto voxPtr = std::shared_ptr<T>(voxel);
-	cubeMap_[x][y][z] = voxPtr;	
-	return true;
+	return setVoxel(voxPtr, x, y, z);
+}
+
+template <typename T>
+size_t CubeMap<T>::fillBox(const std::shared_ptr<T> &voxel, int x0, int y0, int z0, int x1, int y1, int z1)
+{
+	x0 = std::max(x0, 0); y0 = std::max(y0, 0); z0 = std::max(z0, 0);
+	x1 = std::min(x1, x_-1); y1 = std::min(y1, y_-1); z1 = std::min(z1, z_-1);
+	if (x0 > x1 || y0 > y1 || z0 > z1) {
+		return 0;
+	}
+	PaletteIndex index = getPaletteIndex(voxel);
+	if (index == emptyIndex && voxel) {
+		return 0;
+	}
+	return fillBox(index, x0, y0, z0, x1, y1, z1);
+}
+
+template <typename T>
+size_t CubeMap<T>::fillBox(PaletteIndex index, int x0, int y0, int z0, int x1, int y1, int z1)
+{
+	x0 = std::max(x0, 0); y0 = std::max(y0, 0); z0 = std::max(z0, 0);
+	x1 = std::min(x1, x_-1); y1 = std::min(y1, y_-1); z1 = std::min(z1, z_-1);
+	if (x0 > x1 || y0 > y1 || z0 > z1) {
+		return 0;
+	}
+	const int last = chunkSize-1;
+	for (int k=z0 >> chunkBits; k<=z1 >> chunkBits; ++k) {
+		for (int j=y0 >> chunkBits; j<=y1 >> chunkBits; ++j) {
+			for (int i=x0 >> chunkBits; i<=x1 >> chunkBits; ++i) {
+				//part of the box inside this chunk, in chunk coordinates
+				int cx0 = std::max(x0 - (i << chunkBits), 0);
+				int cy0 = std::max(y0 - (j << chunkBits), 0);
+				int cz0 = std::max(z0 - (k << chunkBits), 0);
+				int cx1 = std::min(x1 - (i << chunkBits), last);
+				int cy1 = std::min(y1 - (j << chunkBits), last);
+				int cz1 = std::min(z1 - (k << chunkBits), last);
+				fillChunk(chunks_[i + nbChunksX_*(j + nbChunksY_*k)], getChunkLayers(j), index, cx0, cy0, cz0, cx1, cy1, cz1);
+			}
+		}
+	}
+	return static_cast<size_t>(x1-x0+1)*(y1-y0+1)*(z1-z0+1);
+}
+
+//inline: called for each cube by the mesher and the brushes
+template <typename T>
+inline typename CubeMap<T>::PaletteIndex CubeMap<T>::getIndex(int x, int y, int z) const
+{
+	if (!validCoord(x, y, z)) {
+		return emptyIndex;
+	}
+	const Chunk &chunk = getChunk(x, y, z);
+	if (chunk.cubes.empty()) {
+		if (chunk.packed.empty()) {
+			return chunk.uniform;
+		}
+		decode(chunk);
+	}
+	chunk.accessed = true;
+	return chunk.cubes[cubeOffset(x, y, z)];
+}
+
+template <typename T>
+typename CubeMap<T>::PaletteIndex CubeMap<T>::getPaletteIndex(const std::shared_ptr<T> &voxel)
+{
+	if (!voxel) {
+		return emptyIndex;
+	}
+	auto it = paletteIndices_.find(voxel.get());
+	if (it != paletteIndices_.end()) {
+		return it->second;
+	}
+	if (palette_.size() > 0xFFFF && !compactPalette()) {
+		LOG(ERROR) << "Too many different voxels in the cubeMap";
+		return emptyIndex;
+	}
+	PaletteIndex index = static_cast<PaletteIndex>(palette_.size());
+	palette_.push_back(voxel);
+	paletteIndices_[voxel.get()] = index;
+	return index;
+}
+
+template <typename T>
+void CubeMap<T>::setIndex(PaletteIndex index, int x, int y, int z)
+{
+	Chunk &chunk = getChunk(x, y, z);
+	touch(chunk);
+	if (chunk.cubes.empty()) {
+		if (chunk.uniform == index) {
+			return;
+		}
+		chunk.cubes.assign(getChunkLayers(y >> chunkBits)*chunkSize*chunkSize, chunk.uniform);
+	}
+	chunk.cubes[cubeOffset(x, y, z)] = index;
+	chunk.dirty = true;
+}
+
+//coordinates are inside the chunk, bounds included
+template <typename T>
+void CubeMap<T>::fillChunk(Chunk &chunk, int layers, PaletteIndex index, int x0, int y0, int z0, int x1, int y1, int z1)
+{
+	const int last = chunkSize-1;
+	bool fullLayers = (x0 == 0 && x1 == last && z0 == 0 && z1 == last);
+	if (fullLayers && y0 == 0 && y1 == layers-1) {
+		chunk.dirty = chunk.dirty || chunk.uniform != index || !chunk.cubes.empty() || !chunk.packed.empty();
+		chunk.uniform = index;
+		std::vector<PaletteIndex>().swap(chunk.cubes);
+		std::vector<PaletteIndex>().swap(chunk.packed);
+		return;
+	}
+	touch(chunk);
+	if (chunk.cubes.empty()) {
+		if (chunk.uniform == index) {
+			return;
+		}
+		chunk.cubes.assign(layers*chunkSize*chunkSize, chunk.uniform);
+	}
+	chunk.dirty = true;
+	PaletteIndex *cubes = &chunk.cubes[0];
+	if (fullLayers) {
+		std::fill(cubes + cubeOffset(0, y0, 0), cubes + cubeOffset(0, y1, 0) + chunkSize*chunkSize, index);
+		return;
+	}
+	for (int y=y0; y<=y1; ++y) {
+		for (int z=z0; z<=z1; ++z) {
+			std::fill(cubes + cubeOffset(x0, y, z), cubes + cubeOffset(x1, y, z) + 1, index);
+		}
+	}
+}
+
+//drop the voxels no cube uses anymore (indices change)
+template <typename T>
+bool CubeMap<T>::compactPalette()
+{
+	std::vector<PaletteIndex> remap(palette_.size(), emptyIndex);
+	for (const Chunk &chunk : chunks_) {
+		remap[chunk.uniform] = 1;
+		for (PaletteIndex index : chunk.cubes) {
+			remap[index] = 1;
+		}
+		for (size_t run=1; run<chunk.packed.size(); run+=2) {
+			remap[chunk.packed[run]] = 1;
+		}
+	}
+	//the empty cube keeps its index
+	remap[emptyIndex] = emptyIndex;
+	std::vector<std::shared_ptr<T>> palette(1, std::shared_ptr<T>());
+	paletteIndices_.clear();
+	for (size_t index=1; index<palette_.size(); ++index) {
+		if (remap[index]) {
+			remap[index] = static_cast<PaletteIndex>(palette.size());
+			paletteIndices_[palette_[index].get()] = remap[index];
+			palette.push_back(palette_[index]);
+		}
+	}
+	for (Chunk &chunk : chunks_) {
+		chunk.uniform = remap[chunk.uniform];
+		for (PaletteIndex &index : chunk.cubes) {
+			index = remap[index];
+		}
+		for (size_t run=1; run<chunk.packed.size(); run+=2) {
+			chunk.packed[run] = remap[chunk.packed[run]];
+		}
+	}
+	palette_.swap(palette);
+	LOG(INFO) << "cubeMap palette compacted to " << palette_.size() << " voxels";
+	return palette_.size() <= 0xFFFF;
+}
+
+template <typename T>
+void CubeMap<T>::readChunk(int chunkX, int chunkY, int chunkZ, std::vector<PaletteIndex> &cubes) const
+{
+	const Chunk &chunk = chunkAt(chunkX, chunkY, chunkZ);
+	//a compressed chunk stays compressed, reading it for paging isn't an access
+	if (!chunk.packed.empty()) {
+		unpack(chunk.packed, cubes);
+	} else if (chunk.cubes.empty()) {
+		cubes.assign(getChunkLayers(chunkY)*chunkSize*chunkSize, chunk.uniform);
+	} else {
+		cubes = chunk.cubes;
+	}
+}
+
+//the cubes of the chunk layers inside the map, the chunk doesn't allocate them if they are all the same
+template <typename T>
+void CubeMap<T>::writeChunk(int chunkX, int chunkY, int chunkZ, const std::vector<PaletteIndex> &cubes, bool dirty)
+{
+	Chunk &chunk = chunkAt(chunkX, chunkY, chunkZ);
+	chunk.dirty = dirty;
+	chunk.accessed = true;
+	std::vector<PaletteIndex>().swap(chunk.packed);
+	if (cubes.empty() || std::count(cubes.begin(), cubes.end(), cubes[0]) == static_cast<std::ptrdiff_t>(cubes.size())) {
+		chunk.uniform = cubes.empty() ? emptyIndex : cubes[0];
+		std::vector<PaletteIndex>().swap(chunk.cubes);
+		return;
+	}
+	chunk.cubes = cubes;
+}
+
+template <typename T>
+bool CubeMap<T>::isChunkEmpty(int chunkX, int chunkY, int chunkZ) const
+{
+	const Chunk &chunk = chunkAt(chunkX, chunkY, chunkZ);
+	return chunk.cubes.empty() && chunk.packed.empty() && chunk.uniform == emptyIndex;
+}
+
+//the chunk is emptied and frees its cubes
+template <typename T>
+void CubeMap<T>::clearChunk(int chunkX, int chunkY, int chunkZ)
+{
+	Chunk &chunk = chunkAt(chunkX, chunkY, chunkZ);
+	chunk.uniform = emptyIndex;
+	std::vector<PaletteIndex>().swap(chunk.cubes);
+	std::vector<PaletteIndex>().swap(chunk.packed);
+	chunk.dirty = false;
+}
+
+template <typename T>
+size_t CubeMap<T>::getChunkBytes(int chunkX, int chunkY, int chunkZ) const
+{
+	const Chunk &chunk = chunkAt(chunkX, chunkY, chunkZ);
+	return (chunk.cubes.capacity() + chunk.packed.capacity())*sizeof(PaletteIndex);
+}
+
+//the cubes of a compressed chunk are decoded before being accessed
+template <typename T>
+void CubeMap<T>::touch(const Chunk &chunk)
+{
+	chunk.accessed = true;
+	if (!chunk.packed.empty()) {
+		decode(chunk);
+	}
+}
+
+//kept out of getIndex, which stays small enough to be inlined
+template <typename T>
+void CubeMap<T>::decode(const Chunk &chunk)
+{
+	unpack(chunk.packed, chunk.cubes);
+	std::vector<PaletteIndex>().swap(chunk.packed);
+}
+
+template <typename T>
+void CubeMap<T>::pack(const std::vector<PaletteIndex> &cubes, std::vector<PaletteIndex> &packed)
+{
+	packed.clear();
+	for (size_t start=0; start<cubes.size();) {
+		size_t end = start+1;
+		while (end < cubes.size() && cubes[end] == cubes[start]) {
+			++end;
+		}
+		//a chunk has at most chunkVolume cubes, a run always fits in an index
+		packed.push_back(static_cast<PaletteIndex>(end-start));
+		packed.push_back(cubes[start]);
+		start = end;
+	}
+}
+
+template <typename T>
+void CubeMap<T>::unpack(const std::vector<PaletteIndex> &packed, std::vector<PaletteIndex> &cubes)
+{
+	size_t nbCubes = 0;
+	for (size_t run=0; run<packed.size(); run+=2) {
+		nbCubes += packed[run];
+	}
+	cubes.clear();
+	cubes.reserve(nbCubes);
+	for (size_t run=0; run<packed.size(); run+=2) {
+		cubes.insert(cubes.end(), static_cast<size_t>(packed[run]), packed[run+1]);
+	}
+}
+
+template <typename T>
+size_t CubeMap<T>::compressColdChunks(unsigned int maxAge)
+{
+	size_t nbCompressed = 0;
+	std::vector<PaletteIndex> packed;
+	for (Chunk &chunk : chunks_) {
+		//a chunk accessed since the previous call gets young again
+		if (chunk.accessed) {
+			chunk.accessed = false;
+			chunk.coldAge = 0;
+		} else if (chunk.coldAge < 0xFFFF) {
+			++chunk.coldAge;
+		}
+		if (chunk.cubes.empty() || chunk.coldAge < maxAge) {
+			continue;
+		}
+		pack(chunk.cubes, packed);
+		//not compressed if it doesn't save half of the memory, tried again after maxAge calls
+		chunk.coldAge = 0;
+		if (packed.size()*2 > chunk.cubes.size()) {
+			continue;
+		}
+		chunk.packed.assign(packed.begin(), packed.end());
+		std::vector<PaletteIndex>().swap(chunk.cubes);
+		++nbCompressed;
+	}
+	return nbCompressed;
 }
 
 template <typename T>
@@ -108,6 +609,63 @@ bool CubeMap<T>::validCoord(int x, int y, int z) const
 	return (x >= 0 && y >= 0 && z >= 0 && x < x_ && y < y_ && z < z_);
 }
 
+template <typename T>
+size_t CubeMap<T>::getNbAllocatedChunks() const
+{
+	size_t nbAllocated = 0;
+	for (const Chunk &chunk : chunks_) {
+		if (!chunk.cubes.empty() || !chunk.packed.empty()) {
+			++nbAllocated;
+		}
+	}
+	return nbAllocated;
+}
+
+template <typename T>
+size_t CubeMap<T>::getMemoryUsage() const
+{
+	size_t bytes = sizeof(*this) + chunks_.capacity()*sizeof(Chunk) + palette_.capacity()*sizeof(std::shared_ptr<T>);
+	//hash table nodes hold the pair and a link
+	bytes += paletteIndices_.size()*(sizeof(typename std::unordered_map<const T*, PaletteIndex>::value_type) + sizeof(void*))
+			+ paletteIndices_.bucket_count()*sizeof(void*);
+	for (const Chunk &chunk : chunks_) {
+		bytes += (chunk.cubes.capacity() + chunk.packed.capacity())*sizeof(PaletteIndex);
+	}
+	return bytes;
+}
+
+template <typename T>
+size_t CubeMap<T>::getNbCompressedChunks() const
+{
+	size_t nbCompressed = 0;
+	for (const Chunk &chunk : chunks_) {
+		if (!chunk.packed.empty()) {
+			++nbCompressed;
+		}
+	}
+	return nbCompressed;
+}
+
+template <typename T>
+size_t CubeMap<T>::getResidentBytes() const
+{
+	size_t bytes = 0;
+	for (const Chunk &chunk : chunks_) {
+		bytes += chunk.cubes.capacity()*sizeof(PaletteIndex);
+	}
+	return bytes;
+}
+
+template <typename T>
+size_t CubeMap<T>::getCompressedBytes() const
+{
+	size_t bytes = 0;
+	for (const Chunk &chunk : chunks_) {
+		bytes += chunk.packed.capacity()*sizeof(PaletteIndex);
+	}
+	return bytes;
+}
+
 template <typename T>
 bool CubeMap<T>::writeToFile(std::string filename)
 {
@@ -117,8 +675,8 @@ bool CubeMap<T>::writeToFile(std::string filename)
 		for (int i=z_-1; i>-1; --i) {
 				for (int j=0; j<y_; ++j) {
 					for (int k=0; k<x_; ++k) {
-						if (cubeMap_[k][j][i]) {
-							file << cubeMap_[k][j][i]->getInfos();
+						if (T *voxel = getVoxel(k, j, i)) {
+							file << voxel->getInfos();
 						} else {
 							file << "NULL";
 						}
@@ -151,4 +709,4 @@ bool CubeMap<T>::writeToFile(std::string filename)
 
 
 
-#endif /* CUBEMAP_H */ 
+#endif /* CUBEMAP_H */
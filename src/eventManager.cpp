@@ -2,6 +2,8 @@
 #include <glog/logging.h>
 #include <iostream>
 #include <algorithm>
+#include "profiler.h"
+#include "metrics.h"
 
 EventManager::EventManager(const std::string name, const bool log=true):
 	log_{log},
@@ -35,6 +37,7 @@ int EventManager::subscribe(const std::string eventName, const CallBkFunc lambda
 	cbk.lambdaFunc = lambdaFunc;
 	registeredCbks_.insert( {eventName,cbk} );
 	++idCount_;
+	Metrics::setGauge("events.subscriptions", registeredCbks_.size());
 	return cbk.id;	
 }
 
@@ -44,6 +47,7 @@ bool EventManager::unsubscribe(const int id)
 		if (it->second.id == id) {
 			LOG(INFO) << "Unsubscribe listener with ID = " << id;
 			registeredCbks_.erase(it);
+			Metrics::setGauge("events.subscriptions", registeredCbks_.size());
 			return true;
 		}
 	}
@@ -55,6 +59,7 @@ void EventManager::sendEvent(const std::string eventName, const Arguments args)
 		LOG(INFO) << "New event received: " << eventName;
 		MyEvent ev = { eventName, args };
 		eventQueue_.push(ev);
+		Metrics::increment("events.sent");
 		
 		if (log_) {
 			logFile_.open(logFileName_, std::ios::app);
@@ -72,12 +77,15 @@ void EventManager::processEvents()
 	
 	if (!eventQueue_.empty()) {
 		LOG(INFO) << "========== Start processing events in queue ==========";
+		Metrics::observe("events.batchSize", eventQueue_.size());
 		while (!eventQueue_.empty()) {
 			auto it = registeredCbks_.equal_range(eventQueue_.front().eventName);
 			LOG(INFO) << "Processing some events in queue: " << eventQueue_.front().eventName;
 			for (auto it2 = it.first; it2 != it.second; ++it2) {
 				LOG(INFO) << "Call a matching method for event: " << "\"" << eventQueue_.front().eventName << "\"";
+				ProfileZone zone(Profiler::isEnabled() ? "event:" + eventQueue_.front().eventName : std::string());
 				it2->second.lambdaFunc(it2->first, eventQueue_.front().args);
+				Metrics::increment("events.callbacks");
 			}
 			eventQueue_.pop();
 		}
@@ -0,0 +1,86 @@
+#include "frameScheduler.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+//sleeping is not precise, the end of a wait is spent yielding
+const std::chrono::milliseconds spinMargin(1);
+
+}
+
+FrameScheduler::FrameScheduler(int tickRate, int fpsLimit, bool vsync, int maxTicksPerFrame):
+	tickDuration_{1000 / static_cast<unsigned long>(std::max(1, std::min(tickRate, 1000)))},
+	tickInterval_{std::chrono::milliseconds(tickDuration_)},
+	frameInterval_{Clock::duration::zero()},
+	vsync_{vsync},
+	maxTicksPerFrame_{std::max(1, maxTicksPerFrame)},
+	start_{Clock::now()},
+	nextTick_{start_},
+	nextFrame_{start_}
+{
+	if (fpsLimit > 0) {
+		frameInterval_ = std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / fpsLimit;
+	}
+	LOG(INFO) << "Frame scheduler: a tick every " << tickDuration_ << "ms, fps limit " << fpsLimit << (vsync_ ? " with vsync" : "");
+}
+
+FrameScheduler::~FrameScheduler()
+{
+
+}
+
+void FrameScheduler::waitForWork()
+{
+	if (vsync_) {
+		//the next frame is always due, rendering waits for the screen
+		return;
+	}
+	Clock::time_point deadline = std::min(nextTick_, nextFrame_);
+	Clock::time_point now = Clock::now();
+	if (deadline - now > spinMargin) {
+		std::this_thread::sleep_for(deadline - now - spinMargin);
+	}
+	while (Clock::now() < deadline) {
+		std::this_thread::yield();
+	}
+}
+
+int FrameScheduler::takeTicks()
+{
+	Clock::time_point now = Clock::now();
+	int nbTicks = 0;
+	while (nextTick_ <= now && nbTicks < maxTicksPerFrame_) {
+		nextTick_ += tickInterval_;
+		++nbTicks;
+	}
+	if (nextTick_ <= now) {
+		//too late to catch up (breakpoint, long loading...)
+		LOG(WARNING) << "Simulation late by " << std::chrono::duration_cast<std::chrono::milliseconds>(now - nextTick_).count() << "ms, skipping ticks";
+		nextTick_ = now + tickInterval_;
+	}
+	return nbTicks;
+}
+
+bool FrameScheduler::takeFrame()
+{
+	if (vsync_) {
+		return true;
+	}
+	Clock::time_point now = Clock::now();
+	if (now < nextFrame_) {
+		return false;
+	}
+	nextFrame_ += frameInterval_;
+	if (nextFrame_ <= now) {
+		//keep a regular pace after a slow frame instead of rendering in burst
+		nextFrame_ = now + frameInterval_;
+	}
+	return true;
+}
+
+unsigned long FrameScheduler::getMilliseconds() const
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start_).count();
+}
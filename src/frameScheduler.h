@@ -0,0 +1,55 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+////////////////////////////////////////
+// Pace of the main loop: simulation
+// ticks of fixed duration, frames at
+// their own rate, sleep in between
+////////////////////////////////////////
+//use:
+//
+//FrameScheduler scheduler(100, 60, false); //ticks per second, fps limit, vsync
+//while (running) {
+//	scheduler.waitForWork(); //sleeps until the next tick or frame is due
+//	for (int i=scheduler.takeTicks(); i>0; --i) {
+//		update(scheduler.getTickDuration());
+//	}
+//	if (scheduler.takeFrame()) {
+//		render();
+//	}
+//}
+//
+//A fps limit of 0 renders on every loop. With vsync the buffer swap already
+//blocks until the screen refresh, so frames are never delayed by the scheduler.
+//When the simulation is late, at most maxTicksPerFrame ticks are run in a row
+//and the rest of the delay is dropped.
+
+#include <chrono>
+
+class FrameScheduler
+{
+	public:
+		FrameScheduler(int tickRate, int fpsLimit, bool vsync, int maxTicksPerFrame = 5);
+		~FrameScheduler();
+
+		void waitForWork();
+		int takeTicks();
+		bool takeFrame();
+		//duration of a tick in ms, simulated time always matches real time
+		unsigned long getTickDuration() const { return tickDuration_; }
+		unsigned long getMilliseconds() const;
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		unsigned long tickDuration_;
+		Clock::duration tickInterval_;
+		Clock::duration frameInterval_;
+		bool vsync_;
+		int maxTicksPerFrame_;
+		Clock::time_point start_;
+		Clock::time_point nextTick_;
+		Clock::time_point nextFrame_;
+};
+
+#endif /* FRAMESCHEDULER_H */
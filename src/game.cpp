@@ -6,23 +6,25 @@ Game::Game():
 	keymap_{nullptr},
 	running_{false},
 	currentMap_{nullptr},
+	scheduler_{nullptr},
 	nbFrames_{0},
-	lastFpsCalcul_{0},
-	currentTime_{0},
-	fpsLimit_{90},
-	timeBetweenFrames_{static_cast<unsigned long>(1000/fpsLimit_)},
-	lastFrameTime_(0)
+	nbTicks_{0},
+	lastFpsCalcul_{0}
 
 {
 	graphics_ = nullptr;
 	input_ = nullptr;
 	currentState_ = nullptr;
 	
-	timer_.reset();
 	EventMgrFactory::createEvtMgr("main");	
 	loadOptions();
+	Profiler::setEnabled(config_->getValue<bool>("profiler"));
 	
 	subscribe("quitGame", [this](std::string eventName, Arguments args){ running_ = false; });
+	subscribe("writeProfilerTrace", [this](std::string eventName, Arguments args){
+		Profiler::setEnabled(true);
+		Profiler::writeChromeTrace("profilerTrace.json");
+	});
 }
 
 Game::~Game()
@@ -42,12 +44,16 @@ bool Game::start()
 		keymap_.get());
 
 	//load a state
-	currentState_ = std::unique_ptr<WorldMapState>(new WorldMapState(graphics_->getOgre(), graphics_->getWindow()));
+	currentState_ = std::unique_ptr<WorldMapState>(new WorldMapState(config_.get(), graphics_->getOgre(), graphics_->getWindow()));
 	//load a map
 	Arguments args;
 	args["data"] = std::string("testMap.lua");
 	EventMgrFactory::getCurrentEvtMgr()->sendEvent("loadWorldMap", args);	
 	
+	scheduler_ = std::unique_ptr<FrameScheduler>(new FrameScheduler(
+		config_->getValue<int>("tickRate"),
+		config_->getValue<int>("fpsLimit"),
+		config_->getValue<bool>("vsync")));
 	running_ = true;
 	return true;
 }
@@ -60,23 +66,37 @@ bool Game::isRunning() const
 void Game::update()
 {
 	//~ LOG(INFO) << "Updating game";
-	unsigned long timeLapsed = timer_.getMilliseconds() - lastFrameTime_;
-	input_->capture();
-	EventMgrFactory::getCurrentEvtMgr()->processEvents();
-	currentState_->update(timeLapsed);
-	if (timeLapsed >= timeBetweenFrames_) {
-		graphics_->renderFrame();
+	//sleep until there is something to do instead of spinning
+	scheduler_->waitForWork();
+	{
+		PROFILE_ZONE("inputCapture");
+		input_->capture();
+	}
+	{
+		PROFILE_ZONE("processEvents");
+		EventMgrFactory::getCurrentEvtMgr()->processEvents();
+	}
+	//the simulation advances by fixed steps, whatever the frame rate
+	for (int ticks=scheduler_->takeTicks(); ticks>0; --ticks) {
+		currentState_->update(scheduler_->getTickDuration());
+		++nbTicks_;
+	}
+	if (scheduler_->takeFrame()) {
+		{
+			PROFILE_ZONE("renderFrame");
+			graphics_->renderFrame();
+		}
 		++nbFrames_;
-		lastFrameTime_ = timer_.getMilliseconds();
+		Profiler::endFrame();
 	}
 	//calcul framerate every 2sec
-	//~ LOG(INFO) << timeBetweenFrames_;
-	currentTime_ = timer_.getMilliseconds();
-	if ((currentTime_ - lastFpsCalcul_) > 2000) {
-		int fps = nbFrames_*1000 / (currentTime_ - lastFpsCalcul_); // *1000 because time is in ms, we want it in s
-		LOG(INFO) << "FPS: " << fps << " nbFrames: " << nbFrames_;
-		lastFpsCalcul_ = currentTime_;
+	unsigned long currentTime = scheduler_->getMilliseconds();
+	if ((currentTime - lastFpsCalcul_) > 2000) {
+		int fps = nbFrames_*1000 / (currentTime - lastFpsCalcul_); // *1000 because time is in ms, we want it in s
+		LOG(INFO) << "FPS: " << fps << " nbFrames: " << nbFrames_ << " nbTicks: " << nbTicks_;
+		lastFpsCalcul_ = currentTime;
 		nbFrames_ = 0;
+		nbTicks_ = 0;
 	}
 }
 
@@ -89,6 +109,26 @@ bool Game::loadOptions()
 	defaults["fullscreen"] = "0";
 	defaults["width"] = "800";
 	defaults["height"] = "600";
+	defaults["materialsFile"] = "../media/materials.lua";
+	defaults["chunkVertexFormat"] = "float";
+	defaults["chunkDedupVertices"] = "1";
+	defaults["chunkShortIndices"] = "1";
+	defaults["chunkCulling"] = "1";
+	defaults["chunkRegionSize"] = "1";
+	defaults["coldChunkDelay"] = "30";
+	defaults["lodDistance"] = "4000";
+	defaults["meshCacheFile"] = "chunkMeshes.cache";
+	defaults["meshCacheSize"] = "256";
+	defaults["gpuBufferPoolSize"] = "64";
+	defaults["pagedMapBudget"] = "256";
+	defaults["pagedMapRadius"] = "512";
+	defaults["generatorThreads"] = "0";
+	defaults["tickRate"] = "100";
+	defaults["fpsLimit"] = "90";
+	defaults["vsync"] = "0";
+	defaults["profiler"] = "0";
+	defaults["metricsFile"] = "metrics.txt";
+	defaults["metricsInterval"] = "0";
 	config_ = std::make_shared<Options>(defaults);
 	//get additionnal options from file
 	config_->setConfigFile("options.ini");
@@ -107,6 +147,9 @@ bool Game::loadOptions()
 	defaultKeymap["-Down"] = "stopScrollCamDown";
 	defaultKeymap["scrollUp"] = "zoomCamera";
 	defaultKeymap["scrollDown"] = "unzoomCamera";
+	defaultKeymap["F3"] = "toggleProfiler";
+	defaultKeymap["F4"] = "writeProfilerTrace";
+	defaultKeymap["F5"] = "dumpMetrics";
 	
 	keymap_ = std::make_shared<Options>(defaultKeymap);
 	
@@ -9,6 +9,8 @@
 #include "input/inputOIS.h"
 #include "eventManager.h"
 #include "worldMapState.h"
+#include "frameScheduler.h"
+#include "profiler.h"
 
 
 class Game: public Subscribable
@@ -33,13 +35,12 @@ class Game: public Subscribable
 		std::unique_ptr<InputOIS> input_;
 		std::unique_ptr<WorldMapState> currentState_;
 		
+		std::unique_ptr<FrameScheduler> scheduler_;
+		
 		//for the FPS
-		Ogre::Timer timer_;
 		int nbFrames_;
+		int nbTicks_;
 		unsigned long lastFpsCalcul_;
-		unsigned long currentTime_;
-		int fpsLimit_;
-		unsigned long timeBetweenFrames_;
-		unsigned long lastFrameTime_;};
+};
 
 #endif /* GAME_H */ 
@@ -0,0 +1,82 @@
+#include "bufferPool.h"
+#include <glog/logging.h>
+#include "../metrics.h"
+
+HardwareBufferPool::HardwareBufferPool(size_t maxFreeBytes):
+	vertexBuffers_{},
+	indexBuffers_{},
+	maxFreeBytes_{maxFreeBytes},
+	freeBytes_{0}
+{
+
+}
+
+HardwareBufferPool::~HardwareBufferPool()
+{
+	LOG(INFO) << "Hardware buffer pool freed: " << freeBytes_ << " bytes";
+}
+
+size_t HardwareBufferPool::sizeClass(size_t nbElements)
+{
+	size_t capacity = 64;
+	while (capacity < nbElements) {
+		capacity *= 2;
+	}
+	return capacity;
+}
+
+Ogre::HardwareVertexBufferSharedPtr HardwareBufferPool::acquireVertexBuffer(size_t vertexSize, size_t nbVertices)
+{
+	std::vector<Ogre::HardwareVertexBufferSharedPtr> &free = vertexBuffers_[std::make_pair(vertexSize, sizeClass(nbVertices))];
+	if (!free.empty()) {
+		Ogre::HardwareVertexBufferSharedPtr buffer = free.back();
+		free.pop_back();
+		freeBytes_ -= buffer->getSizeInBytes();
+		Metrics::increment("gpu.buffersReused");
+		Metrics::setGauge("gpu.poolFreeBytes", freeBytes_);
+		return buffer;
+	}
+	Metrics::increment("gpu.buffersCreated");
+	//dynamic, so it can be written again with a discard lock
+	return Ogre::HardwareBufferManager::getSingleton().createVertexBuffer(
+		vertexSize, sizeClass(nbVertices), Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY);
+}
+
+Ogre::HardwareIndexBufferSharedPtr HardwareBufferPool::acquireIndexBuffer(Ogre::HardwareIndexBuffer::IndexType type, size_t nbIndices)
+{
+	std::vector<Ogre::HardwareIndexBufferSharedPtr> &free = indexBuffers_[std::make_pair(static_cast<int>(type), sizeClass(nbIndices))];
+	if (!free.empty()) {
+		Ogre::HardwareIndexBufferSharedPtr buffer = free.back();
+		free.pop_back();
+		freeBytes_ -= buffer->getSizeInBytes();
+		Metrics::increment("gpu.buffersReused");
+		Metrics::setGauge("gpu.poolFreeBytes", freeBytes_);
+		return buffer;
+	}
+	Metrics::increment("gpu.buffersCreated");
+	return Ogre::HardwareBufferManager::getSingleton().createIndexBuffer(
+		type, sizeClass(nbIndices), Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY);
+}
+
+void HardwareBufferPool::release(const Ogre::HardwareVertexBufferSharedPtr &buffer)
+{
+	//buffers not made by the pool are not kept, their size is not a class
+	if (buffer.isNull() || buffer->getNumVertices() != sizeClass(buffer->getNumVertices())
+		|| freeBytes_ + buffer->getSizeInBytes() > maxFreeBytes_) {
+		return;
+	}
+	vertexBuffers_[std::make_pair(buffer->getVertexSize(), buffer->getNumVertices())].push_back(buffer);
+	freeBytes_ += buffer->getSizeInBytes();
+	Metrics::setGauge("gpu.poolFreeBytes", freeBytes_);
+}
+
+void HardwareBufferPool::release(const Ogre::HardwareIndexBufferSharedPtr &buffer)
+{
+	if (buffer.isNull() || buffer->getNumIndexes() != sizeClass(buffer->getNumIndexes())
+		|| freeBytes_ + buffer->getSizeInBytes() > maxFreeBytes_) {
+		return;
+	}
+	indexBuffers_[std::make_pair(static_cast<int>(buffer->getType()), buffer->getNumIndexes())].push_back(buffer);
+	freeBytes_ += buffer->getSizeInBytes();
+	Metrics::setGauge("gpu.poolFreeBytes", freeBytes_);
+}
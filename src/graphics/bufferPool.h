@@ -0,0 +1,48 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+////////////////////////////////////////
+// Hardware buffers kept to be reused
+// when chunks are remeshed
+////////////////////////////////////////
+//use:
+//
+//HardwareBufferPool pool(64*1024*1024);
+//Ogre::HardwareVertexBufferSharedPtr vbuf = pool.acquireVertexBuffer(vertexSize, nbVertices);
+//void *dest = vbuf->lock(0, nbVertices*vertexSize, Ogre::HardwareBuffer::HBL_DISCARD);
+//...
+//pool.release(vbuf); //once the mesh using it is destroyed
+//
+//Buffers are sized by classes (powers of two, at least 64 elements), so the
+//buffer released by a chunk can be taken by the next chunk of a close size
+//and painting doesn't allocate graphic memory once the pool is warm. Up to
+//maxFreeBytes of released buffers are kept, the others are freed.
+
+#include "OGRE/Ogre.h"
+#include <map>
+#include <vector>
+#include <utility>
+
+class HardwareBufferPool
+{
+	public:
+		explicit HardwareBufferPool(size_t maxFreeBytes);
+		~HardwareBufferPool();
+
+		Ogre::HardwareVertexBufferSharedPtr acquireVertexBuffer(size_t vertexSize, size_t nbVertices);
+		Ogre::HardwareIndexBufferSharedPtr acquireIndexBuffer(Ogre::HardwareIndexBuffer::IndexType type, size_t nbIndices);
+		void release(const Ogre::HardwareVertexBufferSharedPtr &buffer);
+		void release(const Ogre::HardwareIndexBufferSharedPtr &buffer);
+		size_t getFreeBytes() const { return freeBytes_; }
+
+		static size_t sizeClass(size_t nbElements);
+
+	private:
+		//free buffers, by element size (or index type) and capacity
+		std::map<std::pair<size_t, size_t>, std::vector<Ogre::HardwareVertexBufferSharedPtr>> vertexBuffers_;
+		std::map<std::pair<int, size_t>, std::vector<Ogre::HardwareIndexBufferSharedPtr>> indexBuffers_;
+		size_t maxFreeBytes_;
+		size_t freeBytes_;
+};
+
+#endif /* BUFFERPOOL_H */
@@ -0,0 +1,78 @@
+#include "chunkGrid.h"
+#include <algorithm>
+
+namespace {
+
+int nbChunksFor(int size, int chunkSize)
+{
+	return (size + chunkSize-1) / chunkSize;
+}
+
+//cubes of the chunk starting at start inside a map of the given size, along one axis
+int clippedExtent(int size, int start, int chunkSize)
+{
+	return std::min(chunkSize, size-start);
+}
+
+bool inGrid(const Coordinates &nbChunks, int x, int y, int z)
+{
+	return x >= 0 && y >= 0 && z >= 0 && x < nbChunks.x && y < nbChunks.y && z < nbChunks.z;
+}
+
+}
+
+bool planChunkMoves(const Coordinates &oldSize, const Coordinates &newSize, const Coordinates &offset, int chunkSize, ChunkMoves &moves)
+{
+	if (offset.x % chunkSize != 0 || offset.y % chunkSize != 0 || offset.z % chunkSize != 0) {
+		return false;
+	}
+	const Coordinates shift = {offset.x/chunkSize, offset.y/chunkSize, offset.z/chunkSize};
+	const Coordinates oldNb = {nbChunksFor(oldSize.x, chunkSize), nbChunksFor(oldSize.y, chunkSize), nbChunksFor(oldSize.z, chunkSize)};
+	Coordinates &nb = moves.nbChunks;
+	nb = {nbChunksFor(newSize.x, chunkSize), nbChunksFor(newSize.y, chunkSize), nbChunksFor(newSize.z, chunkSize)};
+	moves.from.assign(nb.x*nb.y*nb.z, -1);
+	moves.redraw.assign(moves.from.size(), true);
+	moves.nbMoved = 0;
+	for (int z=0; z<nb.z; ++z) {
+		for (int y=0; y<nb.y; ++y) {
+			for (int x=0; x<nb.x; ++x) {
+				int ox = x-shift.x, oy = y-shift.y, oz = z-shift.z;
+				if (!inGrid(oldNb, ox, oy, oz)
+					|| clippedExtent(oldSize.x, ox*chunkSize, chunkSize) != clippedExtent(newSize.x, x*chunkSize, chunkSize)
+					|| clippedExtent(oldSize.y, oy*chunkSize, chunkSize) != clippedExtent(newSize.y, y*chunkSize, chunkSize)
+					|| clippedExtent(oldSize.z, oz*chunkSize, chunkSize) != clippedExtent(newSize.z, z*chunkSize, chunkSize)) {
+					continue;
+				}
+				moves.from[x + y*nb.x + z*nb.x*nb.y] = ox + oy*oldNb.x + oz*oldNb.x*oldNb.y;
+				++moves.nbMoved;
+			}
+		}
+	}
+	//a kept chunk whose neighbours are the same as in the old map keeps its mesh
+	for (int z=0; z<nb.z; ++z) {
+		for (int y=0; y<nb.y; ++y) {
+			for (int x=0; x<nb.x; ++x) {
+				int id = x + y*nb.x + z*nb.x*nb.y;
+				if (moves.from[id] < 0) {
+					continue;
+				}
+				bool same = true;
+				for (int dz=-1; dz<=1 && same; ++dz) {
+					for (int dy=-1; dy<=1 && same; ++dy) {
+						for (int dx=-1; dx<=1 && same; ++dx) {
+							int nx = x+dx, ny = y+dy, nz = z+dz;
+							if (inGrid(nb, nx, ny, nz)) {
+								same = moves.from[nx + ny*nb.x + nz*nb.x*nb.y] >= 0;
+							} else {
+								//out of both maps
+								same = !inGrid(oldNb, nx-shift.x, ny-shift.y, nz-shift.z);
+							}
+						}
+					}
+				}
+				moves.redraw[id] = !same;
+			}
+		}
+	}
+	return true;
+}
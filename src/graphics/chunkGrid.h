@@ -0,0 +1,41 @@
+#ifndef CHUNKGRID_H
+#define CHUNKGRID_H
+
+////////////////////////////////////////
+// Chunks of the scene kept by an
+// anchored resize of the map,
+// independently of Ogre
+////////////////////////////////////////
+//use:
+//
+//ChunkMoves moves;
+//if (planChunkMoves(oldSize, newSize, offset, chunkSize, moves)) {
+//	//moves.from[id]: old chunk moved to the new chunk id, -1 for a new chunk
+//	//moves.redraw[id]: its mesh has to be checked again
+//}
+//
+//A chunk is kept when the offset is a multiple of the chunk size and its
+//cubes, clipped by the end of the map, are the same in both maps (a map
+//lower than a chunk keeps its chunks). Its mesh also reads one cube around
+//it, so a kept chunk is redrawn when a neighbour is new or when the end of
+//the map next to it moved.
+
+#include <vector>
+
+struct Coordinates {
+	int x;
+	int y;
+	int z;
+};
+
+struct ChunkMoves {
+	Coordinates nbChunks; //of the new map
+	std::vector<int> from; //by new chunk id
+	std::vector<bool> redraw; //by new chunk id
+	int nbMoved;
+};
+
+//false if no chunk can be kept (offset not a multiple of the chunk size)
+bool planChunkMoves(const Coordinates &oldSize, const Coordinates &newSize, const Coordinates &offset, int chunkSize, ChunkMoves &moves);
+
+#endif /* CHUNKGRID_H */
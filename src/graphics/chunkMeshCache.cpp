@@ -0,0 +1,328 @@
+#include "chunkMeshCache.h"
+#include <glog/logging.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unistd.h>
+
+namespace {
+
+const char fileMagic[4] = {'P', 'G', 'M', 'C'};
+const std::uint32_t fileVersion = 2;
+
+struct FileHeader {
+	char magic[4];
+	std::uint32_t version;
+	std::uint64_t key;
+	std::uint32_t session; //incremented at each open
+	std::uint32_t padding;
+};
+
+//followed by the vertices, the indices (32 bits) and padding to 8 bytes
+struct EntryHeader {
+	std::uint64_t hash;
+	std::uint64_t check; //a mesh whose check differs is another content with the same hash
+	std::uint32_t lastUse; //session
+	std::uint32_t format;
+	std::uint32_t shortIndices;
+	std::uint32_t nbVertices;
+	std::uint32_t nbFaces;
+	std::uint32_t vertexBytes;
+	std::uint32_t nbIndices;
+	std::uint32_t padding;
+};
+
+size_t entrySize(const EntryHeader &entry)
+{
+	size_t size = sizeof(EntryHeader) + entry.vertexBytes + entry.nbIndices*sizeof(std::uint32_t);
+	return (size + 7) & ~static_cast<size_t>(7);
+}
+
+}
+
+ChunkMeshCache::ChunkMeshCache():
+	filename_{},
+	maxBytes_{0},
+	key_{0},
+	session_{0},
+	file_{},
+	region_{},
+	validEnd_{0},
+	entries_{},
+	pending_{},
+	pendingEntries_{},
+	full_{false}
+{
+
+}
+
+ChunkMeshCache::~ChunkMeshCache()
+{
+	close();
+}
+
+bool ChunkMeshCache::open(const std::string &filename, size_t maxBytes, std::uint64_t key)
+{
+	close();
+	filename_ = filename;
+	maxBytes_ = maxBytes;
+	key_ = key;
+	session_ = 0;
+	full_ = false;
+	if (!mapFile() || !readIndex()) {
+		//missing, damaged or made for another mesher
+		LOG(INFO) << "New chunk mesh cache: " << filename_;
+		session_ = 0;
+		if (!rewrite(std::vector<size_t>())) {
+			LOG(WARNING) << "Unable to create the chunk mesh cache: " << filename_;
+			unmapFile();
+			return false;
+		}
+	} else {
+		if (validEnd_ < region_->get_size()) {
+			dropCutMesh();
+		}
+		if (isOpen() && validEnd_ > maxBytes_) {
+			compact();
+		}
+	}
+	if (!isOpen()) {
+		return false;
+	}
+	++session_;
+	static_cast<FileHeader*>(region_->get_address())->session = session_;
+	LOG(INFO) << "Chunk mesh cache opened: " << filename_ << " (" << entries_.size() << " meshes, " << validEnd_ << " bytes)";
+	return true;
+}
+
+void ChunkMeshCache::close()
+{
+	if (isOpen()) {
+		save();
+	}
+	unmapFile();
+	entries_.clear();
+	pending_.clear();
+	pendingEntries_.clear();
+	validEnd_ = 0;
+}
+
+bool ChunkMeshCache::load(const ChunkHash &hash, ChunkMesh &mesh)
+{
+	char *data = nullptr;
+	auto found = entries_.find(hash.key);
+	if (found != entries_.end()) {
+		data = static_cast<char*>(region_->get_address()) + found->second;
+	} else {
+		auto pending = pendingEntries_.find(hash.key);
+		if (pending == pendingEntries_.end()) {
+			return false;
+		}
+		data = &pending_[pending->second];
+	}
+	EntryHeader *entry = reinterpret_cast<EntryHeader*>(data);
+	if (entry->check != hash.check) {
+		return false;
+	}
+	const char *vertices = data + sizeof(EntryHeader);
+	mesh.clear();
+	mesh.format = static_cast<VertexFormat>(entry->format);
+	mesh.shortIndices = entry->shortIndices != 0;
+	mesh.nbVertices = entry->nbVertices;
+	mesh.nbFaces = entry->nbFaces;
+	mesh.vertices.assign(vertices, vertices + entry->vertexBytes);
+	mesh.indices.resize(entry->nbIndices);
+	if (entry->nbIndices > 0) {
+		std::memcpy(&mesh.indices[0], vertices + entry->vertexBytes, entry->nbIndices*sizeof(std::uint32_t));
+	}
+	//written through the mapping, kept for the next compaction
+	entry->lastUse = session_;
+	return true;
+}
+
+void ChunkMeshCache::store(const ChunkHash &hash, const ChunkMesh &mesh)
+{
+	if (!isOpen() || entries_.count(hash.key) || pendingEntries_.count(hash.key)) {
+		return;
+	}
+	EntryHeader entry;
+	entry.hash = hash.key;
+	entry.check = hash.check;
+	entry.lastUse = session_;
+	entry.format = static_cast<std::uint32_t>(mesh.format);
+	entry.shortIndices = mesh.shortIndices;
+	entry.nbVertices = mesh.nbVertices;
+	entry.nbFaces = mesh.nbFaces;
+	entry.vertexBytes = mesh.vertices.size();
+	entry.nbIndices = mesh.indices.size();
+	entry.padding = 0;
+	size_t size = entrySize(entry);
+	if (getSize() + size > maxBytes_) {
+		if (!full_) {
+			LOG(INFO) << "Chunk mesh cache full, it will be compacted at the next start: " << filename_;
+			full_ = true;
+		}
+		return;
+	}
+	size_t offset = pending_.size();
+	pending_.resize(offset + size, 0);
+	std::memcpy(&pending_[offset], &entry, sizeof(entry));
+	if (!mesh.vertices.empty()) {
+		std::memcpy(&pending_[offset + sizeof(entry)], &mesh.vertices[0], mesh.vertices.size());
+	}
+	if (!mesh.indices.empty()) {
+		std::memcpy(&pending_[offset + sizeof(entry) + mesh.vertices.size()], &mesh.indices[0], mesh.indices.size()*sizeof(std::uint32_t));
+	}
+	pendingEntries_[hash.key] = offset;
+}
+
+bool ChunkMeshCache::save()
+{
+	if (!isOpen() || pending_.empty()) {
+		return true;
+	}
+	//the file is unmapped while it grows
+	size_t end = validEnd_;
+	unmapFile();
+	{
+		std::fstream file(filename_.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(end);
+		file.write(&pending_[0], pending_.size());
+		if (!file) {
+			LOG(WARNING) << "Unable to write the chunk mesh cache: " << filename_;
+		}
+	}
+	pending_.clear();
+	pendingEntries_.clear();
+	entries_.clear();
+	if (!mapFile() || !readIndex()) {
+		LOG(WARNING) << "Chunk mesh cache damaged, it will be rebuilt: " << filename_;
+		unmapFile();
+		return false;
+	}
+	return true;
+}
+
+bool ChunkMeshCache::mapFile()
+{
+	try {
+		file_.reset(new boost::interprocess::file_mapping(filename_.c_str(), boost::interprocess::read_write));
+		region_.reset(new boost::interprocess::mapped_region(*file_, boost::interprocess::read_write));
+	} catch (const boost::interprocess::interprocess_exception&) {
+		//missing or empty file
+		unmapFile();
+		return false;
+	}
+	return true;
+}
+
+void ChunkMeshCache::unmapFile()
+{
+	if (region_) {
+		region_->flush();
+	}
+	region_.reset();
+	file_.reset();
+}
+
+bool ChunkMeshCache::readIndex()
+{
+	const char *base = static_cast<const char*>(region_->get_address());
+	size_t size = region_->get_size();
+	if (size < sizeof(FileHeader)) {
+		return false;
+	}
+	const FileHeader *header = reinterpret_cast<const FileHeader*>(base);
+	if (std::memcmp(header->magic, fileMagic, sizeof(fileMagic)) != 0 || header->version != fileVersion || header->key != key_) {
+		return false;
+	}
+	session_ = header->session;
+	entries_.clear();
+	size_t offset = sizeof(FileHeader);
+	while (offset + sizeof(EntryHeader) <= size) {
+		const EntryHeader *entry = reinterpret_cast<const EntryHeader*>(base + offset);
+		size_t length = entrySize(*entry);
+		if (offset + length > size) {
+			//cut by a crash during a save
+			break;
+		}
+		entries_[entry->hash] = offset;
+		offset += length;
+	}
+	validEnd_ = offset;
+	return true;
+}
+
+//keep the meshes at the given offsets of the mapped file
+bool ChunkMeshCache::rewrite(const std::vector<size_t> &offsets)
+{
+	FileHeader header;
+	std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+	header.version = fileVersion;
+	header.key = key_;
+	header.session = session_;
+	header.padding = 0;
+	std::vector<char> content(reinterpret_cast<const char*>(&header), reinterpret_cast<const char*>(&header) + sizeof(header));
+	for (size_t offset : offsets) {
+		const char *entry = static_cast<const char*>(region_->get_address()) + offset;
+		content.insert(content.end(), entry, entry + entrySize(*reinterpret_cast<const EntryHeader*>(entry)));
+	}
+	unmapFile();
+	entries_.clear();
+	{
+		std::ofstream file(filename_.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		file.write(&content[0], content.size());
+		if (!file) {
+			return false;
+		}
+	}
+	return mapFile() && readIndex();
+}
+
+//the end of a mesh cut by a crash during a save is truncated, the other meshes stay in place
+void ChunkMeshCache::dropCutMesh()
+{
+	size_t end = validEnd_;
+	unmapFile();
+	entries_.clear();
+	if (::truncate(filename_.c_str(), end) != 0 || !mapFile() || !readIndex()) {
+		LOG(WARNING) << "Unable to truncate the chunk mesh cache: " << filename_;
+		unmapFile();
+		return;
+	}
+	LOG(INFO) << "Chunk mesh cache truncated to " << validEnd_ << " bytes: " << filename_;
+}
+
+void ChunkMeshCache::compact()
+{
+	//most recently used first, down to 3/4 of the limit to leave room for new meshes
+	std::vector<std::pair<std::uint32_t, size_t>> uses;
+	const char *base = static_cast<const char*>(region_->get_address());
+	for (auto &entry : entries_) {
+		uses.push_back(std::make_pair(reinterpret_cast<const EntryHeader*>(base + entry.second)->lastUse, entry.second));
+	}
+	std::sort(uses.begin(), uses.end(), [](const std::pair<std::uint32_t, size_t> &a, const std::pair<std::uint32_t, size_t> &b) {
+		return a.first > b.first;
+	});
+	std::vector<size_t> offsets;
+	size_t size = sizeof(FileHeader);
+	for (auto &use : uses) {
+		size_t length = entrySize(*reinterpret_cast<const EntryHeader*>(base + use.second));
+		if (size + length > maxBytes_/4*3) {
+			break;
+		}
+		size += length;
+		offsets.push_back(use.second);
+	}
+	//file order is kept
+	std::sort(offsets.begin(), offsets.end());
+	size_t nbMeshes = entries_.size();
+	if (!rewrite(offsets)) {
+		LOG(WARNING) << "Unable to compact the chunk mesh cache: " << filename_;
+		unmapFile();
+		return;
+	}
+	LOG(INFO) << "Chunk mesh cache compacted: " << nbMeshes << " -> " << entries_.size() << " meshes";
+}
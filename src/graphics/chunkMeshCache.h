@@ -0,0 +1,75 @@
+#ifndef CHUNKMESHCACHE_H
+#define CHUNKMESHCACHE_H
+
+////////////////////////////////////////
+// Chunk meshes kept on disk between
+// sessions, found by content hash
+////////////////////////////////////////
+//use:
+//
+//ChunkMeshCache cache;
+//cache.open("chunkMeshes.cache", 256*1024*1024, key);
+//if (!cache.load(hash, mesh)) { //hash given by ChunkMesher::hashChunk
+//	mesher.buildChunk(map, ..., mesh);
+//	cache.store(hash, mesh);
+//}
+//cache.save(); //appends the meshes stored since the last save
+//
+//The file is memory mapped, meshes are read from it without parsing the rest.
+//The key identifies everything the meshes depend on besides the content of
+//the chunks (mesher version and settings, matter registry): a file made with
+//another key is discarded. Each mesh keeps the last session it was loaded in.
+//A mesh cut by a crash is truncated at open. When the file is over the size
+//limit at open, the meshes unused for the longest time are dropped; during a
+//session new meshes are no longer stored once the limit is reached. Meshes are found by the key of the hash and only
+//loaded if its check matches too.
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include "chunkMesher.h"
+
+namespace boost { namespace interprocess {
+	class file_mapping;
+	class mapped_region;
+} }
+
+class ChunkMeshCache
+{
+	public:
+		ChunkMeshCache();
+		~ChunkMeshCache();
+
+		bool open(const std::string &filename, size_t maxBytes, std::uint64_t key);
+		void close();
+		bool isOpen() const { return region_ != nullptr; }
+		bool load(const ChunkHash &hash, ChunkMesh &mesh);
+		void store(const ChunkHash &hash, const ChunkMesh &mesh);
+		bool save();
+		size_t getSize() const { return validEnd_ + pending_.size(); }
+		size_t getNbMeshes() const { return entries_.size() + pendingEntries_.size(); }
+
+	private:
+		bool mapFile();
+		void unmapFile();
+		bool readIndex();
+		bool rewrite(const std::vector<size_t> &offsets);
+		void dropCutMesh();
+		void compact();
+
+		std::string filename_;
+		size_t maxBytes_;
+		std::uint64_t key_;
+		std::uint32_t session_;
+		std::unique_ptr<boost::interprocess::file_mapping> file_;
+		std::unique_ptr<boost::interprocess::mapped_region> region_;
+		size_t validEnd_; //end of the last complete mesh of the file
+		std::unordered_map<std::uint64_t, size_t> entries_; //offset of each mesh in the file
+		std::vector<char> pending_; //meshes stored since the last save
+		std::unordered_map<std::uint64_t, size_t> pendingEntries_; //offset of each mesh in pending_
+		bool full_;
+};
+
+#endif /* CHUNKMESHCACHE_H */
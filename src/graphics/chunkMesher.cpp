@@ -0,0 +1,484 @@
+#include "chunkMesher.h"
+#include <glog/logging.h>
+#include <cstring>
+#include <algorithm>
+#include "../matterVoxel.h"
+
+namespace {
+
+//corners of each face, relative to the min corner of the cell
+//(same order as ChunkMesher::Face)
+const int faceCorners[6][4][3] = {
+	{ {0,1,0}, {0,1,1}, {1,1,1}, {1,1,0} }, //top
+	{ {0,0,0}, {0,0,1}, {0,1,1}, {0,1,0} }, //left
+	{ {0,0,0}, {1,0,0}, {1,0,1}, {0,0,1} }, //bottom
+	{ {0,0,0}, {0,1,0}, {1,1,0}, {1,0,0} }, //back
+	{ {1,0,0}, {1,1,0}, {1,1,1}, {1,0,1} }, //right
+	{ {0,0,1}, {1,0,1}, {1,1,1}, {0,1,1} }  //front
+};
+
+//texture coordinates of each corner, v is inside the atlas row
+const float faceUVs[6][4][2] = {
+	{ {0,0}, {0,1}, {1,1}, {1,0} }, //top
+	{ {0,1}, {1,1}, {1,0}, {0,0} }, //left
+	{ {0,1}, {1,1}, {1,0}, {0,0} }, //bottom
+	{ {1,1}, {1,0}, {0,0}, {0,1} }, //back
+	{ {1,1}, {1,0}, {0,0}, {0,1} }, //right
+	{ {0,1}, {1,1}, {1,0}, {0,0} }  //front
+};
+
+//neighbour hiding each face
+const int faceNeighbours[6][3] = {
+	{0,1,0}, {-1,0,0}, {0,-1,0}, {0,0,-1}, {1,0,0}, {0,0,1}
+};
+
+//FNV-1a step
+inline void mixHash(std::uint64_t &hash, std::uint64_t value)
+{
+	hash = (hash ^ value) * 1099511628211ull;
+}
+
+//multiply-xorshift mixing, independent of the FNV-1a one
+inline void mixCheck(std::uint64_t &check, std::uint64_t value)
+{
+	check = (check ^ value) + 0x9E3779B97F4A7C15ull;
+	check = (check ^ (check >> 30)) * 0xBF58476D1CE4E5B9ull;
+	check ^= check >> 31;
+}
+
+inline int countBits(std::uint64_t word)
+{
+#ifdef __GNUC__
+	return __builtin_popcountll(word);
+#else
+	int count = 0;
+	for (; word; word &= word-1) {
+		++count;
+	}
+	return count;
+#endif
+}
+
+inline int lowestBit(std::uint64_t word)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(word);
+#else
+	int bit = 0;
+	while (!(word & 1)) {
+		word >>= 1;
+		++bit;
+	}
+	return bit;
+#endif
+}
+
+}
+
+///////////////////////////////////////
+//	ChunkMesh
+///////////////////////////////////////
+
+ChunkMesh::ChunkMesh():
+	format{VertexFormat::Float},
+	vertices{},
+	indices{},
+	nbVertices{0},
+	nbFaces{0},
+	shortIndices{false}
+{
+
+}
+
+size_t ChunkMesh::vertexSize() const
+{
+	return (format == VertexFormat::Packed) ? 4 : 5*sizeof(float);
+}
+
+size_t ChunkMesh::sizeInBytes() const
+{
+	return vertices.size() + indices.size()*indexSize();
+}
+
+void ChunkMesh::clear()
+{
+	vertices.clear();
+	indices.clear();
+	nbVertices = 0;
+	nbFaces = 0;
+	shortIndices = false;
+}
+
+MeshStats::MeshStats():
+	nbChunks{0},
+	nbVertices{0},
+	nbIndices{0},
+	nbFaces{0},
+	vertexBytes{0},
+	indexBytes{0}
+{
+
+}
+
+void MeshStats::add(const ChunkMesh &mesh)
+{
+	++nbChunks;
+	nbVertices += mesh.nbVertices;
+	nbIndices += mesh.indices.size();
+	nbFaces += mesh.nbFaces;
+	vertexBytes += mesh.vertices.size();
+	indexBytes += mesh.indices.size()*mesh.indexSize();
+}
+
+float MeshStats::dedupRatio() const
+{
+	if (nbFaces == 0) {
+		return 1.0f;
+	}
+	return static_cast<float>(nbVertices) / (nbFaces*4);
+}
+
+///////////////////////////////////////
+//	ChunkMesher
+///////////////////////////////////////
+
+const int ChunkMesher::maxPackedChunkSize;
+const int ChunkMesher::maxDedupChunkSize;
+const int ChunkMesher::maxDedupAtlasRows;
+const int ChunkMesher::maxLod;
+const int ChunkMesher::maxRowSize;
+const int ChunkMesher::version;
+
+ChunkMesher::ChunkMesher(float cubeSize, int nbAtlasRows, VertexFormat format):
+	cubeSize_{cubeSize},
+	nbAtlasRows_{nbAtlasRows},
+	format_{format},
+	dedupVertices_{false},
+	shortIndices_{true},
+	dedupChunk_{false},
+	vertexIndices_{},
+	occupied_{},
+	drawable_{},
+	atlasRows_{},
+	cellCodes_{},
+	tablesMap_{nullptr},
+	tablesLastVoxel_{nullptr},
+	limits_{0, 0, 0}
+{
+
+}
+
+ChunkMesher::~ChunkMesher()
+{
+
+}
+
+void ChunkMesher::buildChunk(const CubeMap<Voxel> &map, int startX, int startY, int startZ, int endX, int endY, int endZ, ChunkMesh &mesh, int lod)
+{
+	mesh.clear();
+	vertexIndices_.clear();
+	mesh.format = format_;
+	int size = std::max(endX-startX, std::max(endY-startY, endZ-startZ)) + 1;
+	if (format_ == VertexFormat::Packed && size > maxPackedChunkSize) {
+		LOG(WARNING) << "Chunks of size " << size << " are too big for the packed vertex format, using floats";
+		mesh.format = VertexFormat::Float;
+	}
+	dedupChunk_ = dedupVertices_;
+	if (dedupChunk_ && (size > maxDedupChunkSize || nbAtlasRows_ > maxDedupAtlasRows)) {
+		LOG(WARNING) << "Chunks of size " << size << " with " << nbAtlasRows_ << " atlas rows don't fit the vertex keys, vertices not deduplicated";
+		dedupChunk_ = false;
+	}
+	limits_[0] = std::min(endX+1, map.getSizeX()) - startX;
+	limits_[1] = std::min(endY+1, map.getSizeY()) - startY;
+	limits_[2] = std::min(endZ+1, map.getSizeZ()) - startZ;
+	if (lod > 0) {
+		int step = 1 << std::min(lod, maxLod);
+		for (int i=startX; i<=endX; i+=step) {
+			for (int j=startY; j<=endY; j+=step) {
+				for (int k=startZ; k<=endZ; k+=step) {
+					const MatterInfos *matter = sampleBlock(map, i, j, k, step);
+					if (!matter) {
+						continue;
+					}
+					for (int face=0; face<NB_FACES; ++face) {
+						const int *n = faceNeighbours[face];
+						if (!sampleBlock(map, i+n[0]*step, j+n[1]*step, k+n[2]*step, step)) {
+							addFace(static_cast<Face>(face), i-startX, j-startY, k-startZ, step, matter->atlasRow, mesh);
+						}
+					}
+				}
+			}
+		}
+		mesh.shortIndices = shortIndices_ && mesh.nbVertices <= 0xFFFF;
+		return;
+	}
+	//cubes outside of the map are empty, no need to look at them
+	int sizeX = limits_[0];
+	int sizeY = limits_[1];
+	int sizeZ = limits_[2];
+	if (sizeX > 0 && sizeY > 0 && sizeZ > 0) {
+		updatePaletteTables(map);
+		for (int slab=0; slab<sizeX; slab+=maxRowSize) {
+			buildSlab(map, startX+slab, startY, startZ, std::min(maxRowSize, sizeX-slab), sizeY, sizeZ, slab, mesh);
+		}
+	}
+	mesh.shortIndices = shortIndices_ && mesh.nbVertices <= 0xFFFF;
+}
+
+ChunkHash ChunkMesher::hashChunk(const CubeMap<Voxel> &map, int startX, int startY, int startZ, int endX, int endY, int endZ, int lod)
+{
+	updatePaletteTables(map);
+	//FNV-1a on the cells of the chunk and of the neighbour blocks (one block of apron)
+	ChunkHash hash = { 14695981039346656037ull, 0 };
+	auto mix = [&hash](std::uint64_t value) { mixHash(hash.key, value); mixCheck(hash.check, value); };
+	int step = 1 << std::max(0, std::min(lod, maxLod));
+	int last[3] = { endX-startX, endY-startY, endZ-startZ };
+	mix(step);
+	for (int axis=0; axis<3; ++axis) {
+		mix(last[axis]);
+		//where the map ends, corners are clamped to it
+		last[axis] = (last[axis]/step + 2)*step - 1;
+	}
+	mix(std::min(endX+1, map.getSizeX()) - startX);
+	mix(std::min(endY+1, map.getSizeY()) - startY);
+	mix(std::min(endZ+1, map.getSizeZ()) - startZ);
+	for (int z=-step; z<=last[2]; ++z) {
+		for (int y=-step; y<=last[1]; ++y) {
+			for (int x=-step; x<=last[0]; ++x) {
+				mix(cellCodes_[map.getIndex(startX+x, startY+y, startZ+z)]);
+			}
+		}
+	}
+	return hash;
+}
+
+std::uint64_t ChunkMesher::getCacheKey() const
+{
+	std::uint64_t key = 14695981039346656037ull;
+	std::uint32_t cubeSizeBits;
+	std::memcpy(&cubeSizeBits, &cubeSize_, sizeof(cubeSizeBits));
+	mixHash(key, version);
+	mixHash(key, static_cast<std::uint64_t>(format_));
+	mixHash(key, dedupVertices_);
+	mixHash(key, shortIndices_);
+	mixHash(key, nbAtlasRows_);
+	mixHash(key, cubeSizeBits);
+	return key;
+}
+
+//the palette only grows, or is compacted when it is full: the tables are built
+//again when the map, its palette size or its last voxel changed
+void ChunkMesher::updatePaletteTables(const CubeMap<Voxel> &map)
+{
+	const size_t size = map.getPaletteSize();
+	const Voxel *lastVoxel = map.getPaletteVoxel(static_cast<CubeMap<Voxel>::PaletteIndex>(size-1));
+	if (&map == tablesMap_ && size == atlasRows_.size() && lastVoxel == tablesLastVoxel_) {
+		return;
+	}
+	tablesMap_ = &map;
+	tablesLastVoxel_ = lastVoxel;
+	atlasRows_.assign(map.getPaletteSize(), 0);
+	cellCodes_.assign(map.getPaletteSize(), 1);
+	cellCodes_[CubeMap<Voxel>::emptyIndex] = 0;
+	for (size_t index=1; index<atlasRows_.size(); ++index) {
+		Voxel *vox = map.getPaletteVoxel(static_cast<CubeMap<Voxel>::PaletteIndex>(index));
+		if (!vox) {
+			cellCodes_[index] = 0;
+		} else if (vox->getId() == "matter") {
+			const MatterInfos &infos = static_cast<MatterVoxel*>(vox)->getMatterInfos();
+			atlasRows_[index] = infos.atlasRow;
+			cellCodes_[index] = infos.id + 2;
+		}
+	}
+}
+
+void ChunkMesher::buildSlab(const CubeMap<Voxel> &map, int startX, int startY, int startZ, int sizeX, int sizeY, int sizeZ, int cellX, ChunkMesh &mesh)
+{
+	//rows of the slab and its apron, y and z from -1 to size
+	const int rowsZ = sizeZ+2;
+	occupied_.assign((sizeY+2)*rowsZ, 0);
+	drawable_.assign((sizeY+2)*rowsZ, 0);
+	auto row = [rowsZ](int y, int z) { return (y+1)*rowsZ + z+1; };
+	for (int y=-1; y<=sizeY; ++y) {
+		for (int z=-1; z<=sizeZ; ++z) {
+			bool apron = (y < 0 || z < 0 || y == sizeY || z == sizeZ);
+			std::uint64_t occupied = 0;
+			std::uint64_t drawable = 0;
+			for (int x=-1; x<=sizeX; ++x) {
+				CubeMap<Voxel>::PaletteIndex index = map.getIndex(startX+x, startY+y, startZ+z);
+				if (index == CubeMap<Voxel>::emptyIndex) {
+					continue;
+				}
+				occupied |= std::uint64_t(1) << (x+1);
+				if (!apron && x >= 0 && x < sizeX && atlasRows_[index] > 0) {
+					drawable |= std::uint64_t(1) << (x+1);
+				}
+			}
+			occupied_[row(y, z)] = occupied;
+			drawable_[row(y, z)] = drawable;
+		}
+	}
+
+	//faces of a row: its drawable cubes without neighbour on that side
+	std::uint64_t masks[NB_FACES];
+	auto computeMasks = [&](int y, int z) {
+		std::uint64_t cubes = drawable_[row(y, z)];
+		std::uint64_t occupied = occupied_[row(y, z)];
+		masks[TOP] = cubes & ~occupied_[row(y+1, z)];
+		masks[BOTTOM] = cubes & ~occupied_[row(y-1, z)];
+		masks[LEFT] = cubes & ~(occupied << 1);
+		masks[RIGHT] = cubes & ~(occupied >> 1);
+		masks[BACK] = cubes & ~occupied_[row(y, z-1)];
+		masks[FRONT] = cubes & ~occupied_[row(y, z+1)];
+	};
+	size_t nbFaces = 0;
+	for (int y=0; y<sizeY; ++y) {
+		for (int z=0; z<sizeZ; ++z) {
+			if (drawable_[row(y, z)]) {
+				computeMasks(y, z);
+				for (int face=0; face<NB_FACES; ++face) {
+					nbFaces += countBits(masks[face]);
+				}
+			}
+		}
+	}
+	if (nbFaces == 0) {
+		return;
+	}
+	mesh.vertices.reserve(mesh.vertices.size() + nbFaces*4*mesh.vertexSize());
+	mesh.indices.reserve(mesh.indices.size() + nbFaces*6);
+	for (int y=0; y<sizeY; ++y) {
+		for (int z=0; z<sizeZ; ++z) {
+			if (!drawable_[row(y, z)]) {
+				continue;
+			}
+			computeMasks(y, z);
+			for (int face=0; face<NB_FACES; ++face) {
+				for (std::uint64_t mask = masks[face]; mask; mask &= mask-1) {
+					int x = lowestBit(mask) - 1;
+					int atlasRow = atlasRows_[map.getIndex(startX+x, startY+y, startZ+z)];
+					addFace(static_cast<Face>(face), cellX+x, y, z, 1, atlasRow, mesh);
+				}
+			}
+		}
+	}
+}
+
+void ChunkMesher::addFace(Face face, int cellX, int cellY, int cellZ, int step, int atlasRow, ChunkMesh &mesh)
+{
+	unsigned int corners[4];
+	for (int c=0; c<4; ++c) {
+		const int *corner = faceCorners[face][c];
+		int x = std::min(cellX + corner[0]*step, limits_[0]);
+		int y = std::min(cellY + corner[1]*step, limits_[1]);
+		int z = std::min(cellZ + corner[2]*step, limits_[2]);
+		if (mesh.format == VertexFormat::Packed) {
+			unsigned char packed[4];
+			packed[0] = static_cast<unsigned char>(x | ((face & 3) << 6));
+			packed[1] = static_cast<unsigned char>(y | ((face >> 2) << 6));
+			packed[2] = static_cast<unsigned char>(z);
+			packed[3] = static_cast<unsigned char>(atlasRow-1);
+			std::uint32_t key;
+			std::memcpy(&key, packed, sizeof(key));
+			corners[c] = addVertex(key, packed, sizeof(packed), mesh);
+		} else {
+			float vertex[5];
+			vertex[0] = cubeSize_*x;
+			vertex[1] = cubeSize_*y;
+			vertex[2] = cubeSize_*z;
+			vertex[3] = faceUVs[face][c][0];
+			vertex[4] = (atlasRow-1 + faceUVs[face][c][1]) / nbAtlasRows_;
+			//the vertex only depends on the corner, its uv and the atlas row (16 bits by corner
+			//coordinate and 14 for the row, checked by buildChunk, so two vertices never share a key)
+			std::uint64_t key = static_cast<std::uint64_t>(x)
+				| static_cast<std::uint64_t>(y) << 16
+				| static_cast<std::uint64_t>(z) << 32
+				| static_cast<std::uint64_t>(atlasRow) << 48
+				| static_cast<std::uint64_t>(faceUVs[face][c][0] > 0.5f) << 62
+				| static_cast<std::uint64_t>(faceUVs[face][c][1] > 0.5f) << 63;
+			corners[c] = addVertex(key, reinterpret_cast<unsigned char*>(vertex), sizeof(vertex), mesh);
+		}
+	}
+	++mesh.nbFaces;
+	mesh.indices.push_back(corners[0]);
+	mesh.indices.push_back(corners[1]);
+	mesh.indices.push_back(corners[2]);
+	mesh.indices.push_back(corners[2]);
+	mesh.indices.push_back(corners[3]);
+	mesh.indices.push_back(corners[0]);
+}
+
+unsigned int ChunkMesher::addVertex(std::uint64_t key, const unsigned char *vertex, size_t size, ChunkMesh &mesh)
+{
+	if (dedupChunk_) {
+		auto it = vertexIndices_.find(key);
+		if (it != vertexIndices_.end()) {
+			return it->second;
+		}
+		vertexIndices_[key] = mesh.nbVertices;
+	}
+	mesh.vertices.insert(mesh.vertices.end(), vertex, vertex+size);
+	return mesh.nbVertices++;
+}
+
+//majority matter of a block of step^3 cubes, nullptr if the block is mostly empty
+//(cubes outside of the map don't count, so thin maps keep their surface)
+const MatterInfos* ChunkMesher::sampleBlock(const CubeMap<Voxel> &map, int x, int y, int z, int step) const
+{
+	const int maxCells = 1 << (3*maxLod);
+	const MatterInfos *matters[maxCells];
+	int counts[maxCells];
+	int nbMatters = 0;
+	int nbEmpty = 0;
+	int nbCells = 0;
+	for (int i=std::max(x, 0); i<std::min(x+step, map.getSizeX()); ++i) {
+		for (int j=std::max(y, 0); j<std::min(y+step, map.getSizeY()); ++j) {
+			for (int k=std::max(z, 0); k<std::min(z+step, map.getSizeZ()); ++k) {
+				++nbCells;
+				Voxel *vox = map.getVoxel(i, j, k);
+				if (!vox || vox->getId() != "matter") {
+					++nbEmpty;
+					continue;
+				}
+				const MatterInfos *infos = &static_cast<MatterVoxel*>(vox)->getMatterInfos();
+				int m = 0;
+				while (m < nbMatters && matters[m] != infos) {
+					++m;
+				}
+				if (m == nbMatters) {
+					matters[m] = infos;
+					counts[m] = 0;
+					++nbMatters;
+				}
+				++counts[m];
+			}
+		}
+	}
+	if (nbMatters == 0 || nbEmpty*2 > nbCells) {
+		return nullptr;
+	}
+	int best = 0;
+	for (int m=1; m<nbMatters; ++m) {
+		if (counts[m] > counts[best]) {
+			best = m;
+		}
+	}
+	return matters[best];
+}
+
+bool ChunkMesher::stringToFormat(const std::string &name, VertexFormat &format)
+{
+	if (name == "float") {
+		format = VertexFormat::Float;
+	} else if (name == "packed") {
+		format = VertexFormat::Packed;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+std::string ChunkMesher::formatToString(VertexFormat format)
+{
+	return (format == VertexFormat::Packed) ? "packed" : "float";
+}
@@ -0,0 +1,133 @@
+#ifndef CHUNKMESHER_H
+#define CHUNKMESHER_H
+
+////////////////////////////////////////
+// Build the geometry of a chunk of the
+// world map (only the visible faces),
+// independently of Ogre
+////////////////////////////////////////
+//Two vertex formats are available:
+// - Float: float3 position + float2 uv (20 bytes)
+// - Packed: one ubyte4 (4 bytes) expanded by the chunkPacked shader
+//   x: cell x (6 bits) + bits 0-1 of the face index
+//   y: cell y (6 bits) + bit 2 of the face index
+//   z: cell z
+//   w: row of the matter in the texture atlas (starting at 0), also its
+//      layer in the chunkMatters texture array
+//   Positions are in cells, relative to the chunk origin.
+//
+//Distant chunks can be built at a lower level of detail: with lod=1 (or 2)
+//each block of 2^3 (or 4^3) cubes becomes one cube of the majority matter.
+//
+//At full detail the visible faces are found with occupancy bitsets: one 64 bits
+//word per row along x of the chunk, with a one cell apron read from the
+//neighbour chunks. The faces of a whole row are given by shifts and ANDs with
+//the neighbour rows. Chunks wider than 62 cubes are meshed by slabs along x.
+//
+//hashChunk gives two independent 64 bits hashes of everything buildChunk reads
+//for a chunk: the matters of its cubes, the cubes of the neighbour blocks and
+//where the map ends. The key finds a mesh already built, the check confirms
+//the content is the same before the mesh is shared.
+//
+//When vertex deduplication is on, corners shared by several faces with the
+//same attributes are only stored once (mostly useful with the packed format,
+//whose texture coordinates don't depend on the corner).
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include "../cubeMap.h"
+#include "../voxel.h"
+#include "../materialRegistry.h"
+
+enum class VertexFormat {
+	Float,
+	Packed
+};
+
+struct ChunkMesh {
+	VertexFormat format;
+	std::vector<unsigned char> vertices; //raw vertex data, vertexSize() bytes each
+	std::vector<unsigned int> indices;
+	size_t nbVertices;
+	size_t nbFaces;
+	bool shortIndices; //indices can be sent as 16 bits
+
+	ChunkMesh();
+	size_t vertexSize() const;
+	size_t indexSize() const { return shortIndices ? 2 : 4; }
+	size_t sizeInBytes() const;
+	bool empty() const { return nbVertices == 0; }
+	void clear();
+};
+
+struct ChunkHash {
+	std::uint64_t key; //FNV-1a
+	std::uint64_t check; //another mixing of the same values
+
+	bool operator==(const ChunkHash &other) const { return key == other.key && check == other.check; }
+	bool operator!=(const ChunkHash &other) const { return !(*this == other); }
+};
+
+struct MeshStats {
+	int nbChunks;
+	size_t nbVertices;
+	size_t nbIndices;
+	size_t nbFaces;
+	size_t vertexBytes;
+	size_t indexBytes;
+
+	MeshStats();
+	void add(const ChunkMesh &mesh);
+	float dedupRatio() const; //vertices kept / vertices without deduplication
+};
+
+class ChunkMesher
+{
+	public:
+		ChunkMesher(float cubeSize, int nbAtlasRows, VertexFormat format);
+		~ChunkMesher();
+
+		void buildChunk(const CubeMap<Voxel> &map, int startX, int startY, int startZ, int endX, int endY, int endZ, ChunkMesh &mesh, int lod=0);
+		ChunkHash hashChunk(const CubeMap<Voxel> &map, int startX, int startY, int startZ, int endX, int endY, int endZ, int lod=0);
+		std::uint64_t getCacheKey() const; //version and settings, the meshes depend on them too
+		VertexFormat getFormat() const { return format_; }
+		void setDedupVertices(bool dedup) { dedupVertices_ = dedup; }
+		void setShortIndices(bool shortIndices) { shortIndices_ = shortIndices; }
+		bool getShortIndices() const { return shortIndices_; }
+
+		static bool stringToFormat(const std::string &name, VertexFormat &format);
+		static std::string formatToString(VertexFormat format);
+		static const int maxPackedChunkSize = 63;
+		static const int maxDedupChunkSize = 0xFFFF; //corners (0 to size) and atlas rows in the float vertex keys
+		static const int maxDedupAtlasRows = 0x3FFF;
+		static const int maxLod = 2;
+		static const int maxRowSize = 62; //cubes in a row word, without the apron
+		static const int version = 1; //to increment when the meshes built change
+
+	private:
+		enum Face { TOP=0, LEFT, BOTTOM, BACK, RIGHT, FRONT, NB_FACES };
+		void buildSlab(const CubeMap<Voxel> &map, int startX, int startY, int startZ, int sizeX, int sizeY, int sizeZ, int cellX, ChunkMesh &mesh);
+		void updatePaletteTables(const CubeMap<Voxel> &map);
+		void addFace(Face face, int cellX, int cellY, int cellZ, int step, int atlasRow, ChunkMesh &mesh);
+		const MatterInfos* sampleBlock(const CubeMap<Voxel> &map, int x, int y, int z, int step) const;
+		unsigned int addVertex(std::uint64_t key, const unsigned char *vertex, size_t size, ChunkMesh &mesh);
+
+		float cubeSize_;
+		int nbAtlasRows_;
+		VertexFormat format_;
+		bool dedupVertices_;
+		bool shortIndices_;
+		bool dedupChunk_; //dedupVertices_ unless the chunk built doesn't fit the vertex keys
+		std::unordered_map<std::uint64_t, unsigned int> vertexIndices_; //reused by each buildChunk
+		std::vector<std::uint64_t> occupied_; //any voxel, rows of the slab and its apron (bit 0 is x-1)
+		std::vector<std::uint64_t> drawable_; //matter voxels inside the slab
+		std::vector<int> atlasRows_; //by palette index of the map, 0 if not a matter
+		std::vector<std::uint32_t> cellCodes_; //by palette index: 0 empty, 1 not a matter, else matter id + 2
+		const CubeMap<Voxel> *tablesMap_; //map and last palette voxel the tables were built for
+		const Voxel *tablesLastVoxel_;
+		int limits_[3]; //chunk-local end of the map, corners are clamped to it
+};
+
+#endif /* CHUNKMESHER_H */
@@ -0,0 +1,170 @@
+#include "chunkRegion.h"
+#include <glog/logging.h>
+#include <cstring>
+#include <algorithm>
+#include "../metrics.h"
+
+ChunkRegion::ChunkRegion(const std::string &name, Ogre::SceneManager *sceneMgr, Ogre::SceneNode *node, int nbSlots, float cubeSize, const Ogre::Vector3 &extent, VertexFormat format, bool shortIndices, HardwareBufferPool *bufferPool):
+	name_{name},
+	sceneMgr_{sceneMgr},
+	node_{node},
+	cubeSize_{cubeSize},
+	format_{format},
+	vertexSize_{0},
+	shortIndices_{shortIndices},
+	longIndices_{false},
+	bufferPool_{bufferPool},
+	slots_(nbSlots, Slot{{}, {}, 0, 0, 0, 0, 0, false}),
+	mesh_{},
+	entity_{nullptr},
+	vertexBuffer_{},
+	indexBuffer_{},
+	indexScratch_{},
+	nbTriangles_{0},
+	dirty_{false},
+	rebuild_{true}
+{
+	ChunkMesh sample;
+	sample.format = format_;
+	vertexSize_ = sample.vertexSize();
+	mesh_ = Ogre::MeshManager::getSingleton().createManual(name_, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+	Ogre::SubMesh *subMesh = mesh_->createSubMesh();
+	subMesh->useSharedVertices = false;
+	subMesh->vertexData = new Ogre::VertexData();
+	subMesh->vertexData->vertexStart = 0;
+	Ogre::VertexDeclaration *decl = subMesh->vertexData->vertexDeclaration;
+	if (format_ == VertexFormat::Packed) {
+		//expanded by the chunkPacked vertex program
+		decl->addElement(0, 0, Ogre::VET_UBYTE4, Ogre::VES_POSITION);
+	} else {
+		decl->addElement(0, 0, Ogre::VET_FLOAT3, Ogre::VES_POSITION);
+		decl->addElement(0, 3*sizeof(float), Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES, 0);
+	}
+	subMesh->setMaterialName(format_ == VertexFormat::Packed ? "chunkPacked" : "default");
+	mesh_->_setBounds(Ogre::AxisAlignedBox(Ogre::Vector3::ZERO, extent));
+	mesh_->_setBoundingSphereRadius(extent.length());
+	mesh_->load();
+}
+
+ChunkRegion::~ChunkRegion()
+{
+	if (entity_) {
+		sceneMgr_->destroyEntity(entity_);
+	}
+	Ogre::MeshManager::getSingleton().remove(name_);
+	bufferPool_->release(vertexBuffer_);
+	bufferPool_->release(indexBuffer_);
+}
+
+void ChunkRegion::setChunk(int slot, const ChunkMesh &mesh, int cellX, int cellY, int cellZ)
+{
+	Slot &target = slots_[slot];
+	target.vertices = mesh.vertices;
+	target.indices = mesh.indices;
+	target.nbVertices = mesh.nbVertices;
+	//positions are relative to the chunk, move them to the region
+	for (size_t v=0; v<target.nbVertices; ++v) {
+		unsigned char *vertex = &target.vertices[v*vertexSize_];
+		if (format_ == VertexFormat::Packed) {
+			vertex[0] = (vertex[0] & 0xC0) | ((vertex[0] & 0x3F) + cellX);
+			vertex[1] = (vertex[1] & 0xC0) | ((vertex[1] & 0x3F) + cellY);
+			vertex[2] = static_cast<unsigned char>(vertex[2] + cellZ);
+		} else {
+			float position[3];
+			std::memcpy(position, vertex, sizeof(position));
+			position[0] += cellX*cubeSize_;
+			position[1] += cellY*cubeSize_;
+			position[2] += cellZ*cubeSize_;
+			std::memcpy(vertex, position, sizeof(position));
+		}
+	}
+	target.dirty = true;
+	dirty_ = true;
+	if (target.nbVertices > target.vertexCapacity || target.indices.size() > target.indexCapacity) {
+		rebuild_ = true;
+	}
+}
+
+void ChunkRegion::update()
+{
+	if (!dirty_) {
+		return;
+	}
+	dirty_ = false;
+	nbTriangles_ = 0;
+	for (const Slot &slot : slots_) {
+		nbTriangles_ += slot.indices.size()/3;
+	}
+	if (rebuild_) {
+		rebuild();
+		return;
+	}
+	for (Slot &slot : slots_) {
+		if (slot.dirty) {
+			writeSlot(slot);
+			Metrics::increment("mesh.regionSlotWrites");
+		}
+	}
+	entity_->setVisible(nbTriangles_ > 0);
+}
+
+void ChunkRegion::rebuild()
+{
+	rebuild_ = false;
+	//a quarter more than needed, and at least a few faces, so most edits fit in place
+	size_t nbVertices = 0;
+	size_t nbIndices = 0;
+	for (Slot &slot : slots_) {
+		slot.vertexStart = nbVertices;
+		slot.vertexCapacity = slot.nbVertices + std::max(slot.nbVertices/4, static_cast<size_t>(16));
+		slot.indexStart = nbIndices;
+		slot.indexCapacity = slot.indices.size() + std::max(slot.indices.size()/4, static_cast<size_t>(24));
+		nbVertices += slot.vertexCapacity;
+		nbIndices += slot.indexCapacity;
+	}
+	longIndices_ = !shortIndices_ || nbVertices > 0xFFFF;
+	Ogre::SubMesh *subMesh = mesh_->getSubMesh(0);
+	//the old buffers go back to the pool once the new ones are bound
+	Ogre::HardwareVertexBufferSharedPtr oldVertexBuffer = vertexBuffer_;
+	Ogre::HardwareIndexBufferSharedPtr oldIndexBuffer = indexBuffer_;
+	vertexBuffer_ = bufferPool_->acquireVertexBuffer(vertexSize_, nbVertices);
+	subMesh->vertexData->vertexBufferBinding->setBinding(0, vertexBuffer_);
+	subMesh->vertexData->vertexCount = nbVertices;
+	indexBuffer_ = bufferPool_->acquireIndexBuffer(
+		longIndices_ ? Ogre::HardwareIndexBuffer::IT_32BIT : Ogre::HardwareIndexBuffer::IT_16BIT, nbIndices);
+	subMesh->indexData->indexBuffer = indexBuffer_;
+	subMesh->indexData->indexStart = 0;
+	subMesh->indexData->indexCount = nbIndices;
+	for (Slot &slot : slots_) {
+		writeSlot(slot);
+	}
+	bufferPool_->release(oldVertexBuffer);
+	bufferPool_->release(oldIndexBuffer);
+	Metrics::increment("mesh.regionRebuilds");
+	if (!entity_) {
+		entity_ = sceneMgr_->createEntity(name_, name_);
+		node_->attachObject(entity_);
+	}
+	entity_->setVisible(nbTriangles_ > 0);
+}
+
+void ChunkRegion::writeSlot(Slot &slot)
+{
+	slot.dirty = false;
+	if (slot.nbVertices > 0) {
+		vertexBuffer_->writeData(slot.vertexStart*vertexSize_, slot.nbVertices*vertexSize_, &slot.vertices[0]);
+	}
+	//indices of the region, the unused ones repeat the first vertex of the slot
+	size_t indexSize = longIndices_ ? 4 : 2;
+	indexScratch_.resize(slot.indexCapacity*indexSize);
+	for (size_t i=0; i<slot.indexCapacity; ++i) {
+		unsigned int index = slot.vertexStart + (i < slot.indices.size() ? slot.indices[i] : 0);
+		if (longIndices_) {
+			std::memcpy(&indexScratch_[i*4], &index, 4);
+		} else {
+			unsigned short shortIndex = static_cast<unsigned short>(index);
+			std::memcpy(&indexScratch_[i*2], &shortIndex, 2);
+		}
+	}
+	indexBuffer_->writeData(slot.indexStart*indexSize, slot.indexCapacity*indexSize, &indexScratch_[0]);
+}
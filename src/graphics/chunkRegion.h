@@ -0,0 +1,72 @@
+#ifndef CHUNKREGION_H
+#define CHUNKREGION_H
+
+////////////////////////////////////////
+// Meshes of NxN neighbour chunks drawn
+// as one Ogre mesh (one draw call)
+////////////////////////////////////////
+//use:
+//
+//ChunkRegion region("0-0-0_region", sceneMgr, node, 16, cubeSize, Ogre::Vector3(1600, 400, 1600), format, true, &bufferPool);
+//region.setChunk(slot, chunkMesh, cellX, cellY, cellZ); //offset of the chunk in the region
+//region.update(); //sends the modified slots to the graphic card
+//
+//Each chunk has a slot, a range of the vertex and index buffers with some
+//room to grow. When a chunk changes only its slot is written; the buffers are
+//only rebuilt when a slot gets too small, with buffers taken from the pool. Indices left unused in a slot make
+//degenerate triangles. A copy of the slots is kept to rebuild the buffers.
+
+#include "OGRE/Ogre.h"
+#include <vector>
+#include <string>
+#include "chunkMesher.h"
+#include "bufferPool.h"
+
+class ChunkRegion
+{
+	public:
+		ChunkRegion(const std::string &name, Ogre::SceneManager *sceneMgr, Ogre::SceneNode *node, int nbSlots, float cubeSize, const Ogre::Vector3 &extent, VertexFormat format, bool shortIndices, HardwareBufferPool *bufferPool);
+		~ChunkRegion();
+
+		void setChunk(int slot, const ChunkMesh &mesh, int cellX, int cellY, int cellZ);
+		void update();
+		bool isDirty() const { return dirty_; }
+		bool empty() const { return nbTriangles_ == 0; }
+		int getNbTriangles() const { return nbTriangles_; }
+		Ogre::SceneNode* getNode() const { return node_; }
+
+	private:
+		struct Slot {
+			std::vector<unsigned char> vertices; //moved to the region
+			std::vector<unsigned int> indices; //relative to the slot
+			size_t nbVertices;
+			size_t vertexStart;
+			size_t vertexCapacity;
+			size_t indexStart;
+			size_t indexCapacity;
+			bool dirty;
+		};
+		void rebuild();
+		void writeSlot(Slot &slot);
+
+		std::string name_;
+		Ogre::SceneManager *sceneMgr_;
+		Ogre::SceneNode *node_;
+		float cubeSize_;
+		VertexFormat format_;
+		size_t vertexSize_;
+		bool shortIndices_; //allowed, if the region has less than 2^16 vertices
+		bool longIndices_; //used by the current buffers
+		HardwareBufferPool *bufferPool_;
+		std::vector<Slot> slots_;
+		Ogre::MeshPtr mesh_;
+		Ogre::Entity *entity_;
+		Ogre::HardwareVertexBufferSharedPtr vertexBuffer_;
+		Ogre::HardwareIndexBufferSharedPtr indexBuffer_;
+		std::vector<unsigned char> indexScratch_; //indices of a slot before upload
+		int nbTriangles_;
+		bool dirty_; //some slots to upload
+		bool rebuild_; //some slots too small
+};
+
+#endif /* CHUNKREGION_H */
@@ -17,7 +17,7 @@ GraphicsOgre::GraphicsOgre(const Options *config):
 
 	//create manualy the window
 	Ogre::NameValuePairList opts;
-	opts.insert(Ogre::NameValuePairList::value_type("vsync", "false"));
+	opts.insert(Ogre::NameValuePairList::value_type("vsync", config->getValue<bool>("vsync") ? "true" : "false"));
 	opts.insert(Ogre::NameValuePairList::value_type("top", "10"));
 	opts.insert(Ogre::NameValuePairList::value_type("left", "10"));
 	window_ = ogre_->createRenderWindow(
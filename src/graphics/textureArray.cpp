@@ -0,0 +1,70 @@
+#include "textureArray.h"
+#include <glog/logging.h>
+#include <algorithm>
+
+TextureArray::TextureArray():
+	width_{0},
+	height_{0},
+	nbLayers_{0},
+	levels_{}
+{
+
+}
+
+int TextureArray::mipSize(int size, int mip)
+{
+	return std::max(size >> mip, 1);
+}
+
+bool TextureArray::build(const unsigned char *atlas, int width, int height, int nbRows)
+{
+	levels_.clear();
+	if (width <= 0 || nbRows <= 0 || height % nbRows != 0) {
+		LOG(ERROR) << "The texture atlas (" << width << "x" << height << ") can't be cut in " << nbRows << " rows";
+		return false;
+	}
+	width_ = width;
+	height_ = height/nbRows;
+	nbLayers_ = nbRows;
+	//the rows of the atlas are already the layers, one after the other
+	levels_.push_back(std::vector<unsigned char>(atlas, atlas + static_cast<size_t>(width)*height*4));
+	for (int mip=1; getWidth(mip-1) > 1 || getHeight(mip-1) > 1; ++mip) {
+		levels_.push_back(std::vector<unsigned char>());
+		downsample(levels_[mip-1], getWidth(mip-1), getHeight(mip-1), levels_[mip], getWidth(mip), getHeight(mip));
+	}
+	return true;
+}
+
+//each pixel is the average of the pixels it covers in the same layer of the previous level
+void TextureArray::downsample(const std::vector<unsigned char> &source, int sourceWidth, int sourceHeight, std::vector<unsigned char> &dest, int width, int height) const
+{
+	dest.resize(static_cast<size_t>(width)*height*4*nbLayers_);
+	const size_t sourceLayer = static_cast<size_t>(sourceWidth)*sourceHeight*4;
+	const size_t destLayer = static_cast<size_t>(width)*height*4;
+	for (int layer=0; layer<nbLayers_; ++layer) {
+		const unsigned char *from = &source[layer*sourceLayer];
+		unsigned char *to = &dest[layer*destLayer];
+		for (int y=0; y<height; ++y) {
+			//odd sizes: the last pixel also covers the remaining row or column
+			int y0 = y*sourceHeight/height;
+			int y1 = std::max((y+1)*sourceHeight/height, y0+1);
+			for (int x=0; x<width; ++x) {
+				int x0 = x*sourceWidth/width;
+				int x1 = std::max((x+1)*sourceWidth/width, x0+1);
+				unsigned int sum[4] = {0, 0, 0, 0};
+				for (int j=y0; j<y1; ++j) {
+					for (int i=x0; i<x1; ++i) {
+						const unsigned char *pixel = from + (static_cast<size_t>(j)*sourceWidth + i)*4;
+						for (int c=0; c<4; ++c) {
+							sum[c] += pixel[c];
+						}
+					}
+				}
+				unsigned int count = (y1-y0)*(x1-x0);
+				for (int c=0; c<4; ++c) {
+					to[(static_cast<size_t>(y)*width + x)*4 + c] = static_cast<unsigned char>((sum[c] + count/2) / count);
+				}
+			}
+		}
+	}
+}
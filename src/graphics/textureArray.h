@@ -0,0 +1,49 @@
+#ifndef TEXTUREARRAY_H
+#define TEXTUREARRAY_H
+
+////////////////////////////////////////
+// Layers of a 2D texture array made from
+// the rows of the texture atlas,
+// independently of Ogre
+////////////////////////////////////////
+//use:
+//
+//TextureArray layers;
+//if (layers.build(atlasPixels, 100, 800, 8)) { //RGBA, 8 rows of 100x100
+//	for (int mip=0; mip<=layers.getNbMipmaps(); ++mip) {
+//		upload(layers.getWidth(mip), layers.getHeight(mip), layers.getNbLayers(), layers.getLevel(mip));
+//	}
+//}
+//
+//Each row of the atlas becomes a layer with its own mipmaps, made by a box
+//filter inside the layer: colours of neighbour rows never bleed into each
+//other, unlike the mipmaps of the whole atlas. Levels follow the OpenGL sizes
+//(halved and rounded down until 1x1). A level holds all the layers, one after
+//the other.
+
+#include <vector>
+
+class TextureArray
+{
+	public:
+		TextureArray();
+
+		bool build(const unsigned char *atlas, int width, int height, int nbRows);
+		int getWidth(int mip=0) const { return mipSize(width_, mip); }
+		int getHeight(int mip=0) const { return mipSize(height_, mip); }
+		int getNbLayers() const { return nbLayers_; }
+		int getNbMipmaps() const { return levels_.empty() ? 0 : levels_.size()-1; } //without the full size level
+		const std::vector<unsigned char>& getLevel(int mip) const { return levels_[mip]; }
+
+		static int mipSize(int size, int mip);
+
+	private:
+		void downsample(const std::vector<unsigned char> &source, int sourceWidth, int sourceHeight, std::vector<unsigned char> &dest, int width, int height) const;
+
+		int width_;
+		int height_;
+		int nbLayers_;
+		std::vector<std::vector<unsigned char>> levels_; //RGBA, by mipmap level
+};
+
+#endif /* TEXTUREARRAY_H */
@@ -1,10 +1,14 @@
 #include "worldMapGui.h"
 #include <glog/logging.h>
 #include "../tools.h"
+#include "../brush.h"
+#include "../profiler.h"
 
 
-WorldMapGui::WorldMapGui(Ogre::RenderWindow* window, Ogre::SceneManager *sceneMgr):
-	radius_{1}
+WorldMapGui::WorldMapGui(Ogre::RenderWindow* window, Ogre::SceneManager *sceneMgr, const MaterialRegistry *materials):
+	radius_{1},
+	tool_{"brush"},
+	profilerRefresh_{0}
 {
 	platform_ = new MyGUI::OgrePlatform();
 	platform_->initialise(window, sceneMgr);
@@ -17,23 +21,47 @@ WorldMapGui::WorldMapGui(Ogre::RenderWindow* window, Ogre::SceneManager *sceneMg
 	exitBtn_->eventMouseButtonClick += MyGUI::newDelegate(this, &WorldMapGui::buttonClicked);
 	resizeBtn_ = myGUI_->findWidget<MyGUI::Button>("bt_resize");
 	resizeBtn_->eventMouseButtonClick += MyGUI::newDelegate(this, &WorldMapGui::buttonClicked);
+	generateBtn_ = myGUI_->findWidget<MyGUI::Button>("bt_generate");
+	generateBtn_->eventMouseButtonClick += MyGUI::newDelegate(this, &WorldMapGui::buttonClicked);
 	matterList_ = myGUI_->findWidget<MyGUI::ListBox>("list_matter");
+	for (size_t id=0; id<materials->size(); ++id) {
+		const MatterInfos &infos = materials->getInfos(static_cast<MatterId>(id));
+		if (infos.editable) {
+			matterList_->addItem(infos.name);
+		}
+	}
 	matterList_->setIndexSelected(0);
-	radio1_= myGUI_->findWidget<MyGUI::Button>("radio_1");
-	radio1_->setStateSelected(true);
-	Arguments arg;
-	arg["radius"] = radius_;
-	EventMgrFactory::getCurrentEvtMgr()->sendEvent("markerRadiusChanged", arg);
-	radio1_->eventMouseButtonClick += MyGUI::newDelegate(this, &WorldMapGui::buttonClicked);
-	radio2_= myGUI_->findWidget<MyGUI::Button>("radio_2");
-	radio2_->eventMouseButtonClick += MyGUI::newDelegate(this, &WorldMapGui::buttonClicked);
-	radio3_= myGUI_->findWidget<MyGUI::Button>("radio_3");
-	radio3_->eventMouseButtonClick += MyGUI::newDelegate(this, &WorldMapGui::buttonClicked);
+	radiusEdit_ = myGUI_->findWidget<MyGUI::Edit>("edit_radius");
+	radiusEdit_->eventEditSelectAccept += MyGUI::newDelegate(this, &WorldMapGui::radiusAccepted);
+	shapeCombo_ = myGUI_->findWidget<MyGUI::ComboBox>("combo_shape");
+	for (BrushShape shape : {BrushShape::Diamond, BrushShape::Square, BrushShape::Circle, BrushShape::Sphere}) {
+		shapeCombo_->addItem(Brush::shapeToString(shape));
+	}
+	shapeCombo_->setIndexSelected(0);
+	shapeCombo_->eventComboAccept += MyGUI::newDelegate(this, &WorldMapGui::shapeAccepted);
+	radioBrush_ = myGUI_->findWidget<MyGUI::Button>("radio_brush");
+	radioBrush_->setStateSelected(true);
+	radioBrush_->eventMouseButtonClick += MyGUI::newDelegate(this, &WorldMapGui::buttonClicked);
+	radioFlood_ = myGUI_->findWidget<MyGUI::Button>("radio_flood");
+	radioFlood_->eventMouseButtonClick += MyGUI::newDelegate(this, &WorldMapGui::buttonClicked);
+	radioBox_ = myGUI_->findWidget<MyGUI::Button>("radio_box");
+	radioBox_->eventMouseButtonClick += MyGUI::newDelegate(this, &WorldMapGui::buttonClicked);
+	sendBrushChanged();
 	saveBtn_ = myGUI_->findWidget<MyGUI::Button>("bt_save");
 	saveBtn_->eventMouseButtonClick += MyGUI::newDelegate(this, &WorldMapGui::buttonClicked);
 	loadBtn_ = myGUI_->findWidget<MyGUI::Button>("bt_load");
 	loadBtn_->eventMouseButtonClick += MyGUI::newDelegate(this, &WorldMapGui::buttonClicked);
+	statsText_ = myGUI_->findWidget<MyGUI::StaticText>("text_stats");
+	profilerText_ = myGUI_->findWidget<MyGUI::StaticText>("text_profiler");
 	
+	subscribe("toggleProfiler", [this](std::string eventName, Arguments args){
+		bool visible = !profilerText_->getVisible();
+		if (visible) {
+			Profiler::setEnabled(true);
+			profilerRefresh_ = 0;
+		}
+		profilerText_->setVisible(visible);
+	});
 	//updates to MyGUI
 	subscribe("mouseMoved", [](std::string eventName, Arguments args){
 		MyGUI::InputManager::getInstance().injectMouseMove(
@@ -103,6 +131,39 @@ int WorldMapGui::getRadius()
 	return radius_;
 }
 
+std::string WorldMapGui::getShape()
+{
+	size_t index = shapeCombo_->getIndexSelected();
+	if (index == MyGUI::ITEM_NONE) {
+		return Brush::shapeToString(BrushShape::Diamond);
+	}
+	return static_cast<std::string>(shapeCombo_->getItemNameAt(index));
+}
+
+std::string WorldMapGui::getTool()
+{
+	return tool_;
+}
+
+void WorldMapGui::setStatsText(const std::string &text)
+{
+	statsText_->setCaption(text);
+}
+
+void WorldMapGui::updateProfiler(unsigned long delta)
+{
+	if (!profilerText_->getVisible()) {
+		return;
+	}
+	//twice a second is enough to read it
+	if (profilerRefresh_ > delta) {
+		profilerRefresh_ -= delta;
+		return;
+	}
+	profilerRefresh_ = 500;
+	profilerText_->setCaption(Profiler::getReport());
+}
+
 void WorldMapGui::buttonClicked(MyGUI::WidgetPtr sender)
 {
 	if (sender == exitBtn_) {
@@ -120,17 +181,29 @@ void WorldMapGui::buttonClicked(MyGUI::WidgetPtr sender)
 		arg["Y"] = 1;
 		arg["Z"] = tools::stringToInt(sizeZ);
 		EventMgrFactory::getCurrentEvtMgr()->sendEvent("resizeWorldMap", arg);
-	} else if ((sender == radio1_) || (sender == radio2_) || (sender == radio3_)) {
-		radio1_->setStateSelected(false);
-		radio2_->setStateSelected(false);
-		radio3_->setStateSelected(false);
-		static_cast<MyGUI::Button*>(sender)->setStateSelected(true);
-		if (sender == radio1_) radius_ = 1;
-		if (sender == radio2_) radius_ = 2;
-		if (sender == radio3_) radius_ = 3;
+	} else if (sender == generateBtn_) {
+		std::string sizeX = myGUI_->findWidget<MyGUI::Edit>("edit_sizeX")->getCaption();
+		std::string sizeZ = myGUI_->findWidget<MyGUI::Edit>("edit_sizeZ")->getCaption();
+		std::string seed = myGUI_->findWidget<MyGUI::Edit>("edit_seed")->getCaption();
+		if (!tools::is_number(sizeX) || !tools::is_number(sizeZ) || !tools::is_number(seed)) {
+			LOG(WARNING) << "Sizes or seed of the map to generate are incorrect";
+			return;
+		}
 		Arguments arg;
-		arg["radius"] = radius_;
-		EventMgrFactory::getCurrentEvtMgr()->sendEvent("markerRadiusChanged", arg);
+		arg["X"] = tools::stringToInt(sizeX);
+		arg["Y"] = 1;
+		arg["Z"] = tools::stringToInt(sizeZ);
+		arg["seed"] = tools::stringToInt(seed);
+		EventMgrFactory::getCurrentEvtMgr()->sendEvent("generateWorldMap", arg);
+	} else if ((sender == radioBrush_) || (sender == radioFlood_) || (sender == radioBox_)) {
+		radioBrush_->setStateSelected(false);
+		radioFlood_->setStateSelected(false);
+		radioBox_->setStateSelected(false);
+		static_cast<MyGUI::Button*>(sender)->setStateSelected(true);
+		if (sender == radioBrush_) tool_ = "brush";
+		if (sender == radioFlood_) tool_ = "flood";
+		if (sender == radioBox_) tool_ = "box";
+		sendBrushChanged();
 	} else if (sender == saveBtn_) {
 		Arguments args;
 		args["filename"] = std::string(myGUI_->findWidget<MyGUI::Edit>("edit_save")->getCaption());
@@ -145,3 +218,28 @@ void WorldMapGui::buttonClicked(MyGUI::WidgetPtr sender)
 	
 }
 
+void WorldMapGui::radiusAccepted(MyGUI::Edit *sender)
+{
+	std::string radius = sender->getCaption();
+	if (!tools::is_number(radius) || tools::stringToInt(radius) < 1 || tools::stringToInt(radius) > Brush::maxRadius) {
+		LOG(WARNING) << "Brush size must be between 1 and " << Brush::maxRadius;
+		sender->setCaption(Ogre::StringConverter::toString(radius_));
+		return;
+	}
+	radius_ = tools::stringToInt(radius);
+	sendBrushChanged();
+}
+
+void WorldMapGui::shapeAccepted(MyGUI::ComboBox *sender, size_t index)
+{
+	sendBrushChanged();
+}
+
+void WorldMapGui::sendBrushChanged()
+{
+	Arguments arg;
+	arg["radius"] = radius_;
+	arg["shape"] = getShape();
+	arg["tool"] = tool_;
+	EventMgrFactory::getCurrentEvtMgr()->sendEvent("brushChanged", arg);
+}
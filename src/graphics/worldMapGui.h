@@ -2,6 +2,7 @@
 #define WORLDMAPGUI_H
 
 #include "../eventManager.h"
+#include "../materialRegistry.h"
 #include <MYGUI/MyGUI.h>
 #include <MYGUI/MyGUI_OgrePlatform.h>
 #include "OGRE/Ogre.h"
@@ -10,28 +11,42 @@
 class WorldMapGui: public Subscribable
 {
 	public:
-		WorldMapGui(Ogre::RenderWindow* window, Ogre::SceneManager *sceneMgr);
+		WorldMapGui(Ogre::RenderWindow* window, Ogre::SceneManager *sceneMgr, const MaterialRegistry *materials);
 		~WorldMapGui();
 
 		bool hasFocus();
 		std::string getSelectedMatter();
 		int getRadius();
+		std::string getShape();
+		std::string getTool();
+		void setStatsText(const std::string &text);
+		void updateProfiler(unsigned long delta);
 	private:
 		void buttonClicked(MyGUI::WidgetPtr sender);
+		void radiusAccepted(MyGUI::Edit *sender);
+		void shapeAccepted(MyGUI::ComboBox *sender, size_t index);
+		void sendBrushChanged();
 
 	
 		MyGUI::Gui *myGUI_;
 		MyGUI::OgrePlatform* platform_;
 		int radius_;
+		std::string tool_;
 		
 		MyGUI::ButtonPtr exitBtn_;
 		MyGUI::ButtonPtr resizeBtn_;
+		MyGUI::ButtonPtr generateBtn_;
 		MyGUI::ListBox *matterList_;
-		MyGUI::ButtonPtr radio1_;
-		MyGUI::ButtonPtr radio2_;
-		MyGUI::ButtonPtr radio3_;
+		MyGUI::Edit *radiusEdit_;
+		MyGUI::ComboBox *shapeCombo_;
+		MyGUI::ButtonPtr radioBrush_;
+		MyGUI::ButtonPtr radioFlood_;
+		MyGUI::ButtonPtr radioBox_;
 		MyGUI::ButtonPtr saveBtn_;
 		MyGUI::ButtonPtr loadBtn_;
+		MyGUI::StaticText *statsText_;
+		MyGUI::StaticText *profilerText_;
+		unsigned long profilerRefresh_;
 };
 
 #endif
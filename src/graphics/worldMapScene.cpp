@@ -2,31 +2,86 @@
 #include <glog/logging.h>
 #include <set>
 #include <cmath>
+#include <algorithm>
+#include <sstream>
 #include "../matterVoxel.h"
+#include "../voxelRay.h"
+#include "../profiler.h"
+#include "../metrics.h"
 
-WorldMapScene::WorldMapScene(Ogre::Root* ogre, Ogre::RenderWindow* window, const std::unique_ptr<CubeMap<Voxel>> *worldMap):
+WorldMapScene::WorldMapScene(const Options *config, Ogre::Root* ogre, Ogre::RenderWindow* window, const std::unique_ptr<CubeMap<Voxel>> *worldMap, const MaterialRegistry *materials):
 	ogre_(ogre),
 	sceneMgr_{ogre_->createSceneManager(Ogre::ST_GENERIC)},
 	worldMap_{worldMap},
+	materials_{materials},
 	worldMapNode_{sceneMgr_->getRootSceneNode()->createChildSceneNode()},
 	camera_{std::unique_ptr<Camera>(new Camera("mainCam", sceneMgr_, window))},
 	cubeSize_{50.0f},
 	chunkSize_{8},
+	chunks_{},
+	dirtyChunks_{},
+	nbChunks_{0,0,0},
+	mapSize_{0,0,0},
+	mesher_{},
+	chunkMesh_{},
+	meshStats_{},
+	bufferPool_{static_cast<size_t>(std::max(config->getValue<int>("gpuBufferPoolSize"), 0))*1024*1024},
+	sharedMeshes_{},
+	meshCache_{},
+	regionSize_{std::max(config->getValue<int>("chunkRegionSize"), 1)},
+	nbRegions_{0,0,0},
+	regions_{},
+	chunkCulling_{config->getValue<bool>("chunkCulling")},
+	visibilityDirty_{true},
+	lastCameraPosition_{Ogre::Vector3::ZERO},
+	lastCameraOrientation_{Ogre::Quaternion::IDENTITY},
+	visibilityStats_{0,0,0,0,0},
+	lodDistance_{config->getValue<float>("lodDistance")},
+	lodHysteresis_{0.1f},
+	lodBuildsPerUpdate_{16},
 	gui_{},
 	mouseButtonPressed{false},
 	selectedCube_{-1,-1,-1},
-	selectionMarkNode_{sceneMgr_->getRootSceneNode()->createChildSceneNode()}
-{
-	textureAtlasInfos_["unknown"] = 1;	
-	textureAtlasInfos_["sea"] = 2;
-	textureAtlasInfos_["plain"] = 3;
-	textureAtlasInfos_["mountain"] = 4;
-	textureAtlasInfos_["desert"] = 5;
-	textureAtlasInfos_["ocean"] = 6;
-	textureAtlasInfos_["forest"] = 7;
-	textureAtlasInfos_["ice"] = 8;
-	
+	selectedFace_{-1},
+	brush_{},
+	tool_{"brush"},
+	boxAnchor_{-1,-1,-1},
+	selectionMarkNode_{sceneMgr_->getRootSceneNode()->createChildSceneNode()},
+	selectionMark_{nullptr},
+	markCells_{},
+	markGrid_{}
+{
 	LOG(INFO) << "Creating a new scene: WorldMap";	
+	//choose how chunk vertices are sent to the graphic card
+	VertexFormat format = VertexFormat::Float;
+	if (!ChunkMesher::stringToFormat(config->getValue<std::string>("chunkVertexFormat"), format)) {
+		LOG(WARNING) << "Unknown chunk vertex format, using floats";
+	}
+	//the packed shaders need the texture array, the default material works with the atlas
+	if (format == VertexFormat::Packed && !initPackedMaterial()) {
+		LOG(WARNING) << "Packed chunks can't be drawn, using floats";
+		format = VertexFormat::Float;
+	}
+	mesher_ = std::unique_ptr<ChunkMesher>(new ChunkMesher(cubeSize_, materials_->getNbAtlasRows(), format));
+	mesher_->setDedupVertices(config->getValue<bool>("chunkDedupVertices"));
+	mesher_->setShortIndices(config->getValue<bool>("chunkShortIndices"));
+	if (format == VertexFormat::Packed && regionSize_*chunkSize_ > ChunkMesher::maxPackedChunkSize) {
+		//packed positions of a region are limited like the ones of a chunk
+		regionSize_ = ChunkMesher::maxPackedChunkSize/chunkSize_;
+		LOG(WARNING) << "Chunk regions too big for the packed vertex format, using " << regionSize_ << "x" << regionSize_;
+	}
+	if (regionSize_ > 1) {
+		LOG(INFO) << "Chunks drawn by regions of " << regionSize_ << "x" << regionSize_ << ", without levels of detail nor occlusion culling";
+	}
+	//meshes of the previous sessions, they depend on the mesher and on the matters
+	int cacheSize = config->getValue<int>("meshCacheSize");
+	if (cacheSize > 0) {
+		meshCache_ = std::unique_ptr<ChunkMeshCache>(new ChunkMeshCache());
+		std::uint64_t key = mesher_->getCacheKey() ^ materials_->getSignature();
+		if (!meshCache_->open(config->getValue<std::string>("meshCacheFile"), static_cast<size_t>(cacheSize)*1024*1024, key)) {
+			meshCache_.reset();
+		}
+	}
 	//load camera
 	camera_->getCameraPtr()->lookAt(0, -1, -0.5); 
 	//load gui
@@ -66,55 +121,53 @@ WorldMapScene::WorldMapScene(Ogre::Root* ogre, Ogre::RenderWindow* window, const
 	cube->end();
 	cube->convertToMesh("meshCube");
 	
-	//create the selection marker cube
-	Ogre::ManualObject* selectionMarker;
-	selectionMarker = sceneMgr_->createManualObject("selectionMarker");
-	selectionMarker->setDynamic(false);
-	selectionMarker->begin("BaseWhiteNoLighting", Ogre::RenderOperation::OT_LINE_LIST);
-	{
-		selectionMarker->position(0,0,0);
-		selectionMarker->colour(Ogre::ColourValue(1, 0.0, 0.0));
-		selectionMarker->position(cubeSize_,0,0);
-		selectionMarker->position(cubeSize_,0,cubeSize_);
-		selectionMarker->position(0,0,cubeSize_);
-
-		selectionMarker->index(0);
-		selectionMarker->index(1);
-		selectionMarker->index(1);
-		selectionMarker->index(2);
-		selectionMarker->index(2);
-		selectionMarker->index(3);
-		selectionMarker->index(3);
-		selectionMarker->index(0);
-	}
-	selectionMarker->end();
-	selectionMarker->convertToMesh("meshSelectionMarker");
-	subscribe("markerRadiusChanged", [this](std::string eventName, Arguments args){
-		createSelectionMark(boost::any_cast<int>(args["radius"]));
+	//create the selection marker, its buffers are rewritten in place when the brush changes
+	selectionMark_ = sceneMgr_->createManualObject("selectionMark");
+	selectionMark_->setDynamic(true);
+	selectionMark_->estimateVertexCount(8*maxMarkCells_);
+	markCells_.reserve(maxMarkCells_);
+	selectionMark_->begin("BaseWhiteNoLighting", Ogre::RenderOperation::OT_LINE_LIST);
+	selectionMark_->position(0, 0, 0);
+	selectionMark_->colour(Ogre::ColourValue::Red);
+	selectionMark_->position(0, 0, 0);
+	selectionMark_->colour(Ogre::ColourValue::Red);
+	selectionMark_->end();
+	selectionMarkNode_->attachObject(selectionMark_);
+	selectionMarkNode_->setVisible(false);
+	createSelectionMark();
+	subscribe("brushChanged", [this](std::string eventName, Arguments args){
+		BrushShape shape = BrushShape::Diamond;
+		Brush::stringToShape(boost::any_cast<std::string>(args["shape"]), shape);
+		brush_.setShape(shape);
+		brush_.setRadius(boost::any_cast<int>(args["radius"]));
+		tool_ = boost::any_cast<std::string>(args["tool"]);
+		boxAnchor_.x = -1;
+		createSelectionMark();
 	});
 	subscribe("mapCreated", [this](std::string eventName, Arguments args){ drawMap(); });
-	subscribe("mapResized", [this](std::string eventName, Arguments args){ drawMap(); });
-	subscribe("cubeModified", [this](std::string eventName, Arguments args){
-		//set the clean flag of the correct chunk to false
-		int id = calculateChunkId(boost::any_cast<int>(args["x"]), boost::any_cast<int>(args["y"]), boost::any_cast<int>(args["z"]));
-		
-		for (ChunkInfos &chunk : chunkList) {
-			if (chunk.id == id) {
-				LOG(INFO) << "Chunk id=" << id << " is to be redrawn";
-				chunk.clean = false;
-				break;
+	subscribe("mapResized", [this](std::string eventName, Arguments args){
+		int offsetX = args.count("offsetX") ? boost::any_cast<int>(args["offsetX"]) : 0;
+		int offsetY = args.count("offsetY") ? boost::any_cast<int>(args["offsetY"]) : 0;
+		int offsetZ = args.count("offsetZ") ? boost::any_cast<int>(args["offsetZ"]) : 0;
+		resizeMap(offsetX, offsetY, offsetZ);
+	});
+	subscribe("cubesModified", [this](std::string eventName, Arguments args){
+		//set the clean flag of every chunk touched by the edit to false, and of the neighbours whose
+		//mesh reads the edited cubes (one block around a chunk, of the coarsest level of detail)
+		const int apron = 1 << ChunkMesher::maxLod;
+		int minX = std::max(boost::any_cast<int>(args["minX"]) - apron, 0) / chunkSize_;
+		int minY = std::max(boost::any_cast<int>(args["minY"]) - apron, 0) / chunkSize_;
+		int minZ = std::max(boost::any_cast<int>(args["minZ"]) - apron, 0) / chunkSize_;
+		int maxX = std::min((boost::any_cast<int>(args["maxX"]) + apron) / chunkSize_, nbChunks_.x-1);
+		int maxY = std::min((boost::any_cast<int>(args["maxY"]) + apron) / chunkSize_, nbChunks_.y-1);
+		int maxZ = std::min((boost::any_cast<int>(args["maxZ"]) + apron) / chunkSize_, nbChunks_.z-1);
+		for (int z=minZ; z<=maxZ; ++z) {
+			for (int y=minY; y<=maxY; ++y) {
+				for (int x=minX; x<=maxX; ++x) {
+					dirtyChunks_.insert(x + y*nbChunks_.x + z*nbChunks_.x*nbChunks_.y);
+				}
 			}
 		}
-		
-		//~ ChunkInfos copy;
-		//~ copy.id = id;
-		//~ copy.clean = true;
-		//~ auto res = std::find(chunkList.begin(), chunkList.end(), copy);
-		//~ if (res == chunkList.end()) {
-			//~ LOG(INFO) << "Chunk to modify not found in vector";
-		//~ } else {
-			//~ res->clean = false;
-		//~ }
 	});
 }
 
@@ -125,48 +178,194 @@ WorldMapScene::~WorldMapScene()
 
 void WorldMapScene::update(unsigned long delta)
 {
+	PROFILE_ZONE("WorldMapScene::update");
 	camera_->update(delta);
-	//check if some chunks need to be redrawn
-	for (ChunkInfos &chunk : chunkList) {
-		if (!chunk.clean) {
-			LOG(INFO) << "Redraw chunk id=" << chunk.id;
-			drawChunk(chunk.id);
-			chunk.clean = true;
-		}
+	//redraw the chunks modified since the last update
+	for (int id : dirtyChunks_) {
+		LOG(INFO) << "Redraw chunk id=" << id;
+		drawChunk(id);
 	}
+	dirtyChunks_.clear();
+	for (auto &region : regions_) {
+		region->update();
+	}
+	updateVisibility();
+	gui_->updateProfiler(delta);
 }
 
 void WorldMapScene::drawMap()
 {
 	//draw the whole map from the cubeMap
 	if (!worldMap_) { LOG(ERROR) << "No wolrdMap to draw"; }
-	if (worldMapNode_->numChildren() > 0) {
+	//culled chunks are detached from the scene graph, unused levels of detail from their node
+	for (auto &entry : chunks_) {
+		setChunkVisible(entry.second, true);
+		clearChunkLods(entry.second);
+	}
+	if (worldMapNode_->numChildren() > 0 || !chunks_.empty()) {
 		LOG(WARNING) << "A map appears to already be loaded";
+		//regions destroy their own entity
+		regions_.clear();
 		//clear the worldMapNode_
 		destroyAllAttachedMovableObjects(worldMapNode_);
 		worldMapNode_->removeAndDestroyAllChildren();
-		chunkList.clear();
+		//meshes are kept for the chunks of the new map with the same content (a resized map
+		//moved by whole chunks), only the chunks whose content changed are meshed again
+		for (auto &shared : sharedMeshes_) {
+			shared.second.users = 0;
+		}
+		chunks_.clear();
 	}
+	dirtyChunks_.clear();
+	meshStats_ = MeshStats();
 	//draw by chunk
-	int chunkId = 0;
-	for (int z=0; z<=((*worldMap_)->getSizeZ()/chunkSize_); ++z) {
-		for (int y=0; y<=((*worldMap_)->getSizeY()/chunkSize_); ++y) {
-			for (int x=0; x<=((*worldMap_)->getSizeX()/chunkSize_); ++x) {
-				LOG(INFO) << "IDchunks: " << x << " " << y << " " << z << " ->" << chunkId;
-				int startX = x*chunkSize_;
-				int startY = y*chunkSize_;
-				int startZ = z*chunkSize_;
-				LOG(INFO) << "Draw chunk id=" << chunkId << " at position " << startX << " " << startY << " " << startZ;
-				drawChunk(startX, startY, startZ, startX+chunkSize_-1, startY+chunkSize_-1, startZ+chunkSize_-1);
-				ChunkInfos newChunk;
-				newChunk.id = chunkId;
-				newChunk.clean = true;
-				chunkList.push_back(newChunk);
-				++chunkId;
+	nbChunks_.x = std::ceil((*worldMap_)->getSizeX()/(float)chunkSize_);
+	nbChunks_.y = std::ceil((*worldMap_)->getSizeY()/(float)chunkSize_);
+	nbChunks_.z = std::ceil((*worldMap_)->getSizeZ()/(float)chunkSize_);
+	mapSize_.x = (*worldMap_)->getSizeX();
+	mapSize_.y = (*worldMap_)->getSizeY();
+	mapSize_.z = (*worldMap_)->getSizeZ();
+	if (regionSize_ > 1) {
+		createRegions();
+	}
+	//the chunks without any cube have nothing to draw nor to hide
+	markFilledChunks();
+	for (int id : dirtyChunks_) {
+		drawChunk(id);
+	}
+	dirtyChunks_.clear();
+	removeUnusedChunkMeshes();
+	for (auto &region : regions_) {
+		region->update();
+	}
+	LOG(INFO) << "Map meshed (" << ChunkMesher::formatToString(mesher_->getFormat()) << " vertices): "
+		<< meshStats_.nbChunks << " chunks, " << meshStats_.nbVertices << " vertices, "
+		<< meshStats_.nbIndices << " indices, " << meshStats_.vertexBytes + meshStats_.indexBytes << " bytes, "
+		<< "vertex dedup ratio " << meshStats_.dedupRatio() << ", "
+		<< sharedMeshes_.size() << " distinct meshes";
+	Metrics::setGauge("scene.chunks", chunks_.size());
+	Metrics::setGauge("scene.regions", regions_.size());
+	Metrics::setGauge("mesh.bytes", meshStats_.vertexBytes + meshStats_.indexBytes);
+	if (meshCache_) {
+		meshCache_->save();
+		Metrics::setGauge("mesh.cacheBytes", meshCache_->getSize());
+	}
+	camera_->setPosition((*worldMap_)->getSizeX()*cubeSize_/2, 500, (*worldMap_)->getSizeZ()*cubeSize_/2+150);
+}
+
+//after CubeMap::resize: the chunks kept by the resize (see planChunkMoves) keep their node and their
+//meshes, only the new chunks and the ones whose neighbours changed are meshed, by update
+void WorldMapScene::resizeMap(int offsetX, int offsetY, int offsetZ)
+{
+	if (!*worldMap_) {
+		return;
+	}
+	const Coordinates oldSize = mapSize_;
+	const Coordinates newSize = {(*worldMap_)->getSizeX(), (*worldMap_)->getSizeY(), (*worldMap_)->getSizeZ()};
+	ChunkMoves moves;
+	if (!regions_.empty() || oldSize.x == 0 || !planChunkMoves(oldSize, newSize, {offsetX, offsetY, offsetZ}, chunkSize_, moves)) {
+		drawMap();
+		return;
+	}
+	mapSize_ = newSize;
+	nbChunks_ = moves.nbChunks;
+	std::unordered_map<int, ChunkInfos> chunks;
+	std::unordered_set<int> dirty;
+	for (int z=0; z<nbChunks_.z; ++z) {
+		for (int y=0; y<nbChunks_.y; ++y) {
+			for (int x=0; x<nbChunks_.x; ++x) {
+				int id = x + y*nbChunks_.x + z*nbChunks_.x*nbChunks_.y;
+				int from = moves.from[id];
+				//drawChunk keeps the mesh if its hash didn't change
+				if (from < 0 || moves.redraw[id] || dirtyChunks_.count(from)) {
+					dirty.insert(id);
+				}
+				auto old = from < 0 ? chunks_.end() : chunks_.find(from);
+				if (old == chunks_.end()) {
+					continue;
+				}
+				ChunkInfos &chunk = chunks[id];
+				chunk = old->second;
+				chunk.id = id;
+				chunk.start.x = x*chunkSize_;
+				chunk.start.y = y*chunkSize_;
+				chunk.start.z = z*chunkSize_;
+				if (chunk.node) {
+					chunk.node->translate(offsetX*cubeSize_, offsetY*cubeSize_, offsetZ*cubeSize_);
+				}
+				chunks_.erase(old);
 			}
 		}
 	}
-	camera_->setPosition((*worldMap_)->getSizeX()*cubeSize_/2, 500, (*worldMap_)->getSizeZ()*cubeSize_/2+150);
+	for (auto &entry : chunks_) {
+		destroyChunk(entry.second);
+	}
+	chunks_.swap(chunks);
+	dirtyChunks_.swap(dirty);
+	visibilityDirty_ = true;
+	LOG(INFO) << "Map resized: " << moves.nbMoved << " chunks moved, " << moves.from.size()-moves.nbMoved << " new";
+	Metrics::setGauge("scene.chunks", chunks_.size());
+}
+
+//the scene chunks inside a chunk of the map with cubes are drawn by the next update
+void WorldMapScene::markFilledChunks()
+{
+	const CubeMap<Voxel> &map = **worldMap_;
+	const int size = CubeMap<Voxel>::chunkSize;
+	for (int k=0; k<map.getNbChunksZ(); ++k) {
+		for (int j=0; j<map.getNbChunksY(); ++j) {
+			for (int i=0; i<map.getNbChunksX(); ++i) {
+				if (map.isChunkEmpty(i, j, k)) {
+					continue;
+				}
+				int maxX = (std::min((i+1)*size, map.getSizeX())-1) / chunkSize_;
+				int maxY = (std::min((j+1)*size, map.getSizeY())-1) / chunkSize_;
+				int maxZ = (std::min((k+1)*size, map.getSizeZ())-1) / chunkSize_;
+				for (int z=k*size/chunkSize_; z<=maxZ; ++z) {
+					for (int y=j*size/chunkSize_; y<=maxY; ++y) {
+						for (int x=i*size/chunkSize_; x<=maxX; ++x) {
+							dirtyChunks_.insert(x + y*nbChunks_.x + z*nbChunks_.x*nbChunks_.y);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void WorldMapScene::initChunk(ChunkInfos &chunk, int id, int x, int y, int z)
+{
+	chunk.id = id;
+	chunk.start.x = x*chunkSize_;
+	chunk.start.y = y*chunkSize_;
+	chunk.start.z = z*chunkSize_;
+	chunk.node = nullptr;
+	chunk.empty = true;
+	chunk.visible = true;
+	chunk.solidSides = 0;
+	chunk.lod = 0;
+	for (int lod=0; lod<=ChunkMesher::maxLod; ++lod) {
+		chunk.lods[lod] = nullptr;
+		chunk.nbTriangles[lod] = 0;
+		chunk.meshHashes[lod] = 0;
+	}
+	chunk.lodBuilt = 0;
+}
+
+//its node, entities and meshes
+void WorldMapScene::destroyChunk(ChunkInfos &chunk)
+{
+	clearChunkLods(chunk);
+	if (chunk.node) {
+		setChunkVisible(chunk, true);
+		destroyAllAttachedMovableObjects(chunk.node);
+		sceneMgr_->destroySceneNode(chunk.node);
+		chunk.node = nullptr;
+	}
+	if (chunk.lodBuilt & 1) {
+		releaseChunkMesh(chunk.meshHashes[0]);
+	}
+	chunk.lodBuilt = 0;
 }
 
 void WorldMapScene::createCube(int x, int y, int z, std::string id)
@@ -186,10 +385,8 @@ void WorldMapScene::createCube(int x, int y, int z, std::string id)
 		//retrieve the type from the voxel
 		MatterVoxel *matVox;
 		matVox = static_cast<MatterVoxel*>((*worldMap_)->getVoxel(x, y, z));
-		std::string matterType = matVox->getType();
-		//~ LOG(INFO) << "MatterType: " << matterType;
 		//set the right material
-		newCube->getSubEntity(0)->setMaterialName(matterType);
+		newCube->getSubEntity(0)->setMaterialName(matVox->getMatterInfos().material);
 		newNode->attachObject(newCube);
 	} else {
 		LOG(WARNING) << "Don't know how to draw that type of voxel: " << id;
@@ -216,9 +413,8 @@ void WorldMapScene::createCube2(int x, int y, int z, std::string id)
 		//retrieve the type from the voxel
 		MatterVoxel *matVox;
 		matVox = static_cast<MatterVoxel*>((*worldMap_)->getVoxel(x, y, z));
-		std::string matterType = matVox->getType();
 
-		cubeOptimised->begin(matterType, Ogre::RenderOperation::OT_TRIANGLE_LIST);
+		cubeOptimised->begin(matVox->getMatterInfos().material, Ogre::RenderOperation::OT_TRIANGLE_LIST);
 		//check if face is hidden by another cube
 		int vertexCount = 0;
 		//top
@@ -299,192 +495,427 @@ void WorldMapScene::createCube2(int x, int y, int z, std::string id)
 }
 
 //draw a chunk of the map as one mesh (using a texture atlas)
-void WorldMapScene::drawChunk(int startX, int startY, int startZ, int endX, int endY, int endZ)
+//names are left to Ogre: nodes are moved by resizeMap, a name with their position would be wrong
+Ogre::SceneNode* WorldMapScene::drawChunk(Ogre::SceneNode *chunkNode, int startX, int startY, int startZ, int endX, int endY, int endZ, std::uint64_t meshKey)
 {
 	//check values
 	if (startX>endX || startY>endY || startZ>endZ) {
 		LOG(WARNING) << "Trying to draw a chunk with incorrect coordinates: from " << startX << "-" << startY << "-" << startZ << " to " << endX << "-" << endY << "-" << endZ;
-		return;
+		return nullptr;
 	}
-	std::string nodeName = Ogre::StringConverter::toString(startX) + "-" + 
-							Ogre::StringConverter::toString(startY) + "-" + 
-							Ogre::StringConverter::toString(startZ) + "_chunkNode";
-	Ogre::SceneNode *chunkNode = nullptr;
-	if (!sceneMgr_->hasSceneNode(nodeName)) {
+	LOG(INFO) << "Draw chunk of coord: [" << startX << "," << startY << "," << startZ << "] [" << endX << "," << endY << "," << endZ << "]";
+	const SharedChunkMesh &shared = sharedMeshes_[meshKey];
+	if (shared.mesh.isNull()) {
+		//a chunk without faces has no node
+		if (chunkNode) {
+			destroyAllAttachedMovableObjects(chunkNode);
+			sceneMgr_->destroySceneNode(chunkNode);
+		}
+		return nullptr;
+	}
+	if (!chunkNode) {
 		LOG(INFO) << "Create a new node for the chunk";
-		chunkNode = worldMapNode_->createChildSceneNode(nodeName);
+		chunkNode = worldMapNode_->createChildSceneNode();
 		chunkNode->setPosition (startX*cubeSize_, startY*cubeSize_, startZ*cubeSize_);	
 		//~ chunkNode->showBoundingBox(true);	
 	} else {
 		LOG(INFO) << "clear what's attached to the scene node";
-		chunkNode = sceneMgr_->getSceneNode(nodeName);
 		destroyAllAttachedMovableObjects(chunkNode);
 	}
-	LOG(INFO) << "Draw chunk of coord: [" << startX << "," << startY << "," << startZ << "] [" << endX << "," << endY << "," << endZ << "]";
-	LOG(INFO) << "Try to draw a chunk of size: " << endX-startX+1 << "*" << endY-startY+1 << "*" << endZ-startZ+1;
-	Ogre::ManualObject* chunkObject;
-	chunkObject = sceneMgr_->createManualObject(
-			Ogre::StringConverter::toString(startX) + "-" + 
-			Ogre::StringConverter::toString(startY) + "-" + 
-			Ogre::StringConverter::toString(startZ) + "_chunk");
-	chunkObject->setDynamic(false);
-	//draw all visible faces
-	chunkObject->begin("default", Ogre::RenderOperation::OT_TRIANGLE_LIST);
-	int vertexCount = 0;
-	for (int i=startX; i <=endX; ++i) {
-		for (int j=startY; j <=endY; ++j) {
-			for (int k=startZ; k<=endZ; ++k) {
-				//~ LOG(INFO) << "Try to draw element at: " << i << "-" << j << "-" << k;
-				//position in actual chunk
-				int posX = i-startX+1;
-				int posY = j-startY+1;
-				int posZ = k-startZ+1;
-				if (Voxel *vox = (*worldMap_)->getVoxel(i, j, k)) {
-					if (vox->getId() == "matter") {
-						MatterVoxel *matVox;
-						matVox = static_cast<MatterVoxel*>(vox);
-						std::string matterType = matVox->getType();
-						int atlasNb = 1; //adjust this number to the row of the material
-						int nbRaw = textureAtlasInfos_.size();
-						auto it = textureAtlasInfos_.find(matterType);
-						if (it != textureAtlasInfos_.end()) {
-							atlasNb = it->second;
-						}
-						//get the right texture coordinates
-						float x0 = 0;
-						float x1 = 1;
-						float y0 = (float)(atlasNb-1) / nbRaw;
-						float y1 = (float)atlasNb / nbRaw;
-						//~ LOG(INFO) << "mat: " << matterType << " = " << atlasNb;
-						//~ LOG(INFO) << x0 << " " << x1 << " " << y0 << " " << y1;
-						//create a representation for that voxel
-						//top
-						if (!(*worldMap_)->getVoxel(i, j+1, k)) {
-							chunkObject->position(cubeSize_*(posX-1),cubeSize_*posY,cubeSize_*(posZ-1)); chunkObject->textureCoord(x0,y0);
-							chunkObject->position(cubeSize_*(posX-1),cubeSize_*posY,cubeSize_*posZ); chunkObject->textureCoord(x0,y1);
-							chunkObject->position(cubeSize_*posX,cubeSize_*posY,cubeSize_*posZ); chunkObject->textureCoord(x1,y1);
-							chunkObject->position(cubeSize_*posX,cubeSize_*posY,cubeSize_*(posZ-1)); chunkObject->textureCoord(x1,y0);
-														
-							chunkObject->triangle(vertexCount,vertexCount+1,vertexCount+2);
-							chunkObject->triangle(vertexCount+2,vertexCount+3,vertexCount);
-							vertexCount += 4;
-						}
-						//left
-						if (!(*worldMap_)->getVoxel(i-1, j, k)) {
-							chunkObject->position(cubeSize_*(posX-1),cubeSize_*(posY-1),cubeSize_*(posZ-1)); chunkObject->textureCoord(0,1);
-							chunkObject->position(cubeSize_*(posX-1),cubeSize_*(posY-1),cubeSize_*posZ); chunkObject->textureCoord(1,1);
-							chunkObject->position(cubeSize_*(posX-1),cubeSize_*posY,cubeSize_*posZ); chunkObject->textureCoord(1,0);
-							chunkObject->position(cubeSize_*(posX-1),cubeSize_*posY,cubeSize_*(posZ-1)); chunkObject->textureCoord(0,0);
-				
-							chunkObject->triangle(vertexCount,vertexCount+1,vertexCount+2);
-							chunkObject->triangle(vertexCount+2,vertexCount+3,vertexCount);
-							vertexCount += 4;
-				
-						}
-						//bottom
-						if (!(*worldMap_)->getVoxel(i, j-1, k)) {
-							chunkObject->position(cubeSize_*(posX-1),cubeSize_*(posY-1),cubeSize_*(posZ-1)); chunkObject->textureCoord(0,1);
-							chunkObject->position(cubeSize_*posX,cubeSize_*(posY-1),cubeSize_*(posZ-1)); chunkObject->textureCoord(1,1);
-							chunkObject->position(cubeSize_*posX,cubeSize_*(posY-1),cubeSize_*posZ); chunkObject->textureCoord(1,0);
-							chunkObject->position(cubeSize_*(posX-1),cubeSize_*(posY-1),cubeSize_*posZ); chunkObject->textureCoord(0,0);
-				
-							chunkObject->triangle(vertexCount,vertexCount+1,vertexCount+2);
-							chunkObject->triangle(vertexCount+2,vertexCount+3,vertexCount);
-							vertexCount += 4;
-						}
-						//back
-						if (!(*worldMap_)->getVoxel(i, j, k-1)) {
-							chunkObject->position(cubeSize_*(posX-1),cubeSize_*(posY-1),cubeSize_*(posZ-1)); chunkObject->textureCoord(1,1);
-							chunkObject->position(cubeSize_*(posX-1),cubeSize_*posY,cubeSize_*(posZ-1)); chunkObject->textureCoord(1,0);
-							chunkObject->position(cubeSize_*posX,cubeSize_*posY,cubeSize_*(posZ-1)); chunkObject->textureCoord(0,0);
-							chunkObject->position(cubeSize_*posX,cubeSize_*(posY-1),cubeSize_*(posZ-1)); chunkObject->textureCoord(0,1);
-				
-							chunkObject->triangle(vertexCount,vertexCount+1,vertexCount+2);
-							chunkObject->triangle(vertexCount+2,vertexCount+3,vertexCount);
-							vertexCount += 4;
-						}
-						//right
-						if (!(*worldMap_)->getVoxel(i+1, j, k)) {
-							chunkObject->position(cubeSize_*posX,cubeSize_*(posY-1),cubeSize_*(posZ-1)); chunkObject->textureCoord(1,1);
-							chunkObject->position(cubeSize_*posX,cubeSize_*posY,cubeSize_*(posZ-1)); chunkObject->textureCoord(1,0);
-							chunkObject->position(cubeSize_*posX,cubeSize_*posY,cubeSize_*posZ); chunkObject->textureCoord(0,0);
-							chunkObject->position(cubeSize_*posX,cubeSize_*(posY-1),cubeSize_*posZ); chunkObject->textureCoord(0,1);
-				
-							chunkObject->triangle(vertexCount,vertexCount+1,vertexCount+2);
-							chunkObject->triangle(vertexCount+2,vertexCount+3,vertexCount);
-							vertexCount += 4;
-						}
-						//front
-						if (!(*worldMap_)->getVoxel(i, j, k+1)) {
-							chunkObject->position(cubeSize_*(posX-1),cubeSize_*(posY-1),cubeSize_*posZ); chunkObject->textureCoord(0,1);
-							chunkObject->position(cubeSize_*posX,cubeSize_*(posY-1),cubeSize_*posZ); chunkObject->textureCoord(1,1);
-							chunkObject->position(cubeSize_*posX,cubeSize_*posY,cubeSize_*posZ); chunkObject->textureCoord(1,0);
-							chunkObject->position(cubeSize_*(posX-1),cubeSize_*posY,cubeSize_*posZ); chunkObject->textureCoord(0,0);
-				
-							chunkObject->triangle(vertexCount,vertexCount+1,vertexCount+2);
-							chunkObject->triangle(vertexCount+2,vertexCount+3,vertexCount);
-							vertexCount += 4;
-						}
-					}
-				}
-			}
+	Ogre::Entity *chunkEntity = sceneMgr_->createEntity(shared.mesh->getName());
+	chunkNode->attachObject(chunkEntity);
+	return chunkNode;
+}
+
+//the mesh of the chunk is only built if no other chunk has the same content,
+//otherwise its buffers are shared and only the node position differs.
+//A mesh with the same key but another check is a collision: the chunk takes the next free key
+std::uint64_t WorldMapScene::acquireChunkMesh(const ChunkHash &hash, int startX, int startY, int startZ, int endX, int endY, int endZ, int lod)
+{
+	std::uint64_t key = hash.key;
+	auto found = sharedMeshes_.find(key);
+	while (found != sharedMeshes_.end() && found->second.check != hash.check) {
+		LOG(WARNING) << "Chunk hash collision on key " << std::hex << key;
+		Metrics::increment("mesh.hashCollisions");
+		found = sharedMeshes_.find(++key);
+	}
+	if (found != sharedMeshes_.end()) {
+		++found->second.users;
+		Metrics::increment("mesh.chunksShared");
+		return key;
+	}
+	//build the visible faces and send them to the graphic card
+	buildChunkMesh(hash, startX, startY, startZ, endX, endY, endZ, lod);
+	SharedChunkMesh shared;
+	shared.nbTriangles = chunkMesh_.indices.size()/3;
+	shared.users = 1;
+	shared.check = hash.check;
+	if (!chunkMesh_.empty()) {
+		std::ostringstream name;
+		name << std::hex << key << "_chunk";
+		shared.mesh = createChunkMesh(name.str(), chunkMesh_);
+	}
+	sharedMeshes_[key] = shared;
+	Metrics::setGauge("mesh.distinctMeshes", sharedMeshes_.size());
+	return key;
+}
+
+//faces of the chunk in chunkMesh_, from the disk cache if a previous session built them
+void WorldMapScene::buildChunkMesh(const ChunkHash &hash, int startX, int startY, int startZ, int endX, int endY, int endZ, int lod)
+{
+	if (meshCache_ && meshCache_->load(hash, chunkMesh_)) {
+		Metrics::increment("mesh.cacheHits");
+	} else {
+		mesher_->buildChunk(**worldMap_, startX, startY, startZ, endX, endY, endZ, chunkMesh_, lod);
+		Metrics::increment(lod == 0 ? "mesh.chunksBuilt" : "mesh.lodsBuilt");
+		if (meshCache_) {
+			meshCache_->store(hash, chunkMesh_);
 		}
 	}
-	chunkObject->end();
-	chunkNode->attachObject(chunkObject);
+	if (lod == 0) {
+		meshStats_.add(chunkMesh_);
+		Metrics::observe("mesh.vertices", chunkMesh_.nbVertices);
+	}
+}
+
+void WorldMapScene::releaseChunkMesh(std::uint64_t hash)
+{
+	auto found = sharedMeshes_.find(hash);
+	if (found == sharedMeshes_.end() || --found->second.users > 0) {
+		return;
+	}
+	if (!found->second.mesh.isNull()) {
+		recycleMeshBuffers(found->second.mesh);
+		Ogre::MeshManager::getSingleton().remove(found->second.mesh->getName());
+	}
+	sharedMeshes_.erase(found);
+	Metrics::setGauge("mesh.distinctMeshes", sharedMeshes_.size());
+}
+
+//the buffers of a mesh about to be removed are kept by the pool for the next chunks
+void WorldMapScene::recycleMeshBuffers(const Ogre::MeshPtr &mesh)
+{
+	if (mesh.isNull() || mesh->getNumSubMeshes() == 0) {
+		return;
+	}
+	Ogre::SubMesh *subMesh = mesh->getSubMesh(0);
+	bufferPool_.release(subMesh->vertexData->vertexBufferBinding->getBuffer(0));
+	bufferPool_.release(subMesh->indexData->indexBuffer);
+}
+
+Ogre::MeshPtr WorldMapScene::createChunkMesh(const std::string &name, const ChunkMesh &chunkMesh)
+{
+	Ogre::MeshPtr mesh = Ogre::MeshManager::getSingleton().createManual(name, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+	Ogre::SubMesh *subMesh = mesh->createSubMesh();
+	subMesh->useSharedVertices = false;
+	subMesh->vertexData = new Ogre::VertexData();
+	subMesh->vertexData->vertexStart = 0;
+	subMesh->vertexData->vertexCount = chunkMesh.nbVertices;
+	Ogre::VertexDeclaration *decl = subMesh->vertexData->vertexDeclaration;
+	if (chunkMesh.format == VertexFormat::Packed) {
+		//expanded by the chunkPacked vertex program
+		decl->addElement(0, 0, Ogre::VET_UBYTE4, Ogre::VES_POSITION);
+	} else {
+		decl->addElement(0, 0, Ogre::VET_FLOAT3, Ogre::VES_POSITION);
+		decl->addElement(0, 3*sizeof(float), Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES, 0);
+	}
+	//buffers from the pool are bigger than needed, only the used part is written and drawn
+	Ogre::HardwareVertexBufferSharedPtr vbuf = bufferPool_.acquireVertexBuffer(chunkMesh.vertexSize(), chunkMesh.nbVertices);
+	vbuf->writeData(0, chunkMesh.vertices.size(), &chunkMesh.vertices[0], true);
+	subMesh->vertexData->vertexBufferBinding->setBinding(0, vbuf);
+
+	Ogre::HardwareIndexBufferSharedPtr ibuf = bufferPool_.acquireIndexBuffer(
+		chunkMesh.shortIndices ? Ogre::HardwareIndexBuffer::IT_16BIT : Ogre::HardwareIndexBuffer::IT_32BIT,
+		chunkMesh.indices.size());
+	if (chunkMesh.shortIndices) {
+		unsigned short *dest = static_cast<unsigned short*>(ibuf->lock(0, chunkMesh.indices.size()*sizeof(unsigned short), Ogre::HardwareBuffer::HBL_DISCARD));
+		for (unsigned int index : chunkMesh.indices) {
+			*dest++ = static_cast<unsigned short>(index);
+		}
+		ibuf->unlock();
+	} else {
+		ibuf->writeData(0, chunkMesh.indices.size()*sizeof(unsigned int), &chunkMesh.indices[0], true);
+	}
+	subMesh->indexData->indexBuffer = ibuf;
+	subMesh->indexData->indexStart = 0;
+	subMesh->indexData->indexCount = chunkMesh.indices.size();
+	subMesh->setMaterialName(chunkMesh.format == VertexFormat::Packed ? "chunkPacked" : "default");
+
+	//positions of packed vertices are in cells, bounds are in world units
+	float extent = chunkSize_*cubeSize_;
+	mesh->_setBounds(Ogre::AxisAlignedBox(0, 0, 0, extent, extent, extent));
+	mesh->_setBoundingSphereRadius(std::sqrt(3.0f)*extent);
+	mesh->load();
+	return mesh;
+}
+
+//meshes of the previous map that no chunk of the new one took
+void WorldMapScene::removeUnusedChunkMeshes()
+{
+	size_t nbRemoved = 0;
+	for (auto it = sharedMeshes_.begin(); it != sharedMeshes_.end();) {
+		if (it->second.users > 0) {
+			++it;
+			continue;
+		}
+		if (!it->second.mesh.isNull()) {
+			recycleMeshBuffers(it->second.mesh);
+			Ogre::MeshManager::getSingleton().remove(it->second.mesh->getName());
+		}
+		it = sharedMeshes_.erase(it);
+		++nbRemoved;
+	}
+	if (nbRemoved > 0) {
+		LOG(INFO) << "Chunk meshes of the previous map removed: " << nbRemoved;
+	}
+	Metrics::setGauge("mesh.distinctMeshes", sharedMeshes_.size());
 }
 
 void WorldMapScene::drawChunk(int id)
 {
-	//calculate the coordinates of this chunk
-	int nbChunkX = std::ceil((*worldMap_)->getSizeX()/(float)chunkSize_);
-	int nbChunkY = std::ceil((*worldMap_)->getSizeY()/(float)chunkSize_);
-	int nbChunkZ = std::ceil((*worldMap_)->getSizeZ()/(float)chunkSize_);
-	
-	int chunkId = 0;
-	for (int z=0; z<nbChunkZ; ++z) { //not very efficient
-		for (int y=0; y<nbChunkY; ++y) {
-			for (int x=0; x<nbChunkX; ++x) {
-				if (chunkId == id) {
-					int xCoord = x*chunkSize_;
-					int yCoord = y*chunkSize_;
-					int zCoord = z*chunkSize_;
-					LOG(INFO) << "Draw chunk at " << xCoord << " " << yCoord << " " << zCoord;
-					drawChunk(xCoord, yCoord, zCoord, xCoord+chunkSize_-1, yCoord+chunkSize_-1, zCoord+chunkSize_-1);
-					return;	
+	if (id < 0 || id >= nbChunks_.x*nbChunks_.y*nbChunks_.z) {
+		LOG(WARNING) << "Trying to draw a chunk that doesn't exist: " << id;
+		return;
+	}
+	PROFILE_ZONE("chunkMeshing");
+	int x = id % nbChunks_.x;
+	int y = (id / nbChunks_.x) % nbChunks_.y;
+	int z = id / (nbChunks_.x*nbChunks_.y);
+	if (!regions_.empty()) {
+		drawChunkInRegion(x, y, z);
+		return;
+	}
+	auto found = chunks_.find(id);
+	if (found == chunks_.end()) {
+		found = chunks_.emplace(id, ChunkInfos()).first;
+		initChunk(found->second, id, x, y, z);
+	}
+	ChunkInfos &chunk = found->second;
+	const Coordinates &start = chunk.start;
+	LOG(INFO) << "Draw chunk at " << start.x << " " << start.y << " " << start.z;
+	ChunkHash hash = mesher_->hashChunk(**worldMap_, start.x, start.y, start.z, start.x+chunkSize_-1, start.y+chunkSize_-1, start.z+chunkSize_-1);
+	bool hadMesh = chunk.lodBuilt & 1;
+	if (hadMesh && hash.key == chunk.meshHashes[0] && hash.check == sharedMeshes_[chunk.meshHashes[0]].check) {
+		//painted with the same matter, or a neighbour changed out of its apron: the entity stays,
+		//the lower levels of detail (wider apron) are built again when they are needed
+		clearChunkLods(chunk);
+		return;
+	}
+	clearChunkLods(chunk);
+	//the old mesh is released after the new one is taken, so it is kept if another chunk uses it
+	std::uint64_t oldKey = chunk.meshHashes[0];
+	chunk.meshHashes[0] = acquireChunkMesh(hash, start.x, start.y, start.z, start.x+chunkSize_-1, start.y+chunkSize_-1, start.z+chunkSize_-1, 0);
+	chunk.node = drawChunk(chunk.node, start.x, start.y, start.z, start.x+chunkSize_-1, start.y+chunkSize_-1, start.z+chunkSize_-1, chunk.meshHashes[0]);
+	if (!chunk.node) {
+		chunk.visible = true;
+	}
+	if (hadMesh) {
+		releaseChunkMesh(oldKey);
+	}
+	const SharedChunkMesh &shared = sharedMeshes_[chunk.meshHashes[0]];
+	chunk.empty = shared.mesh.isNull();
+	chunk.lods[0] = (chunk.node && chunk.node->numAttachedObjects() > 0) ? static_cast<Ogre::Entity*>(chunk.node->getAttachedObject(0)) : nullptr;
+	chunk.nbTriangles[0] = shared.nbTriangles;
+	chunk.lodBuilt = 1;
+	chunk.solidSides = calculateSolidSides(start.x, start.y, start.z);
+	visibilityDirty_ = true;
+	if (!chunk.node && chunk.solidSides == 0) {
+		//nothing to draw nor to hide behind, like the chunks never drawn
+		destroyChunk(chunk);
+		chunks_.erase(found);
+	}
+}
+
+void WorldMapScene::createRegions()
+{
+	nbRegions_.x = (nbChunks_.x + regionSize_-1) / regionSize_;
+	nbRegions_.y = nbChunks_.y;
+	nbRegions_.z = (nbChunks_.z + regionSize_-1) / regionSize_;
+	const float chunkExtent = chunkSize_*cubeSize_;
+	Ogre::Vector3 extent(regionSize_*chunkExtent, chunkExtent, regionSize_*chunkExtent);
+	for (int z=0; z<nbRegions_.z; ++z) {
+		for (int y=0; y<nbRegions_.y; ++y) {
+			for (int x=0; x<nbRegions_.x; ++x) {
+				std::string name = Ogre::StringConverter::toString(x) + "-" + 
+									Ogre::StringConverter::toString(y) + "-" + 
+									Ogre::StringConverter::toString(z) + "_region";
+				Ogre::SceneNode *node = worldMapNode_->createChildSceneNode(name + "Node");
+				node->setPosition(x*extent.x, y*extent.y, z*extent.z);
+				regions_.push_back(std::unique_ptr<ChunkRegion>(new ChunkRegion(name, sceneMgr_, node,
+					regionSize_*regionSize_, cubeSize_, extent, mesher_->getFormat(), mesher_->getShortIndices(), &bufferPool_)));
+			}
+		}
+	}
+	LOG(INFO) << "Chunk regions: " << regions_.size();
+}
+
+//the faces of the chunk are copied into the slot of its region, sent by the next region update
+void WorldMapScene::drawChunkInRegion(int x, int y, int z)
+{
+	const Coordinates start = {x*chunkSize_, y*chunkSize_, z*chunkSize_};
+	int endX = start.x+chunkSize_-1;
+	int endY = start.y+chunkSize_-1;
+	int endZ = start.z+chunkSize_-1;
+	ChunkHash hash = mesher_->hashChunk(**worldMap_, start.x, start.y, start.z, endX, endY, endZ);
+	buildChunkMesh(hash, start.x, start.y, start.z, endX, endY, endZ, 0);
+	ChunkRegion &region = *regions_[x/regionSize_ + y*nbRegions_.x + (z/regionSize_)*nbRegions_.x*nbRegions_.y];
+	int slotX = x % regionSize_;
+	int slotZ = z % regionSize_;
+	region.setChunk(slotX + slotZ*regionSize_, chunkMesh_, slotX*chunkSize_, 0, slotZ*chunkSize_);
+	visibilityDirty_ = true;
+}
+
+void WorldMapScene::countVisibleRegions(Ogre::Camera *cam, VisibilityStats &stats) const
+{
+	//Ogre culls the region entities itself, this only counts them
+	const float chunkExtent = chunkSize_*cubeSize_;
+	const float regionExtent = regionSize_*chunkExtent;
+	for (int z=0; z<nbRegions_.z; ++z) {
+		for (int y=0; y<nbRegions_.y; ++y) {
+			for (int x=0; x<nbRegions_.x; ++x) {
+				const ChunkRegion &region = *regions_[x + y*nbRegions_.x + z*nbRegions_.x*nbRegions_.y];
+				if (region.empty()) {
+					++stats.empty;
+				} else if (chunkCulling_ && !cam->isVisible(Ogre::AxisAlignedBox(
+						x*regionExtent, y*chunkExtent, z*regionExtent,
+						(x+1)*regionExtent, (y+1)*chunkExtent, (z+1)*regionExtent))) {
+					++stats.frustumCulled;
+				} else {
+					++stats.drawn;
+					stats.triangles += region.getNbTriangles();
 				}
-				++chunkId;
 			}
 		}
 	}
-	
 }
 
-void WorldMapScene::createSelectionMark(int radius)
+void WorldMapScene::createSelectionMark()
+{
+	//cells covered by the tool, relative to the selected cube
+	markCells_.clear();
+	if (tool_ == "box" && boxAnchor_.x != -1 && selectedCube_.x != -1) {
+		for (int x=std::min(boxAnchor_.x, selectedCube_.x); x<=std::max(boxAnchor_.x, selectedCube_.x); ++x) {
+			for (int z=std::min(boxAnchor_.z, selectedCube_.z); z<=std::max(boxAnchor_.z, selectedCube_.z); ++z) {
+				markCells_.push_back(Coordinates{x-selectedCube_.x, 0, z-selectedCube_.z});
+			}
+		}
+	} else if (tool_ == "brush") {
+		int extent = brush_.getRadius()-1;
+		for (int z=-extent; z<=extent; ++z) {
+			int halfWidth = brush_.getHalfWidth(0, z);
+			for (int x=-halfWidth; x<=halfWidth; ++x) {
+				markCells_.push_back(Coordinates{x, 0, z});
+			}
+		}
+	} else {
+		markCells_.push_back(Coordinates{0, 0, 0});
+	}
+	drawSelectionMark();
+}
+
+//outline every cell of markCells_ with lines, edges shared by two cells are only drawn once
+void WorldMapScene::drawSelectionMark()
 {
-	//destroy current mark
-	destroyAllAttachedMovableObjects(selectionMarkNode_);
-	selectionMarkNode_->removeAndDestroyAllChildren();
-	//create a new mark
-	int xSize = radius-1;
-	for (int x=-xSize; x<=xSize; ++x) {
-		int ySize = xSize - std::abs(x);
-		LOG(INFO) << "xSize: " << xSize << " ySize: " << ySize;
-		for (int y=-ySize; y<=ySize; ++y) {
-			LOG(INFO) << "x=" << x << " y=" << y;
-			std::string entityName = "selectionMark" + Ogre::StringConverter::toString(x) + "-" + Ogre::StringConverter::toString(y);
-			Ogre::Entity *mark = sceneMgr_->createEntity(entityName, "meshSelectionMarker");
-			Ogre::SceneNode *node = selectionMarkNode_->createChildSceneNode();
-			node->setPosition(x*cubeSize_, 0, y*cubeSize_);
-			node->attachObject(mark);
+	if (markCells_.empty()) {
+		selectionMark_->setVisible(false);
+		return;
+	}
+	selectionMark_->setVisible(true);
+	int minX = markCells_[0].x, maxX = minX;
+	int minZ = markCells_[0].z, maxZ = minZ;
+	for (const Coordinates &cell : markCells_) {
+		minX = std::min(minX, cell.x);
+		maxX = std::max(maxX, cell.x);
+		minZ = std::min(minZ, cell.z);
+		maxZ = std::max(maxZ, cell.z);
+	}
+	//occupancy of the footprint's bounding box, one border cell on the right and front sides
+	int width = maxX-minX+2;
+	int depth = maxZ-minZ+2;
+	markGrid_.assign(width*depth, 0);
+	for (const Coordinates &cell : markCells_) {
+		markGrid_[(cell.x-minX) + (cell.z-minZ)*width] = 1;
+	}
+	const Ogre::ColourValue colour = Ogre::ColourValue::Red;
+	selectionMark_->beginUpdate(0);
+	for (const Coordinates &cell : markCells_) {
+		int gridIndex = (cell.x-minX) + (cell.z-minZ)*width;
+		float x0 = cell.x*cubeSize_;
+		float z0 = cell.z*cubeSize_;
+		float x1 = x0+cubeSize_;
+		float z1 = z0+cubeSize_;
+		//back and left edges
+		selectionMark_->position(x0, 0, z0); selectionMark_->colour(colour);
+		selectionMark_->position(x1, 0, z0); selectionMark_->colour(colour);
+		selectionMark_->position(x0, 0, z0); selectionMark_->colour(colour);
+		selectionMark_->position(x0, 0, z1); selectionMark_->colour(colour);
+		//right and front edges, unless the next cell draws them
+		if (!markGrid_[gridIndex+1]) {
+			selectionMark_->position(x1, 0, z0); selectionMark_->colour(colour);
+			selectionMark_->position(x1, 0, z1); selectionMark_->colour(colour);
+		}
+		if (!markGrid_[gridIndex+width]) {
+			selectionMark_->position(x0, 0, z1); selectionMark_->colour(colour);
+			selectionMark_->position(x1, 0, z1); selectionMark_->colour(colour);
 		}
 	}
+	selectionMark_->end();
 }
 
 
+bool WorldMapScene::initPackedMaterial()
+{
+	Ogre::MaterialPtr material = Ogre::MaterialManager::getSingleton().getByName("chunkPacked");
+	if (material.isNull()) {
+		LOG(ERROR) << "Material chunkPacked not found";
+		return false;
+	}
+	//one layer by matter instead of the atlas, so mipmaps don't mix the matters
+	if (!createMatterTextures()) {
+		return false;
+	}
+	Ogre::Pass *pass = material->getTechnique(0)->getPass(0);
+	pass->getTextureUnitState(0)->setTextureName("chunkMatters", Ogre::TEX_TYPE_2D_ARRAY);
+	material->load();
+	pass->getVertexProgramParameters()->setNamedConstant("cubeSize", cubeSize_);
+	return true;
+}
+
+//the rows of the atlas become the layers of the chunkMatters texture array, with their own mipmaps
+bool WorldMapScene::createMatterTextures()
+{
+	Ogre::Image atlas;
+	try {
+		atlas.load("atlas_test.png", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+	} catch (const Ogre::Exception &e) {
+		LOG(ERROR) << "Unable to load the texture atlas: " << e.getDescription();
+		return false;
+	}
+	std::vector<unsigned char> pixels(atlas.getWidth()*atlas.getHeight()*4);
+	Ogre::PixelBox rgba(atlas.getWidth(), atlas.getHeight(), 1, Ogre::PF_BYTE_RGBA, &pixels[0]);
+	Ogre::PixelUtil::bulkPixelConversion(atlas.getPixelBox(), rgba);
+	TextureArray layers;
+	if (!layers.build(&pixels[0], atlas.getWidth(), atlas.getHeight(), materials_->getNbAtlasRows())) {
+		return false;
+	}
+	//no automatic mipmaps, they would be made by the driver
+	Ogre::TexturePtr texture = Ogre::TextureManager::getSingleton().createManual("chunkMatters",
+		Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, Ogre::TEX_TYPE_2D_ARRAY,
+		layers.getWidth(), layers.getHeight(), layers.getNbLayers(), layers.getNbMipmaps(),
+		Ogre::PF_BYTE_RGBA, Ogre::TU_STATIC_WRITE_ONLY);
+	for (int mip=0; mip<=layers.getNbMipmaps(); ++mip) {
+		Ogre::PixelBox level(layers.getWidth(mip), layers.getHeight(mip), layers.getNbLayers(), Ogre::PF_BYTE_RGBA,
+			const_cast<unsigned char*>(&layers.getLevel(mip)[0]));
+		texture->getBuffer(0, mip)->blitFromMemory(level);
+	}
+	LOG(INFO) << "Matter texture array: " << layers.getNbLayers() << " layers of " << layers.getWidth() << "x" << layers.getHeight()
+		<< ", " << layers.getNbMipmaps() << " mipmaps";
+	return true;
+}
+
 bool WorldMapScene::initGui(Ogre::RenderWindow *window)
 {
-	gui_ = std::unique_ptr<WorldMapGui>(new WorldMapGui(window, sceneMgr_));
+	gui_ = std::unique_ptr<WorldMapGui>(new WorldMapGui(window, sceneMgr_, materials_));
 	
 	subscribe("mouseMoved", [this](std::string eventName, Arguments args){
 		if (!gui_->hasFocus()) checkSelection(boost::any_cast<int>(args["Xabs"]), boost::any_cast<int>(args["Yabs"]));
@@ -494,20 +925,45 @@ bool WorldMapScene::initGui(Ogre::RenderWindow *window)
 	});
 	subscribe("mousePressed", [this](std::string eventName, Arguments args){
 		if (!gui_->hasFocus()){
-			std::string matter = gui_->getSelectedMatter();
-			if ((matter != "") && (selectedCube_.x != -1)) {
-				Arguments arg;
-				arg["matter"] = matter;
-				arg["x"] = selectedCube_.x;
-				arg["y"] = selectedCube_.y;
-				arg["z"] = selectedCube_.z;
-				arg["radius"] = gui_->getRadius();
-				EventMgrFactory::getCurrentEvtMgr()->sendEvent("changeVoxelType", arg);
+			if (selectedCube_.x != -1) {
+				if (tool_ == "brush") {
+					sendPaintEvent();
+				} else if (tool_ == "flood") {
+					std::string matter = gui_->getSelectedMatter();
+					if (matter != "") {
+						Arguments arg;
+						arg["matter"] = matter;
+						arg["x"] = selectedCube_.x;
+						arg["y"] = selectedCube_.y;
+						arg["z"] = selectedCube_.z;
+						EventMgrFactory::getCurrentEvtMgr()->sendEvent("floodFillVoxels", arg);
+					}
+				} else if (tool_ == "box") {
+					//the box is filled when the button is released
+					boxAnchor_ = selectedCube_;
+					createSelectionMark();
+				}
 			}
 			mouseButtonPressed = true;
 		}
 	});
 	subscribe("mouseReleased", [this](std::string eventName, Arguments args){
+		if (tool_ == "box" && boxAnchor_.x != -1) {
+			std::string matter = gui_->getSelectedMatter();
+			if (matter != "" && selectedCube_.x != -1) {
+				Arguments arg;
+				arg["matter"] = matter;
+				arg["x0"] = boxAnchor_.x;
+				arg["y0"] = boxAnchor_.y;
+				arg["z0"] = boxAnchor_.z;
+				arg["x1"] = selectedCube_.x;
+				arg["y1"] = selectedCube_.y;
+				arg["z1"] = selectedCube_.z;
+				EventMgrFactory::getCurrentEvtMgr()->sendEvent("fillVoxelBox", arg);
+			}
+			boxAnchor_.x = -1;
+			createSelectionMark();
+		}
 		mouseButtonPressed = false;
 	});	
 	return true;
@@ -515,64 +971,63 @@ bool WorldMapScene::initGui(Ogre::RenderWindow *window)
 
 void WorldMapScene::checkSelection(int x, int y)
 {
-	//check if mouse is under a chunk	
+	//walk the voxel grid along the ray under the mouse
 	int height = camera_->getCameraPtr()->getViewport()->getActualHeight();
 	int width = camera_->getCameraPtr()->getViewport()->getActualWidth();
 	Ogre::Ray ray = camera_->getCameraPtr()->getCameraToViewportRay(x/float(width), y/float(height));
-	Ogre::RaySceneQuery *rayQuery = sceneMgr_->createRayQuery(ray);
-	rayQuery->setSortByDistance(true);
-	Ogre::RaySceneQueryResult res = rayQuery->execute();
-	
-	//only interested in the first _chunk
-	for (auto &ent : res) {
-		Ogre::MovableObject *obj = ent.movable;
-		if (obj) {
-			//~ LOG(INFO) << "Something under the mouse: " << obj->getName();
-			if (obj->getName().find("_chunk") != std::string::npos) {
-				//calculate which cube it is
-				Ogre::Vector3 point = rayQuery->getRay().getPoint(ent.distance);
-				//~ LOG(INFO) << xCoord << " " << zCoord;
-				Coordinates newSelec;
-				newSelec.x = (point.x-0.0001f) / cubeSize_;
-				newSelec.y = 0;
-				newSelec.z = (point.z-0.0001f) / cubeSize_;
-				if (!(newSelec.x == selectedCube_.x && newSelec.y == selectedCube_.y && newSelec.z == selectedCube_.z)) {
-					selectedCube_ = newSelec;
-					EventMgrFactory::getCurrentEvtMgr()->sendEvent("selectedCubeUpdated");
-					if (mouseButtonPressed) {
-						//maybe it's a mouse drag
-						std::string matter = gui_->getSelectedMatter();
-						if (matter != "") {
-							Arguments arg;
-							arg["matter"] = matter;
-							arg["x"] = selectedCube_.x;
-							arg["y"] = selectedCube_.y;
-							arg["z"] = selectedCube_.z;
-							arg["radius"] = gui_->getRadius();
-							EventMgrFactory::getCurrentEvtMgr()->sendEvent("changeVoxelType", arg);
-						}
-					}
-				}
-				return;		
+	VoxelHit hit;
+	if (*worldMap_ && pickVoxel(**worldMap_, ray.getOrigin().ptr(), ray.getDirection().ptr(), cubeSize_, hit)) {
+		Coordinates newSelec;
+		newSelec.x = hit.x;
+		newSelec.y = hit.y;
+		newSelec.z = hit.z;
+		selectedFace_ = hit.face;
+		if (!(newSelec.x == selectedCube_.x && newSelec.y == selectedCube_.y && newSelec.z == selectedCube_.z)) {
+			selectedCube_ = newSelec;
+			EventMgrFactory::getCurrentEvtMgr()->sendEvent("selectedCubeUpdated");
+			if (mouseButtonPressed && tool_ == "brush") {
+				//maybe it's a mouse drag
+				sendPaintEvent();
 			}
-		
 		}
+		return;
 	}
 	//~ LOG(INFO) << "Nothing under the mouse";
 	if (selectedCube_.x > -1) {
 		selectedCube_.x = -1;
 		selectedCube_.y = -1;
 		selectedCube_.z = -1;
+		selectedFace_ = -1;
 		EventMgrFactory::getCurrentEvtMgr()->sendEvent("selectedCubeUpdated");	
 	}
 }
 
+void WorldMapScene::sendPaintEvent()
+{
+	std::string matter = gui_->getSelectedMatter();
+	if (matter == "") {
+		return;
+	}
+	Arguments arg;
+	arg["matter"] = matter;
+	arg["x"] = selectedCube_.x;
+	arg["y"] = selectedCube_.y;
+	arg["z"] = selectedCube_.z;
+	arg["radius"] = brush_.getRadius();
+	arg["shape"] = Brush::shapeToString(brush_.getShape());
+	EventMgrFactory::getCurrentEvtMgr()->sendEvent("changeVoxelType", arg);
+}
+
 void WorldMapScene::updateSelection()
 {
 	selectionMarkNode_->setVisible(false);
+	if (boxAnchor_.x != -1) {
+		//the box outline follows the mouse
+		createSelectionMark();
+	}
 	if (selectedCube_.x != -1) {
 		//set the selection mark node to the right position
-		selectionMarkNode_->setPosition(selectedCube_.x*cubeSize_, cubeSize_ + 1.0f, selectedCube_.z*cubeSize_);
+		selectionMarkNode_->setPosition(selectedCube_.x*cubeSize_, (selectedCube_.y+1)*cubeSize_ + 1.0f, selectedCube_.z*cubeSize_);
 		selectionMarkNode_->setVisible(true);
 		
 		
@@ -641,12 +1096,257 @@ void WorldMapScene::destroyAllAttachedMovableObjects(Ogre::SceneNode *node)
 
 int WorldMapScene::calculateChunkId(int x, int y, int z)
 {
+	if (x < 0 || y < 0 || z < 0) {
+		return -1;
+	}
 	int chunkX = x/chunkSize_;
 	int chunkY = y/chunkSize_;
 	int chunkZ = z/chunkSize_;
-	int nbChunkX = std::ceil((*worldMap_)->getSizeX()/(float)chunkSize_);
-	int nbChunkY = std::ceil((*worldMap_)->getSizeY()/(float)chunkSize_);
-	int result = chunkX + chunkY*nbChunkX + chunkZ*nbChunkX*nbChunkY;
+	if (chunkX >= nbChunks_.x || chunkY >= nbChunks_.y || chunkZ >= nbChunks_.z) {
+		return -1;
+	}
+	int result = chunkX + chunkY*nbChunks_.x + chunkZ*nbChunks_.x*nbChunks_.y;
 	//~ LOG(INFO) << "chunk id for cube at " << x << " " << y << " " << z << " --> " << result;
 	return result;
 }
+
+unsigned char WorldMapScene::calculateSolidSides(int startX, int startY, int startZ) const
+{
+	//sides follow the mesher's face order: top, left, bottom, back, right, front
+	unsigned char sides = 0;
+	int last = chunkSize_-1;
+	for (int side=0; side<6; ++side) {
+		bool solid = true;
+		for (int a=0; a<chunkSize_ && solid; ++a) {
+			for (int b=0; b<chunkSize_ && solid; ++b) {
+				int x, y, z;
+				switch (side) {
+					case 0: x = a; y = last; z = b; break;
+					case 1: x = 0; y = a; z = b; break;
+					case 2: x = a; y = 0; z = b; break;
+					case 3: x = a; y = b; z = 0; break;
+					case 4: x = last; y = a; z = b; break;
+					default: x = a; y = b; z = last; break;
+				}
+				solid = (*worldMap_)->getVoxel(startX+x, startY+y, startZ+z) != nullptr;
+			}
+		}
+		if (solid) {
+			sides |= 1 << side;
+		}
+	}
+	return sides;
+}
+
+Coordinates WorldMapScene::getCameraCube() const
+{
+	Ogre::Vector3 position = camera_->getCameraPtr()->getDerivedPosition();
+	Coordinates cube = {static_cast<int>(std::floor(position.x/cubeSize_)),
+		static_cast<int>(std::floor(position.y/cubeSize_)),
+		static_cast<int>(std::floor(position.z/cubeSize_))};
+	return cube;
+}
+
+void WorldMapScene::updateVisibility()
+{
+	Ogre::Camera *cam = camera_->getCameraPtr();
+	Ogre::Vector3 cameraPos = cam->getDerivedPosition();
+	Ogre::Quaternion cameraOrientation = cam->getDerivedOrientation();
+	if (!visibilityDirty_ && cameraPos == lastCameraPosition_ && cameraOrientation == lastCameraOrientation_) {
+		return;
+	}
+	visibilityDirty_ = false;
+	lastCameraPosition_ = cameraPos;
+	lastCameraOrientation_ = cameraOrientation;
+
+	VisibilityStats stats = {0, 0, 0, 0, 0};
+	if (!regions_.empty()) {
+		countVisibleRegions(cam, stats);
+	} else {
+		int lodBuildsLeft = lodBuildsPerUpdate_;
+		const float chunkExtent = chunkSize_*cubeSize_;
+		//blocks of blockSize^3 chunks are tested first to skip whole parts of the grid
+		const int blockSize = 4;
+		const int nbBlocksX = (nbChunks_.x+blockSize-1) / blockSize;
+		const int nbBlocksY = (nbChunks_.y+blockSize-1) / blockSize;
+		std::unordered_map<int, bool> blocksVisible;
+		int withGeometry = 0;
+		for (auto &entry : chunks_) {
+			ChunkInfos &chunk = entry.second;
+			if (chunk.empty || !chunk.node) {
+				continue;
+			}
+			++withGeometry;
+			int x = chunk.start.x/chunkSize_;
+			int y = chunk.start.y/chunkSize_;
+			int z = chunk.start.z/chunkSize_;
+			bool visible = false;
+			if (!chunkCulling_) {
+				visible = true;
+			} else {
+				int bx = x/blockSize, by = y/blockSize, bz = z/blockSize;
+				auto block = blocksVisible.find(bx + by*nbBlocksX + bz*nbBlocksX*nbBlocksY);
+				if (block == blocksVisible.end()) {
+					int ex = std::min((bx+1)*blockSize, nbChunks_.x);
+					int ey = std::min((by+1)*blockSize, nbChunks_.y);
+					int ez = std::min((bz+1)*blockSize, nbChunks_.z);
+					Ogre::AxisAlignedBox blockBox(bx*blockSize*chunkExtent, by*blockSize*chunkExtent, bz*blockSize*chunkExtent,
+												ex*chunkExtent, ey*chunkExtent, ez*chunkExtent);
+					block = blocksVisible.emplace(bx + by*nbBlocksX + bz*nbBlocksX*nbBlocksY, cam->isVisible(blockBox)).first;
+				}
+				if (!block->second || !cam->isVisible(Ogre::AxisAlignedBox(
+						x*chunkExtent, y*chunkExtent, z*chunkExtent,
+						(x+1)*chunkExtent, (y+1)*chunkExtent, (z+1)*chunkExtent))) {
+					++stats.frustumCulled;
+				} else if (isChunkOccluded(x, y, z, cameraPos)) {
+					++stats.occluded;
+				} else {
+					visible = true;
+				}
+			}
+			if (visible) {
+				Ogre::Vector3 center((x+0.5f)*chunkExtent, (y+0.5f)*chunkExtent, (z+0.5f)*chunkExtent);
+				if (!setChunkLod(chunk, chooseLod(chunk.lod, center.distance(cameraPos)), lodBuildsLeft)) {
+					//too many levels of detail built during this update, finish later
+					visibilityDirty_ = true;
+				}
+				++stats.drawn;
+				stats.triangles += chunk.nbTriangles[chunk.lod];
+			}
+			setChunkVisible(chunk, visible);
+		}
+		//the chunks never drawn, or without faces, are empty
+		stats.empty = nbChunks_.x*nbChunks_.y*nbChunks_.z - withGeometry;
+	}
+	if (stats.drawn != visibilityStats_.drawn || stats.frustumCulled != visibilityStats_.frustumCulled
+		|| stats.occluded != visibilityStats_.occluded || stats.empty != visibilityStats_.empty
+		|| stats.triangles != visibilityStats_.triangles) {
+		visibilityStats_ = stats;
+		Metrics::setGauge("scene.chunksDrawn", stats.drawn);
+		Metrics::setGauge("scene.chunksCulled", stats.frustumCulled);
+		Metrics::setGauge("scene.chunksOccluded", stats.occluded);
+		Metrics::setGauge("scene.triangles", stats.triangles);
+		gui_->setStatsText((regions_.empty() ? "Chunks drawn: " : "Regions drawn: ") + Ogre::StringConverter::toString(stats.drawn)
+			+ "  culled: " + Ogre::StringConverter::toString(stats.frustumCulled)
+			+ "  occluded: " + Ogre::StringConverter::toString(stats.occluded)
+			+ "  empty: " + Ogre::StringConverter::toString(stats.empty)
+			+ "  triangles: " + Ogre::StringConverter::toString(stats.triangles));
+	}
+}
+
+bool WorldMapScene::isChunkOccluded(int x, int y, int z, const Ogre::Vector3 &cameraPos) const
+{
+	//conservative: the chunk is hidden only if each of its sides is covered by a full
+	//layer of cubes of the neighbour chunk, and the camera is outside of that shell
+	Ogre::AxisAlignedBox shell((x*chunkSize_-1)*cubeSize_, (y*chunkSize_-1)*cubeSize_, (z*chunkSize_-1)*cubeSize_,
+							((x+1)*chunkSize_+1)*cubeSize_, ((y+1)*chunkSize_+1)*cubeSize_, ((z+1)*chunkSize_+1)*cubeSize_);
+	if (shell.contains(cameraPos)) {
+		return false;
+	}
+	static const int neighbours[6][3] = {
+		{0,1,0}, {-1,0,0}, {0,-1,0}, {0,0,-1}, {1,0,0}, {0,0,1}
+	};
+	static const int oppositeSide[6] = {2, 4, 0, 5, 1, 3};
+	for (int side=0; side<6; ++side) {
+		int nx = x + neighbours[side][0];
+		int ny = y + neighbours[side][1];
+		int nz = z + neighbours[side][2];
+		if (nx < 0 || ny < 0 || nz < 0 || nx >= nbChunks_.x || ny >= nbChunks_.y || nz >= nbChunks_.z) {
+			return false;
+		}
+		auto neighbour = chunks_.find(nx + ny*nbChunks_.x + nz*nbChunks_.x*nbChunks_.y);
+		if (neighbour == chunks_.end() || !(neighbour->second.solidSides & (1 << oppositeSide[side]))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void WorldMapScene::setChunkVisible(ChunkInfos &chunk, bool visible)
+{
+	//hidden chunks are removed from the scene graph so Ogre doesn't even test them
+	if (chunk.visible == visible || !chunk.node) {
+		return;
+	}
+	if (visible) {
+		worldMapNode_->addChild(chunk.node);
+	} else {
+		worldMapNode_->removeChild(chunk.node);
+	}
+	chunk.visible = visible;
+}
+
+int WorldMapScene::chooseLod(int currentLod, float distance) const
+{
+	if (lodDistance_ <= 0) {
+		return 0;
+	}
+	//level n starts at lodDistance_*2^(n-1), the hysteresis avoids switching back and forth
+	int lod = currentLod;
+	while (lod < ChunkMesher::maxLod && distance > lodDistance_*(1 << lod)*(1+lodHysteresis_)) {
+		++lod;
+	}
+	while (lod > 0 && distance < lodDistance_*(1 << (lod-1))*(1-lodHysteresis_)) {
+		--lod;
+	}
+	return lod;
+}
+
+bool WorldMapScene::setChunkLod(ChunkInfos &chunk, int lod, int &buildsLeft)
+{
+	if (lod == chunk.lod) {
+		return true;
+	}
+	if (!(chunk.lodBuilt & (1 << lod))) {
+		if (buildsLeft <= 0) {
+			return false;
+		}
+		--buildsLeft;
+		buildChunkLod(chunk, lod);
+	}
+	if (Ogre::Entity *current = chunk.lods[chunk.lod]) {
+		chunk.node->detachObject(current);
+	}
+	if (Ogre::Entity *next = chunk.lods[lod]) {
+		chunk.node->attachObject(next);
+	}
+	chunk.lod = lod;
+	return true;
+}
+
+void WorldMapScene::buildChunkLod(ChunkInfos &chunk, int lod)
+{
+	const Coordinates &start = chunk.start;
+	ChunkHash hash = mesher_->hashChunk(**worldMap_, start.x, start.y, start.z, start.x+chunkSize_-1, start.y+chunkSize_-1, start.z+chunkSize_-1, lod);
+	chunk.meshHashes[lod] = acquireChunkMesh(hash, start.x, start.y, start.z, start.x+chunkSize_-1, start.y+chunkSize_-1, start.z+chunkSize_-1, lod);
+	chunk.lodBuilt |= 1 << lod;
+	const SharedChunkMesh &shared = sharedMeshes_[chunk.meshHashes[lod]];
+	chunk.nbTriangles[lod] = shared.nbTriangles;
+	chunk.lods[lod] = nullptr;
+	if (!shared.mesh.isNull()) {
+		chunk.lods[lod] = sceneMgr_->createEntity(shared.mesh->getName());
+	}
+}
+
+void WorldMapScene::clearChunkLods(ChunkInfos &chunk)
+{
+	//the full detail mesh belongs to the node, the other levels are destroyed here
+	for (int lod=1; lod<=ChunkMesher::maxLod; ++lod) {
+		if (Ogre::Entity *entity = chunk.lods[lod]) {
+			if (entity->isAttached()) {
+				chunk.node->detachObject(entity);
+			}
+			sceneMgr_->destroyEntity(entity);
+			chunk.lods[lod] = nullptr;
+		}
+		if (chunk.lodBuilt & (1 << lod)) {
+			releaseChunkMesh(chunk.meshHashes[lod]);
+		}
+		chunk.nbTriangles[lod] = 0;
+	}
+	if (chunk.lods[0] && !chunk.lods[0]->isAttached()) {
+		chunk.node->attachObject(chunk.lods[0]);
+	}
+	chunk.lod = 0;
+	chunk.lodBuilt &= 1;
+}
@@ -4,60 +4,151 @@
 #include "OGRE/Ogre.h"
 #include <memory>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
 #include "camera.h"
 #include "../eventManager.h"
 #include "../cubeMap.h"
 #include "../voxel.h"
+#include "../materialRegistry.h"
+#include "../brush.h"
 #include "worldMapGui.h"
+#include "chunkMesher.h"
+#include "chunkMeshCache.h"
+#include "chunkRegion.h"
+#include "chunkGrid.h"
+#include "bufferPool.h"
+#include "textureArray.h"
+#include "../options.h"
 
-struct Coordinates {
-	int x;
-	int y;
-	int z;
-};
-
+//only kept for the chunks with faces to draw or full sides hiding their neighbours
 struct ChunkInfos {
 	int id;
-	bool clean;
+	Coordinates start; //first cube of the chunk
+	Ogre::SceneNode *node;
+	bool empty; //nothing to draw
+	bool visible; //node attached to the scene graph
+	unsigned char solidSides; //one bit per side (mesher's face order) whose layer of cubes is full
+	//levels of detail
+	int lod; //currently attached to the node
+	Ogre::Entity *lods[ChunkMesher::maxLod+1]; //nullptr if nothing to draw at that level
+	int nbTriangles[ChunkMesher::maxLod+1];
+	unsigned char lodBuilt; //one bit per level already built
+	std::uint64_t meshHashes[ChunkMesher::maxLod+1]; //key of the shared mesh of each level built (its content hash unless taken)
+};
+
+//mesh of every chunk with the same content hash, each chunk has its own entity
+struct SharedChunkMesh {
+	Ogre::MeshPtr mesh; //null if nothing to draw
+	int nbTriangles;
+	int users; //levels of chunks using it
+	std::uint64_t check; //second hash of the content, another content with the same key doesn't share the mesh
+};
+
+struct VisibilityStats {
+	int drawn;
+	int frustumCulled;
+	int occluded;
+	int empty;
+	int triangles;
 };
 
 class WorldMapScene: public Subscribable
 {
 	public:
-		WorldMapScene(Ogre::Root *ogre, Ogre::RenderWindow *window, const std::unique_ptr<CubeMap<Voxel>> *worldMap);
+		WorldMapScene(const Options *config, Ogre::Root *ogre, Ogre::RenderWindow *window, const std::unique_ptr<CubeMap<Voxel>> *worldMap, const MaterialRegistry *materials);
 		~WorldMapScene();
 		void update(unsigned long delta);
 		
 		void drawMap();
+		void resizeMap(int offsetX, int offsetY, int offsetZ);
+		const VisibilityStats& getVisibilityStats() const { return visibilityStats_; }
+		Coordinates getCameraCube() const; //cube under the camera, may be out of the map
 	private:
 		void createCube(int x, int y, int z, std::string id);
 		void createCube2(int x, int y, int z, std::string id);
-		void drawChunk(int startX, int startY, int startZ, int endX, int endY, int endZ);
+		Ogre::SceneNode* drawChunk(Ogre::SceneNode *chunkNode, int startX, int startY, int startZ, int endX, int endY, int endZ, std::uint64_t meshKey);
 		void drawChunk(int id);
-		void createSelectionMark(int radius);
+		void initChunk(ChunkInfos &chunk, int id, int x, int y, int z);
+		void destroyChunk(ChunkInfos &chunk);
+		Ogre::MeshPtr createChunkMesh(const std::string &name, const ChunkMesh &chunkMesh);
+		std::uint64_t acquireChunkMesh(const ChunkHash &hash, int startX, int startY, int startZ, int endX, int endY, int endZ, int lod);
+		void buildChunkMesh(const ChunkHash &hash, int startX, int startY, int startZ, int endX, int endY, int endZ, int lod);
+		void createRegions();
+		void drawChunkInRegion(int x, int y, int z);
+		void markFilledChunks();
+		void countVisibleRegions(Ogre::Camera *cam, VisibilityStats &stats) const;
+		void releaseChunkMesh(std::uint64_t hash);
+		void recycleMeshBuffers(const Ogre::MeshPtr &mesh);
+		void removeUnusedChunkMeshes();
+		bool initPackedMaterial();
+		bool createMatterTextures();
+		void createSelectionMark();
+		void drawSelectionMark();
 		
 		bool initGui(Ogre::RenderWindow *window);
 		void checkSelection(int x, int y);
+		void sendPaintEvent();
 		void updateSelection();
 		Coordinates entityNameToCoordinates(std::string entityName);
 		void destroyAllAttachedMovableObjects(Ogre::SceneNode *node);
 		int calculateChunkId(int x, int y, int z);
+		unsigned char calculateSolidSides(int startX, int startY, int startZ) const;
+		void updateVisibility();
+		bool isChunkOccluded(int x, int y, int z, const Ogre::Vector3 &cameraPos) const;
+		void setChunkVisible(ChunkInfos &chunk, bool visible);
+		int chooseLod(int currentLod, float distance) const;
+		bool setChunkLod(ChunkInfos &chunk, int lod, int &buildsLeft);
+		void buildChunkLod(ChunkInfos &chunk, int lod);
+		void clearChunkLods(ChunkInfos &chunk);
 		
 		
 		Ogre::Root *ogre_;
 		Ogre::SceneManager *sceneMgr_;
 		const std::unique_ptr<CubeMap<Voxel>> *worldMap_;
+		const MaterialRegistry *materials_;
 		Ogre::SceneNode *worldMapNode_;
 		std::unique_ptr<Camera> camera_;
 		float cubeSize_;
 		int chunkSize_;
-		std::vector<ChunkInfos> chunkList;
-		std::map<std::string, int> textureAtlasInfos_;		
+		std::unordered_map<int, ChunkInfos> chunks_; //by chunk id, created when drawn (a paged map only has its resident ones)
+		std::unordered_set<int> dirtyChunks_; //ids drawn again by the next update
+		Coordinates nbChunks_; //size of the chunk grid
+		Coordinates mapSize_; //of the map drawn, in cubes
+		std::unique_ptr<ChunkMesher> mesher_;
+		ChunkMesh chunkMesh_; //reused by each drawChunk
+		MeshStats meshStats_;
+		HardwareBufferPool bufferPool_; //declared before regions_, destroyed after them: their destructors give their buffers back to it
+		std::unordered_map<std::uint64_t, SharedChunkMesh> sharedMeshes_; //by key of the content hash
+		std::unique_ptr<ChunkMeshCache> meshCache_; //nullptr if disabled
+		//regions of regionSize_^2 chunks (x and z) drawn as one mesh, none if regionSize_ is 1
+		int regionSize_;
+		Coordinates nbRegions_;
+		std::vector<std::unique_ptr<ChunkRegion>> regions_;
+		//culling
+		bool chunkCulling_;
+		bool visibilityDirty_;
+		Ogre::Vector3 lastCameraPosition_;
+		Ogre::Quaternion lastCameraOrientation_;
+		VisibilityStats visibilityStats_;
+		//levels of detail
+		float lodDistance_; //distance of the first switch, doubled for each level (0 = no lod)
+		float lodHysteresis_;
+		int lodBuildsPerUpdate_;
 		//gui
 		std::unique_ptr<WorldMapGui> gui_;
 		bool mouseButtonPressed;
 		Coordinates selectedCube_;
+		int selectedFace_; //face of selectedCube_ under the mouse (ChunkMesher order)
+		Brush brush_; //shape of the marker
+		std::string tool_; //brush, flood or box
+		Coordinates boxAnchor_; //first corner of the box being drawn, x=-1 if none
 		Ogre::SceneNode *selectionMarkNode_;
+		Ogre::ManualObject *selectionMark_; //one line list for the whole brush footprint
+		std::vector<Coordinates> markCells_; //footprint, relative to the selected cube (y unused)
+		std::vector<char> markGrid_; //occupancy of the footprint's bounding box, reused
+		static const int maxMarkCells_ = 1024; //footprint the buffers are first sized for
 };
 
 #endif /* WORLDMAPSCENE_H */ 
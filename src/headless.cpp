@@ -0,0 +1,223 @@
+////////////////////////////////////////
+// Pigell without window nor input:
+// runs WorldMapState from the command
+// line (conversion, generation, checks)
+////////////////////////////////////////
+//Commands are run in the given order, for example:
+//pigellHeadless --generate 4096 4096 42 --mesh --save big.lua --metrics big.txt
+
+#include <glog/logging.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include "options.h"
+#include "eventManager.h"
+#include "worldMapState.h"
+#include "metrics.h"
+#include "matterVoxel.h"
+#include "graphics/chunkMesher.h"
+
+namespace {
+
+void printUsage(const char *program)
+{
+	std::cout << "Usage: " << program << " [--options file.ini] commands...\n"
+		<< "  --load FILE              run a map script, load a map definition or a paged map (.pmap)\n"
+		<< "  --generate X Z SEED [Y]  generate a new map\n"
+		<< "  --resize X Y Z [DX DY DZ] resize the map, the old cubes moved by DX DY DZ\n"
+		<< "  --save FILE              save the map to a Lua file, or a paged map (.pmap)\n"
+		<< "  --mesh                   build the mesh of every chunk and print statistics\n"
+		<< "  --validate               count the cubes of each matter, fails if some are empty\n"
+		<< "  --metrics FILE           append the metrics to a file\n";
+}
+
+void processEvents()
+{
+	EventMgrFactory::getCurrentEvtMgr()->processEvents();
+}
+
+bool needMap(const WorldMapState &state, const std::string &command)
+{
+	if (!state.getWorldMap()) {
+		LOG(ERROR) << command << ": there is no world map";
+		return false;
+	}
+	return true;
+}
+
+//same chunks as WorldMapScene
+bool meshMap(const Options &config, const WorldMapState &state)
+{
+	const int chunkSize = 8;
+	const CubeMap<Voxel> &map = *state.getWorldMap();
+	VertexFormat format = VertexFormat::Float;
+	ChunkMesher::stringToFormat(config.getValue<std::string>("chunkVertexFormat"), format);
+	ChunkMesher mesher(50.0f, state.getMaterials()->getNbAtlasRows(), format);
+	mesher.setDedupVertices(config.getValue<bool>("chunkDedupVertices"));
+	mesher.setShortIndices(config.getValue<bool>("chunkShortIndices"));
+	ChunkMesh mesh;
+	MeshStats stats;
+	//chunks with the same content share their mesh, only the first one is built
+	std::set<std::pair<std::uint64_t, std::uint64_t>> built;
+	int nbChunks = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int z=0; z<map.getSizeZ(); z+=chunkSize) {
+		for (int y=0; y<map.getSizeY(); y+=chunkSize) {
+			for (int x=0; x<map.getSizeX(); x+=chunkSize) {
+				++nbChunks;
+				ChunkHash hash = mesher.hashChunk(map, x, y, z, x+chunkSize-1, y+chunkSize-1, z+chunkSize-1);
+				if (!built.insert(std::make_pair(hash.key, hash.check)).second) {
+					Metrics::increment("mesh.chunksShared");
+					continue;
+				}
+				mesher.buildChunk(map, x, y, z, x+chunkSize-1, y+chunkSize-1, z+chunkSize-1, mesh);
+				stats.add(mesh);
+				Metrics::observe("mesh.vertices", mesh.nbVertices);
+			}
+		}
+	}
+	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	Metrics::increment("mesh.chunksBuilt", stats.nbChunks);
+	Metrics::setGauge("mesh.distinctMeshes", built.size());
+	Metrics::setGauge("mesh.bytes", stats.vertexBytes + stats.indexBytes);
+	std::cout << "Meshed " << nbChunks << " chunks (" << built.size() << " distinct meshes) in " << duration.count() << "ms: "
+		<< stats.nbVertices << " vertices, " << stats.nbIndices << " indices, "
+		<< stats.vertexBytes + stats.indexBytes << " bytes\n";
+	return true;
+}
+
+bool validateMap(const WorldMapState &state)
+{
+	const CubeMap<Voxel> &map = *state.getWorldMap();
+	std::vector<size_t> counts(map.getPaletteSize(), 0);
+	for (int y=0; y<map.getSizeY(); ++y) {
+		for (int z=0; z<map.getSizeZ(); ++z) {
+			for (int x=0; x<map.getSizeX(); ++x) {
+				++counts[map.getIndex(x, y, z)];
+			}
+		}
+	}
+	std::cout << "Map of " << map.getSizeX() << "*" << map.getSizeY() << "*" << map.getSizeZ() << ":\n";
+	for (size_t index=1; index<counts.size(); ++index) {
+		Voxel *vox = map.getPaletteVoxel(static_cast<CubeMap<Voxel>::PaletteIndex>(index));
+		if (counts[index] > 0 && vox) {
+			std::string name = (vox->getId() == "matter") ? static_cast<MatterVoxel*>(vox)->getType() : vox->getId();
+			std::cout << "  " << name << ": " << counts[index] << "\n";
+		}
+	}
+	std::cout << "  empty: " << counts[CubeMap<Voxel>::emptyIndex] << "\n";
+	return counts[CubeMap<Voxel>::emptyIndex] == 0;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	FLAGS_logtostderr = true;
+	google::InitGoogleLogging(argv[0]);
+	std::vector<std::string> args(argv+1, argv+argc);
+	if (args.empty() || args[0] == "--help") {
+		printUsage(argv[0]);
+		return args.empty() ? 1 : 0;
+	}
+
+	//the options used without graphics, see Game::loadOptions
+	std::map<std::string, std::string> defaults;
+	defaults["materialsFile"] = "../media/materials.lua";
+	defaults["chunkVertexFormat"] = "float";
+	defaults["chunkDedupVertices"] = "1";
+	defaults["chunkShortIndices"] = "1";
+	defaults["generatorThreads"] = "0";
+	defaults["coldChunkDelay"] = "0";
+	defaults["pagedMapBudget"] = "256";
+	defaults["pagedMapRadius"] = "512";
+	defaults["metricsFile"] = "metrics.txt";
+	defaults["metricsInterval"] = "0";
+	Options config(defaults);
+	size_t next = 0;
+	if (args.size() >= 2 && args[0] == "--options") {
+		config.setConfigFile(args[1]);
+		next = 2;
+	}
+
+	EventMgrFactory::createEvtMgr("main");
+	WorldMapState state(&config);
+	//commands and the number of values following them
+	static const std::map<std::string, size_t> commands = {
+		{"--load", 1}, {"--generate", 3}, {"--resize", 3}, {"--save", 1},
+		{"--mesh", 0}, {"--validate", 0}, {"--metrics", 1}
+	};
+	bool success = true;
+	for (size_t i=next; i<args.size() && success; ++i) {
+		const std::string &command = args[i];
+		auto found = commands.find(command);
+		if (found == commands.end()) {
+			LOG(ERROR) << "Unknown command: " << command;
+			printUsage(argv[0]);
+			return 1;
+		}
+		if (i+found->second >= args.size()) {
+			LOG(ERROR) << command << " needs " << found->second << " values";
+			return 1;
+		}
+		if (command == "--load") {
+			Arguments event;
+			event["data"] = args[++i];
+			EventMgrFactory::getCurrentEvtMgr()->sendEvent("loadWorldMap", event);
+			processEvents();
+			success = needMap(state, command);
+		} else if (command == "--generate") {
+			Arguments event;
+			event["X"] = std::atoi(args[i+1].c_str());
+			event["Z"] = std::atoi(args[i+2].c_str());
+			event["seed"] = std::atoi(args[i+3].c_str());
+			i += 3;
+			//optional height
+			int y = 1;
+			if (i+1 < args.size() && args[i+1].compare(0, 2, "--") != 0) {
+				y = std::atoi(args[++i].c_str());
+			}
+			event["Y"] = y;
+			EventMgrFactory::getCurrentEvtMgr()->sendEvent("generateWorldMap", event);
+			processEvents();
+			success = needMap(state, command);
+		} else if (command == "--resize") {
+			Arguments event;
+			event["X"] = std::atoi(args[i+1].c_str());
+			event["Y"] = std::atoi(args[i+2].c_str());
+			event["Z"] = std::atoi(args[i+3].c_str());
+			i += 3;
+			//optional offsets
+			if (i+3 < args.size() && args[i+1].compare(0, 2, "--") != 0) {
+				event["offsetX"] = std::atoi(args[i+1].c_str());
+				event["offsetY"] = std::atoi(args[i+2].c_str());
+				event["offsetZ"] = std::atoi(args[i+3].c_str());
+				i += 3;
+			}
+			success = needMap(state, command);
+			if (success) {
+				EventMgrFactory::getCurrentEvtMgr()->sendEvent("resizeWorldMap", event);
+				processEvents();
+			}
+		} else if (command == "--save") {
+			Arguments event;
+			event["filename"] = args[++i];
+			success = needMap(state, command);
+			if (success) {
+				EventMgrFactory::getCurrentEvtMgr()->sendEvent("saveWorldMap", event);
+				processEvents();
+			}
+		} else if (command == "--mesh") {
+			success = needMap(state, command) && meshMap(config, state);
+		} else if (command == "--validate") {
+			success = needMap(state, command) && validateMap(state);
+		} else if (command == "--metrics") {
+			success = Metrics::writeToFile(args[++i]);
+		}
+	}
+	return success ? 0 : 1;
+}
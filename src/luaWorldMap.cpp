@@ -0,0 +1,486 @@
+#include "luaWorldMap.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include "matterVoxel.h"
+
+namespace {
+
+const char *worldMetatable = "Pigell.WorldMap";
+const char *arrayMetatable = "Pigell.MatterArray";
+
+//a MatterArray userdata is this header followed by capacity matter ids
+struct ArrayHeader {
+	size_t size;
+	size_t capacity;
+};
+
+MatterId* arrayValues(ArrayHeader *header)
+{
+	return reinterpret_cast<MatterId*>(header+1);
+}
+
+}
+
+const MatterId LuaWorldMap::empty;
+
+LuaWorldMap::LuaWorldMap(std::unique_ptr<CubeMap<Voxel>> *worldMap, const MaterialRegistry *materials):
+	worldMap_{worldMap},
+	materials_{materials},
+	matterIds_{},
+	paletteIndices_{},
+	changes_{},
+	resized_{false},
+	fixedSize_{false}
+{
+
+}
+
+LuaWorldMap::~LuaWorldMap()
+{
+
+}
+
+void LuaWorldMap::open(lua_State *L)
+{
+	//MatterArray type
+	luaL_newmetatable(L, arrayMetatable);
+	lua_newtable(L);
+	lua_pushcfunction(L, arrayFill);
+	lua_setfield(L, -2, "fill");
+	lua_pushcclosure(L, arrayIndex, 1); //methods as upvalue
+	lua_setfield(L, -2, "__index");
+	lua_pushcfunction(L, arrayNewIndex);
+	lua_setfield(L, -2, "__newindex");
+	lua_pushcfunction(L, arrayLength);
+	lua_setfield(L, -2, "__len");
+	lua_pop(L, 1);
+
+	//world object
+	static const luaL_Reg worldMethods[] = {
+		{"getSize", getSize},
+		{"resize", resize},
+		{"matterId", matterId},
+		{"matterName", matterName},
+		{"get", get},
+		{"set", set},
+		{"fill", fill},
+		{"newArray", newArray},
+		{"getRegion", getRegion},
+		{"setRegion", setRegion},
+		{"chunks", chunks},
+		{nullptr, nullptr}
+	};
+	luaL_newmetatable(L, worldMetatable);
+	lua_newtable(L);
+	luaL_register(L, nullptr, worldMethods);
+	lua_pushinteger(L, empty);
+	lua_setfield(L, -2, "empty");
+	lua_setfield(L, -2, "__index");
+	lua_pop(L, 1);
+	LuaWorldMap **world = static_cast<LuaWorldMap**>(lua_newuserdata(L, sizeof(LuaWorldMap*)));
+	*world = this;
+	luaL_getmetatable(L, worldMetatable);
+	lua_setmetatable(L, -2);
+	lua_setglobal(L, "world");
+}
+
+void LuaWorldMap::resetChanges()
+{
+	changes_ = ChangeSet();
+	resized_ = false;
+}
+
+CubeMap<Voxel>& LuaWorldMap::getMap(lua_State *L)
+{
+	if (!*worldMap_) {
+		luaL_error(L, "there is no world map, use world:resize first");
+	}
+	return **worldMap_;
+}
+
+//palette indices of the map <-> matter ids, rebuilt by each bulk operation
+void LuaWorldMap::updateLookups()
+{
+	CubeMap<Voxel> &map = **worldMap_;
+	matterIds_.assign(map.getPaletteSize(), empty);
+	for (size_t index=1; index<matterIds_.size(); ++index) {
+		Voxel *vox = map.getPaletteVoxel(static_cast<PaletteIndex>(index));
+		if (vox && vox->getId() == "matter") {
+			matterIds_[index] = static_cast<MatterVoxel*>(vox)->getMatterId();
+		} else if (vox) {
+			matterIds_[index] = MaterialRegistry::unknownId;
+		}
+	}
+	paletteIndices_.assign(materials_->size(), CubeMap<Voxel>::emptyIndex);
+}
+
+LuaWorldMap::PaletteIndex LuaWorldMap::toPaletteIndex(lua_State *L, MatterId id)
+{
+	if (id == empty) {
+		return CubeMap<Voxel>::emptyIndex;
+	}
+	if (id >= paletteIndices_.size()) {
+		id = MaterialRegistry::unknownId;
+	}
+	if (paletteIndices_[id] != CubeMap<Voxel>::emptyIndex) {
+		return paletteIndices_[id];
+	}
+	CubeMap<Voxel> &map = **worldMap_;
+	//a full palette is compacted to add the voxel, which changes the indices looked up before
+	bool full = map.getPaletteSize() > 0xFFFF;
+	PaletteIndex index = map.getPaletteIndex(materials_->getVoxel(id));
+	if (index == CubeMap<Voxel>::emptyIndex) {
+		luaL_error(L, "too many different voxels in the map, %s can't be added", materials_->getInfos(id).name.c_str());
+	}
+	if (full) {
+		updateLookups();
+	}
+	paletteIndices_[id] = index;
+	return index;
+}
+
+MatterId LuaWorldMap::checkMatter(lua_State *L, int arg)
+{
+	if (lua_type(L, arg) == LUA_TNUMBER) {
+		lua_Integer id = lua_tointeger(L, arg);
+		luaL_argcheck(L, id == empty || (id >= 0 && static_cast<size_t>(id) < materials_->size()), arg, "unknown matter id");
+		return static_cast<MatterId>(id);
+	}
+	const char *name = luaL_checkstring(L, arg);
+	if (!materials_->hasMatter(name)) {
+		luaL_error(L, "unknown matter: %s", name);
+	}
+	return materials_->getId(name);
+}
+
+size_t LuaWorldMap::readRegion(int x0, int y0, int z0, int x1, int y1, int z1, MatterId *values)
+{
+	const CubeMap<Voxel> &map = **worldMap_;
+	updateLookups();
+	size_t n = 0;
+	for (int y=y0; y<=y1; ++y) {
+		for (int z=z0; z<=z1; ++z) {
+			for (int x=x0; x<=x1; ++x) {
+				values[n++] = toMatterId(map.getIndex(x, y, z));
+			}
+		}
+	}
+	return n;
+}
+
+size_t LuaWorldMap::writeRegion(lua_State *L, int x0, int y0, int z0, int x1, int y1, int z1, const MatterId *values)
+{
+	CubeMap<Voxel> &map = **worldMap_;
+	updateLookups();
+	//every matter is added to the palette before the first cube is written, so an error leaves the map as it was
+	size_t volume = static_cast<size_t>(x1-x0+1)*(y1-y0+1)*(z1-z0+1);
+	for (size_t n=0; n<volume; ++n) {
+		if (n == 0 || values[n] != values[n-1]) {
+			toPaletteIndex(L, values[n]);
+		}
+	}
+	size_t nbCubes = 0;
+	size_t n = 0;
+	for (int y=y0; y<=y1; ++y) {
+		for (int z=z0; z<=z1; ++z) {
+			//runs of the same matter along x are written at once
+			int runStart = x0;
+			for (int x=x0; x<=x1; ++x) {
+				if (x == x1 || values[n+1] != values[n]) {
+					nbCubes += map.fillBox(toPaletteIndex(L, values[n]), runStart, y, z, x, y, z);
+					runStart = x+1;
+				}
+				++n;
+			}
+		}
+	}
+	changes_.add(std::max(x0, 0), std::max(y0, 0), std::max(z0, 0),
+				std::min(x1, map.getSizeX()-1), std::min(y1, map.getSizeY()-1), std::min(z1, map.getSizeZ()-1), nbCubes);
+	return nbCubes;
+}
+
+///////////////////////////////////////
+//	Lua functions
+///////////////////////////////////////
+
+LuaWorldMap* LuaWorldMap::checkWorld(lua_State *L)
+{
+	return *static_cast<LuaWorldMap**>(luaL_checkudata(L, 1, worldMetatable));
+}
+
+MatterId* LuaWorldMap::checkArray(lua_State *L, int arg, size_t &size)
+{
+	ArrayHeader *header = static_cast<ArrayHeader*>(luaL_checkudata(L, arg, arrayMetatable));
+	size = header->size;
+	return arrayValues(header);
+}
+
+MatterId* LuaWorldMap::pushArray(lua_State *L, size_t size)
+{
+	ArrayHeader *header = static_cast<ArrayHeader*>(lua_newuserdata(L, sizeof(ArrayHeader) + size*sizeof(MatterId)));
+	header->size = size;
+	header->capacity = size;
+	luaL_getmetatable(L, arrayMetatable);
+	lua_setmetatable(L, -2);
+	MatterId *values = arrayValues(header);
+	std::fill(values, values+size, empty);
+	return values;
+}
+
+int LuaWorldMap::getSize(lua_State *L)
+{
+	LuaWorldMap *world = checkWorld(L);
+	const CubeMap<Voxel> *map = world->worldMap_->get();
+	lua_pushinteger(L, map ? map->getSizeX() : 0);
+	lua_pushinteger(L, map ? map->getSizeY() : 0);
+	lua_pushinteger(L, map ? map->getSizeZ() : 0);
+	return 3;
+}
+
+int LuaWorldMap::resize(lua_State *L)
+{
+	LuaWorldMap *world = checkWorld(L);
+	int x = luaL_checkint(L, 2);
+	int y = luaL_checkint(L, 3);
+	int z = luaL_checkint(L, 4);
+	int offsetX = luaL_optint(L, 5, 0);
+	int offsetY = luaL_optint(L, 6, 0);
+	int offsetZ = luaL_optint(L, 7, 0);
+	if (x <= 0 || y <= 0 || z <= 0) {
+		return luaL_error(L, "incorrect map size: %d*%d*%d", x, y, z);
+	}
+	if (world->fixedSize_) {
+		return luaL_error(L, "the size of this map can't change (paged map)");
+	}
+	if (*world->worldMap_) {
+		(*world->worldMap_)->resize(x, y, z, offsetX, offsetY, offsetZ, CubeMap<Voxel>::emptyIndex);
+	} else {
+		*world->worldMap_ = std::unique_ptr<CubeMap<Voxel>>(new CubeMap<Voxel>(x, y, z));
+	}
+	world->resized_ = true;
+	return 0;
+}
+
+int LuaWorldMap::matterId(lua_State *L)
+{
+	LuaWorldMap *world = checkWorld(L);
+	const char *name = luaL_checkstring(L, 2);
+	if (!world->materials_->hasMatter(name)) {
+		lua_pushnil(L);
+	} else {
+		lua_pushinteger(L, world->materials_->getId(name));
+	}
+	return 1;
+}
+
+int LuaWorldMap::matterName(lua_State *L)
+{
+	LuaWorldMap *world = checkWorld(L);
+	MatterId id = world->checkMatter(L, 2);
+	if (id == empty) {
+		lua_pushnil(L);
+	} else {
+		lua_pushstring(L, world->materials_->getInfos(id).name.c_str());
+	}
+	return 1;
+}
+
+int LuaWorldMap::get(lua_State *L)
+{
+	LuaWorldMap *world = checkWorld(L);
+	CubeMap<Voxel> &map = world->getMap(L);
+	Voxel *vox = map.getVoxel(luaL_checkint(L, 2), luaL_checkint(L, 3), luaL_checkint(L, 4));
+	if (!vox) {
+		lua_pushinteger(L, empty);
+	} else if (vox->getId() == "matter") {
+		lua_pushinteger(L, static_cast<MatterVoxel*>(vox)->getMatterId());
+	} else {
+		lua_pushinteger(L, MaterialRegistry::unknownId);
+	}
+	return 1;
+}
+
+int LuaWorldMap::set(lua_State *L)
+{
+	LuaWorldMap *world = checkWorld(L);
+	CubeMap<Voxel> &map = world->getMap(L);
+	int x = luaL_checkint(L, 2);
+	int y = luaL_checkint(L, 3);
+	int z = luaL_checkint(L, 4);
+	MatterId id = world->checkMatter(L, 5);
+	if (id != empty && map.getPaletteIndex(world->materials_->getVoxel(id)) == CubeMap<Voxel>::emptyIndex) {
+		return luaL_error(L, "too many different voxels in the map, %s can't be added", world->materials_->getInfos(id).name.c_str());
+	}
+	bool done = map.setVoxel(id == empty ? std::shared_ptr<Voxel>() : world->materials_->getVoxel(id), x, y, z);
+	if (done) {
+		world->changes_.add(x, y, z, x, y, z, 1);
+	}
+	lua_pushboolean(L, done);
+	return 1;
+}
+
+int LuaWorldMap::fill(lua_State *L)
+{
+	LuaWorldMap *world = checkWorld(L);
+	CubeMap<Voxel> &map = world->getMap(L);
+	MatterId id = world->checkMatter(L, 8);
+	if (id != empty && map.getPaletteIndex(world->materials_->getVoxel(id)) == CubeMap<Voxel>::emptyIndex) {
+		return luaL_error(L, "too many different voxels in the map, %s can't be added", world->materials_->getInfos(id).name.c_str());
+	}
+	ChangeSet changes = Brush::fillBox(map, id == empty ? std::shared_ptr<Voxel>() : world->materials_->getVoxel(id),
+		luaL_checkint(L, 2), luaL_checkint(L, 3), luaL_checkint(L, 4),
+		luaL_checkint(L, 5), luaL_checkint(L, 6), luaL_checkint(L, 7));
+	world->changes_.add(changes.minX, changes.minY, changes.minZ, changes.maxX, changes.maxY, changes.maxZ, changes.nbCubes);
+	lua_pushinteger(L, changes.nbCubes);
+	return 1;
+}
+
+int LuaWorldMap::newArray(lua_State *L)
+{
+	checkWorld(L);
+	int size = luaL_checkint(L, 2);
+	luaL_argcheck(L, size >= 0, 2, "negative size");
+	pushArray(L, size);
+	return 1;
+}
+
+int LuaWorldMap::getRegion(lua_State *L)
+{
+	LuaWorldMap *world = checkWorld(L);
+	world->getMap(L);
+	int x0 = luaL_checkint(L, 2);
+	int y0 = luaL_checkint(L, 3);
+	int z0 = luaL_checkint(L, 4);
+	int x1 = luaL_checkint(L, 5);
+	int y1 = luaL_checkint(L, 6);
+	int z1 = luaL_checkint(L, 7);
+	luaL_argcheck(L, x0 <= x1 && y0 <= y1 && z0 <= z1, 2, "empty region");
+	size_t volume = static_cast<size_t>(x1-x0+1)*(y1-y0+1)*(z1-z0+1);
+	//the array given by the script is reused when it's big enough
+	MatterId *values = nullptr;
+	if (!lua_isnoneornil(L, 8)) {
+		ArrayHeader *header = static_cast<ArrayHeader*>(luaL_checkudata(L, 8, arrayMetatable));
+		if (header->capacity >= volume) {
+			header->size = volume;
+			values = arrayValues(header);
+			lua_pushvalue(L, 8);
+		}
+	}
+	if (!values) {
+		values = pushArray(L, volume);
+	}
+	world->readRegion(x0, y0, z0, x1, y1, z1, values);
+	return 1;
+}
+
+int LuaWorldMap::setRegion(lua_State *L)
+{
+	LuaWorldMap *world = checkWorld(L);
+	world->getMap(L);
+	int x0 = luaL_checkint(L, 2);
+	int y0 = luaL_checkint(L, 3);
+	int z0 = luaL_checkint(L, 4);
+	int x1 = luaL_checkint(L, 5);
+	int y1 = luaL_checkint(L, 6);
+	int z1 = luaL_checkint(L, 7);
+	size_t size;
+	const MatterId *values = checkArray(L, 8, size);
+	luaL_argcheck(L, x0 <= x1 && y0 <= y1 && z0 <= z1, 2, "empty region");
+	luaL_argcheck(L, size >= static_cast<size_t>(x1-x0+1)*(y1-y0+1)*(z1-z0+1), 8, "array smaller than the region");
+	lua_pushinteger(L, world->writeRegion(L, x0, y0, z0, x1, y1, z1, values));
+	return 1;
+}
+
+int LuaWorldMap::chunks(lua_State *L)
+{
+	checkWorld(L);
+	//iterator state: the world, the next chunk and the array reused for each chunk
+	lua_pushvalue(L, 1);
+	lua_pushinteger(L, 0);
+	const int chunkSize = CubeMap<Voxel>::chunkSize;
+	pushArray(L, chunkSize*chunkSize*chunkSize);
+	lua_pushcclosure(L, nextChunk, 3);
+	return 1;
+}
+
+int LuaWorldMap::nextChunk(lua_State *L)
+{
+	LuaWorldMap *world = *static_cast<LuaWorldMap**>(lua_touserdata(L, lua_upvalueindex(1)));
+	int chunk = static_cast<int>(lua_tointeger(L, lua_upvalueindex(2)));
+	const CubeMap<Voxel> &map = world->getMap(L);
+	const int chunkSize = CubeMap<Voxel>::chunkSize;
+	int nbX = (map.getSizeX()+chunkSize-1) / chunkSize;
+	int nbY = (map.getSizeY()+chunkSize-1) / chunkSize;
+	int nbZ = (map.getSizeZ()+chunkSize-1) / chunkSize;
+	if (chunk >= nbX*nbY*nbZ) {
+		return 0;
+	}
+	lua_pushinteger(L, chunk+1);
+	lua_replace(L, lua_upvalueindex(2));
+	int x0 = (chunk % nbX)*chunkSize;
+	int y0 = ((chunk / nbX) % nbY)*chunkSize;
+	int z0 = (chunk / (nbX*nbY))*chunkSize;
+	int x1 = std::min(x0+chunkSize, map.getSizeX()) - 1;
+	int y1 = std::min(y0+chunkSize, map.getSizeY()) - 1;
+	int z1 = std::min(z0+chunkSize, map.getSizeZ()) - 1;
+	ArrayHeader *header = static_cast<ArrayHeader*>(lua_touserdata(L, lua_upvalueindex(3)));
+	header->size = static_cast<size_t>(x1-x0+1)*(y1-y0+1)*(z1-z0+1);
+	world->readRegion(x0, y0, z0, x1, y1, z1, arrayValues(header));
+	lua_pushvalue(L, lua_upvalueindex(3));
+	lua_pushinteger(L, x0);
+	lua_pushinteger(L, y0);
+	lua_pushinteger(L, z0);
+	lua_pushinteger(L, x1);
+	lua_pushinteger(L, y1);
+	lua_pushinteger(L, z1);
+	return 7;
+}
+
+int LuaWorldMap::arrayIndex(lua_State *L)
+{
+	size_t size;
+	const MatterId *values = checkArray(L, 1, size);
+	if (lua_type(L, 2) == LUA_TNUMBER) {
+		lua_Integer i = lua_tointeger(L, 2);
+		if (i < 1 || static_cast<size_t>(i) > size) {
+			lua_pushnil(L);
+		} else {
+			lua_pushinteger(L, values[i-1]);
+		}
+		return 1;
+	}
+	//methods
+	lua_pushvalue(L, 2);
+	lua_rawget(L, lua_upvalueindex(1));
+	return 1;
+}
+
+int LuaWorldMap::arrayNewIndex(lua_State *L)
+{
+	size_t size;
+	MatterId *values = checkArray(L, 1, size);
+	lua_Integer i = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, i >= 1 && static_cast<size_t>(i) <= size, 2, "index out of the array");
+	lua_Integer id = luaL_checkinteger(L, 3);
+	luaL_argcheck(L, id >= 0 && id <= empty, 3, "not a matter id");
+	values[i-1] = static_cast<MatterId>(id);
+	return 0;
+}
+
+int LuaWorldMap::arrayLength(lua_State *L)
+{
+	size_t size;
+	checkArray(L, 1, size);
+	lua_pushinteger(L, size);
+	return 1;
+}
+
+int LuaWorldMap::arrayFill(lua_State *L)
+{
+	size_t size;
+	MatterId *values = checkArray(L, 1, size);
+	lua_Integer id = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, id >= 0 && id <= empty, 2, "not a matter id");
+	std::fill(values, values+size, static_cast<MatterId>(id));
+	return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef LUAWORLDMAP_H
+#define LUAWORLDMAP_H
+
+////////////////////////////////////////
+// Access to the world map from Lua
+// scripts, by whole regions at once
+////////////////////////////////////////
+//The binding adds a global "world" to the Lua state:
+//
+//world:getSize()                                  --> x, y, z
+//world:resize(x, y, z [, dx, dy, dz])            creates the map if there is none,
+//                                                 the old cubes are moved by dx, dy, dz,
+//                                                 an error if the map has a fixed size (paged)
+//world:matterId(name) / world:matterName(id)
+//world:get(x, y, z) / world:set(x, y, z, matter)  single cubes
+//world:fill(x0, y0, z0, x1, y1, z1, matter)       --> number of cubes set
+//world:newArray(size)                             --> MatterArray
+//world:getRegion(x0, y0, z0, x1, y1, z1 [, array]) --> MatterArray
+//world:setRegion(x0, y0, z0, x1, y1, z1, array)   --> number of cubes set
+//for array, x0, y0, z0, x1, y1, z1 in world:chunks() do ... end
+//
+//A MatterArray is a block of 16 bits matter ids living in C++ (no Lua table
+//per cube): array[i], #array, array:fill(id). world.empty is the id of an empty
+//cube. Regions are ordered x first, then z, then y:
+//i = 1 + dx + dz*sizeX + dy*sizeX*sizeZ. Bounds are included.
+//Matters can be given by name or by id.
+
+#include <memory>
+#include <vector>
+#include "cubeMap.h"
+#include "voxel.h"
+#include "materialRegistry.h"
+#include "brush.h"
+extern "C" {
+	#include "lua.h"
+	#include "lauxlib.h"
+}
+
+class LuaWorldMap
+{
+	public:
+		LuaWorldMap(std::unique_ptr<CubeMap<Voxel>> *worldMap, const MaterialRegistry *materials);
+		~LuaWorldMap();
+
+		void open(lua_State *L);
+		//what the scripts did since the last reset
+		const ChangeSet& getChanges() const { return changes_; }
+		bool wasResized() const { return resized_; }
+		void setFixedSize(bool fixed) { fixedSize_ = fixed; }
+		void resetChanges();
+
+		static const MatterId empty = 0xFFFF;
+
+	private:
+		typedef CubeMap<Voxel>::PaletteIndex PaletteIndex;
+
+		CubeMap<Voxel>& getMap(lua_State *L);
+		void updateLookups();
+		MatterId toMatterId(PaletteIndex index) const { return matterIds_[index]; }
+		PaletteIndex toPaletteIndex(lua_State *L, MatterId id); //Lua error if the palette is full
+		MatterId checkMatter(lua_State *L, int arg);
+		size_t readRegion(int x0, int y0, int z0, int x1, int y1, int z1, MatterId *values);
+		size_t writeRegion(lua_State *L, int x0, int y0, int z0, int x1, int y1, int z1, const MatterId *values);
+
+		static LuaWorldMap* checkWorld(lua_State *L);
+		static MatterId* checkArray(lua_State *L, int arg, size_t &size);
+		static MatterId* pushArray(lua_State *L, size_t size);
+		static int getSize(lua_State *L);
+		static int resize(lua_State *L);
+		static int matterId(lua_State *L);
+		static int matterName(lua_State *L);
+		static int get(lua_State *L);
+		static int set(lua_State *L);
+		static int fill(lua_State *L);
+		static int newArray(lua_State *L);
+		static int getRegion(lua_State *L);
+		static int setRegion(lua_State *L);
+		static int chunks(lua_State *L);
+		static int nextChunk(lua_State *L);
+		static int arrayIndex(lua_State *L);
+		static int arrayNewIndex(lua_State *L);
+		static int arrayLength(lua_State *L);
+		static int arrayFill(lua_State *L);
+
+		std::unique_ptr<CubeMap<Voxel>> *worldMap_;
+		const MaterialRegistry *materials_;
+		std::vector<MatterId> matterIds_; //by palette index of the map
+		std::vector<PaletteIndex> paletteIndices_; //by matter id, 0 until needed
+		ChangeSet changes_;
+		bool resized_;
+		bool fixedSize_; //world:resize refused
+};
+
+#endif /* LUAWORLDMAP_H */
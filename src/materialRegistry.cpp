@@ -0,0 +1,159 @@
+#include "materialRegistry.h"
+#include "voxel.h"
+#include <glog/logging.h>
+extern "C" {
+	#include "lua.h"
+	#include "lualib.h"
+	#include "lauxlib.h"
+}
+
+MaterialRegistry::MaterialRegistry():
+	matters_{},
+	ids_{},
+	voxels_{},
+	nbAtlasRows_{1}
+{
+	//the unknown matter always exists, even without data file
+	MatterInfos unknown;
+	unknown.name = "unknown";
+	unknown.atlasRow = 1;
+	unknown.material = "default";
+	unknown.editable = false;
+	addMatter(unknown);
+	voxels_.push_back(Voxel::createMatterVoxel(&matters_[unknownId]));
+}
+
+MaterialRegistry::~MaterialRegistry()
+{
+
+}
+
+bool MaterialRegistry::loadFromFile(const std::string filename)
+{
+	if (matters_.size() > 1) {
+		//voxels already created keep a pointer on their MatterInfos
+		LOG(WARNING) << "Material registry already loaded, ignoring: " << filename;
+		return false;
+	}
+	LOG(INFO) << "Loading matter types from file: " << filename;
+	lua_State *L = lua_open();
+	if (luaL_loadfile(L, filename.c_str()) || lua_pcall(L, 0, 0, 0)) {
+		LOG(ERROR) << lua_tostring(L, -1);
+		lua_close(L);
+		return false;
+	}
+	lua_getglobal(L, "atlasRows");
+	if (lua_isnumber(L, -1)) {
+		nbAtlasRows_ = (int)lua_tonumber(L, -1);
+	}
+	lua_pop(L, 1);
+	lua_getglobal(L, "materials");
+	if (!lua_istable(L, -1)) {
+		LOG(ERROR) << "No materials table defined in: " << filename;
+		lua_close(L);
+		return false;
+	}
+	//ipairs order gives the ids
+	for (int i=1; ; ++i) {
+		lua_rawgeti(L, -1, i);
+		if (!lua_istable(L, -1)) {
+			lua_pop(L, 1);
+			break;
+		}
+		MatterInfos infos;
+		lua_getfield(L, -1, "name");
+		infos.name = lua_isstring(L, -1) ? lua_tostring(L, -1) : "";
+		lua_pop(L, 1);
+		lua_getfield(L, -1, "atlasRow");
+		infos.atlasRow = lua_isnumber(L, -1) ? (int)lua_tonumber(L, -1) : 1;
+		lua_pop(L, 1);
+		lua_getfield(L, -1, "material");
+		infos.material = lua_isstring(L, -1) ? lua_tostring(L, -1) : infos.name;
+		lua_pop(L, 1);
+		lua_getfield(L, -1, "editable");
+		infos.editable = lua_isnil(L, -1) ? true : lua_toboolean(L, -1);
+		lua_pop(L, 1);
+		lua_pop(L, 1);
+		if (infos.name == "") {
+			LOG(WARNING) << "Matter number " << i << " has no name, ignoring it";
+			continue;
+		}
+		if (infos.name == matters_[unknownId].name) {
+			//allow the data file to redefine how unknown matter is drawn
+			infos.id = unknownId;
+			matters_[unknownId] = infos;
+			continue;
+		}
+		addMatter(infos);
+	}
+	lua_pop(L, 1);
+	lua_close(L);
+	//voxels are created once all MatterInfos have their final address
+	voxels_.clear();
+	for (MatterInfos &infos : matters_) {
+		voxels_.push_back(Voxel::createMatterVoxel(&infos));
+	}
+	LOG(INFO) << matters_.size() << " matter types loaded";
+	return true;
+}
+
+bool MaterialRegistry::hasMatter(const std::string &name) const
+{
+	return ids_.find(name) != ids_.end();
+}
+
+MatterId MaterialRegistry::getId(const std::string &name) const
+{
+	auto it = ids_.find(name);
+	if (it == ids_.end()) {
+		LOG(WARNING) << "Unknown matter type: " << name;
+		return unknownId;
+	}
+	return it->second;
+}
+
+const MatterInfos& MaterialRegistry::getInfos(MatterId id) const
+{
+	if (static_cast<size_t>(id) >= matters_.size()) {
+		LOG(WARNING) << "Matter id out of range: " << id;
+		return matters_[unknownId];
+	}
+	return matters_[id];
+}
+
+std::uint64_t MaterialRegistry::getSignature() const
+{
+	//FNV-1a, the same on every run
+	std::uint64_t signature = 14695981039346656037ull;
+	auto mix = [&signature](std::uint64_t value) { signature = (signature ^ value) * 1099511628211ull; };
+	mix(nbAtlasRows_);
+	for (const MatterInfos &infos : matters_) {
+		mix(infos.id);
+		mix(infos.atlasRow);
+		for (char c : infos.name) {
+			mix(static_cast<unsigned char>(c));
+		}
+	}
+	return signature;
+}
+
+std::shared_ptr<Voxel> MaterialRegistry::getVoxel(MatterId id) const
+{
+	if (static_cast<size_t>(id) >= voxels_.size()) {
+		LOG(WARNING) << "Matter id out of range: " << id;
+		return voxels_[unknownId];
+	}
+	return voxels_[id];
+}
+
+bool MaterialRegistry::addMatter(MatterInfos infos)
+{
+	if (hasMatter(infos.name)) {
+		LOG(WARNING) << "Matter type defined twice: " << infos.name;
+		return false;
+	}
+	infos.id = matters_.size();
+	ids_[infos.name] = infos.id;
+	matters_.push_back(infos);
+	return true;
+}
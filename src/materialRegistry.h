@@ -0,0 +1,64 @@
+#ifndef MATERIALREGISTRY_H
+#define MATERIALREGISTRY_H
+
+////////////////////////////////////////
+// List of all the matter types known
+// by the game, loaded once from a Lua
+// data file (see media/materials.lua)
+////////////////////////////////////////
+//use:
+//
+//MaterialRegistry materials;
+//materials.loadFromFile("../media/materials.lua");
+//MatterId id = materials.getId("ocean");
+//materials.getInfos(id).atlasRow;
+//materials.getVoxel(id); //shared voxel of that matter
+//
+//Ids are dense (0..size()-1) and follow the order of the data file,
+//id 0 is always the "unknown" matter.
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+class Voxel;
+
+typedef unsigned short MatterId;
+
+struct MatterInfos {
+	MatterId id;
+	std::string name;
+	int atlasRow; //row of the matter in the texture atlas (starting at 1)
+	std::string material; //name of the Ogre material used to draw a single cube
+	bool editable; //can be selected in the editor
+};
+
+class MaterialRegistry
+{
+	public:
+		MaterialRegistry();
+		~MaterialRegistry();
+
+		bool loadFromFile(const std::string filename);
+		bool hasMatter(const std::string &name) const;
+		MatterId getId(const std::string &name) const;
+		const MatterInfos& getInfos(MatterId id) const;
+		std::shared_ptr<Voxel> getVoxel(MatterId id) const;
+		int getNbAtlasRows() const { return nbAtlasRows_; }
+		size_t size() const { return matters_.size(); }
+		std::uint64_t getSignature() const; //changes with the ids, names or atlas rows
+
+		static const MatterId unknownId = 0;
+
+	private:
+		bool addMatter(MatterInfos infos);
+
+		std::vector<MatterInfos> matters_;
+		std::unordered_map<std::string, MatterId> ids_;
+		std::vector<std::shared_ptr<Voxel>> voxels_;
+		int nbAtlasRows_;
+};
+
+#endif /* MATERIALREGISTRY_H */
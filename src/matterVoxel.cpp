@@ -1,9 +1,9 @@
 #include "matterVoxel.h"
 
 
-MatterVoxel::MatterVoxel(std::string type):
+MatterVoxel::MatterVoxel(const MatterInfos *infos):
 	Voxel("matter"),
-	type_{type}
+	infos_{infos}
 {
 	
 }
@@ -15,10 +15,10 @@ MatterVoxel::~MatterVoxel()
 
 std::string MatterVoxel::getInfos()
 {
-	return getId() + ":" + type_;
+	return getId() + ":" + infos_->name;
 }
 
 std::string MatterVoxel::getType() const
 {
-	return type_;
+	return infos_->name;
 }
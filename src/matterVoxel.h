@@ -2,18 +2,22 @@
 #define MATTERVOXEL_H
 
 #include "voxel.h"
+#include "materialRegistry.h"
 #include <string>
 
+//MatterVoxels are shared: one instance per matter type, owned by the MaterialRegistry
 class MatterVoxel: public Voxel
 {
 	public:
-		MatterVoxel(std::string type);
+		MatterVoxel(const MatterInfos *infos);
 		virtual ~MatterVoxel();
 
 		virtual std::string getInfos();
 		std::string getType() const;
+		MatterId getMatterId() const { return infos_->id; }
+		const MatterInfos& getMatterInfos() const { return *infos_; }
 	private:
-		std::string type_;
+		const MatterInfos *infos_;
 };
 
 #endif /* MATTERVOXEL_H */ 
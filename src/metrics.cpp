@@ -0,0 +1,114 @@
+#include "metrics.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+
+std::map<std::string, unsigned long long> Metrics::counters_;
+std::map<std::string, double> Metrics::gauges_;
+std::map<std::string, Metrics::Histogram> Metrics::histograms_;
+
+///////////////////////////////////////
+//	Histogram
+///////////////////////////////////////
+
+Metrics::Histogram::Histogram():
+	count{0},
+	sum{0},
+	min{0},
+	max{0},
+	buckets{}
+{
+
+}
+
+void Metrics::Histogram::add(double value)
+{
+	min = (count == 0) ? value : std::min(min, value);
+	max = (count == 0) ? value : std::max(max, value);
+	++count;
+	sum += value;
+	size_t bucket = 0;
+	if (value > 1) {
+		bucket = static_cast<size_t>(std::ceil(std::log2(value)));
+	}
+	if (bucket >= buckets.size()) {
+		buckets.resize(bucket+1, 0);
+	}
+	++buckets[bucket];
+}
+
+///////////////////////////////////////
+//	Metrics
+///////////////////////////////////////
+
+void Metrics::increment(const std::string &name, unsigned long long n)
+{
+	counters_[name] += n;
+}
+
+void Metrics::setGauge(const std::string &name, double value)
+{
+	gauges_[name] = value;
+}
+
+void Metrics::observe(const std::string &name, double value)
+{
+	histograms_[name].add(value);
+}
+
+unsigned long long Metrics::getCounter(const std::string &name)
+{
+	auto found = counters_.find(name);
+	return (found != counters_.end()) ? found->second : 0;
+}
+
+double Metrics::getGauge(const std::string &name)
+{
+	auto found = gauges_.find(name);
+	return (found != gauges_.end()) ? found->second : 0;
+}
+
+std::string Metrics::getReport()
+{
+	std::ostringstream report;
+	for (auto &counter : counters_) {
+		report << "counter " << counter.first << " " << counter.second << "\n";
+	}
+	for (auto &gauge : gauges_) {
+		report << "gauge " << gauge.first << " " << gauge.second << "\n";
+	}
+	for (auto &histogram : histograms_) {
+		const Histogram &h = histogram.second;
+		report << "histogram " << histogram.first << " count=" << h.count << " sum=" << h.sum
+			<< " min=" << h.min << " max=" << h.max << " mean=" << (h.count ? h.sum/h.count : 0);
+		for (size_t k=0; k<h.buckets.size(); ++k) {
+			if (h.buckets[k] > 0) {
+				report << " <=" << (1ull << k) << ":" << h.buckets[k];
+			}
+		}
+		report << "\n";
+	}
+	return report.str();
+}
+
+bool Metrics::writeToFile(const std::string &filename)
+{
+	std::ofstream file(filename.c_str(), std::ios::app);
+	if (!file.is_open()) {
+		LOG(WARNING) << "Unable to open file: " << filename;
+		return false;
+	}
+	//each dump is appended, to follow the values during a long session
+	file << "# metrics at " << std::time(nullptr) << "\n" << getReport() << "\n";
+	return true;
+}
+
+void Metrics::reset()
+{
+	counters_.clear();
+	gauges_.clear();
+	histograms_.clear();
+}
@@ -0,0 +1,52 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+////////////////////////////////////////
+// Named counters, gauges and histograms
+// describing the game while it runs
+////////////////////////////////////////
+//use:
+//
+//Metrics::increment("events.sent"); //counter, only grows
+//Metrics::setGauge("map.chunks", 4096); //current value
+//Metrics::observe("mesh.vertices", 1200); //distribution (count, sum, min, max, buckets)
+//Metrics::writeToFile("metrics.txt"); //one line per metric, sorted by name
+//
+//Histogram buckets are powers of two: a value v is counted in the first bucket
+//"<=2^k" with v <= 2^k. Only the main thread must use it.
+
+#include <string>
+#include <map>
+#include <vector>
+
+class Metrics
+{
+	public:
+		struct Histogram {
+			size_t count;
+			double sum;
+			double min;
+			double max;
+			std::vector<size_t> buckets; //bucket k counts values <= 2^k
+
+			Histogram();
+			void add(double value);
+		};
+
+		static void increment(const std::string &name, unsigned long long n = 1);
+		static void setGauge(const std::string &name, double value);
+		static void observe(const std::string &name, double value);
+
+		static unsigned long long getCounter(const std::string &name);
+		static double getGauge(const std::string &name);
+		static std::string getReport();
+		static bool writeToFile(const std::string &filename);
+		static void reset();
+
+	private:
+		static std::map<std::string, unsigned long long> counters_;
+		static std::map<std::string, double> gauges_;
+		static std::map<std::string, Histogram> histograms_;
+};
+
+#endif /* METRICS_H */
@@ -0,0 +1,401 @@
+#include "pagedMap.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include <cstring>
+#include "matterVoxel.h"
+#include "metrics.h"
+
+namespace {
+
+const char fileMagic[4] = {'P', 'G', 'P', 'M'};
+const std::uint32_t fileVersion = 1;
+//memory of a loaded chunk besides its cubes, so uniform chunks are unloaded too
+const size_t residentOverhead = 64;
+
+struct FileHeader {
+	char magic[4];
+	std::uint32_t version;
+	std::int32_t sizeX;
+	std::int32_t sizeY;
+	std::int32_t sizeZ;
+	std::uint32_t chunkBits;
+};
+
+ChangeSet chunkBox(const CubeMap<Voxel> &map, int i, int j, int k)
+{
+	const int bits = CubeMap<Voxel>::chunkBits;
+	int x1 = std::min((i+1) << bits, map.getSizeX()) - 1;
+	int y1 = std::min((j+1) << bits, map.getSizeY()) - 1;
+	int z1 = std::min((k+1) << bits, map.getSizeZ()) - 1;
+	ChangeSet box;
+	box.add(i << bits, j << bits, k << bits, x1, y1, z1,
+		static_cast<size_t>(x1 - (i << bits) + 1)*(y1 - (j << bits) + 1)*(z1 - (k << bits) + 1));
+	return box;
+}
+
+}
+
+const std::uint16_t PagedMap::emptyMatter;
+
+PagedMap::PagedMap(const MaterialRegistry *materials):
+	materials_{materials},
+	filename_{},
+	file_{},
+	maxBytes_{0},
+	nbChunks_{0, 0, 0},
+	resident_{},
+	tick_{0},
+	residentBytes_{0},
+	toIndex_{},
+	toMatter_{},
+	cubes_{},
+	matters_{},
+	overBudget_{false}
+{
+
+}
+
+PagedMap::~PagedMap()
+{
+
+}
+
+bool PagedMap::isPagedFile(const std::string &filename)
+{
+	const std::string extension = ".pmap";
+	return filename.size() > extension.size() && filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+bool PagedMap::save(const std::string &filename, const CubeMap<Voxel> &map)
+{
+	std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file) {
+		LOG(WARNING) << "Unable to write the paged map: " << filename;
+		return false;
+	}
+	FileHeader header;
+	std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+	header.version = fileVersion;
+	header.sizeX = map.getSizeX();
+	header.sizeY = map.getSizeY();
+	header.sizeZ = map.getSizeZ();
+	header.chunkBits = CubeMap<Voxel>::chunkBits;
+	int nbX = map.getNbChunksX();
+	int nbY = map.getNbChunksY();
+	int nbZ = map.getNbChunksZ();
+	//entries are written once the offsets of the cubes are known
+	std::vector<ChunkEntry> entries(static_cast<size_t>(nbX)*nbY*nbZ, ChunkEntry{0, emptyMatter, 1, 0});
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(&entries[0]), entries.size()*sizeof(ChunkEntry));
+	std::uint64_t offset = sizeof(header) + entries.size()*sizeof(ChunkEntry);
+	toMatter_.clear();
+	updateMatterTables(map);
+	size_t nbStored = 0;
+	for (int k=0; k<nbZ; ++k) {
+		for (int j=0; j<nbY; ++j) {
+			for (int i=0; i<nbX; ++i) {
+				map.readChunk(i, j, k, cubes_);
+				matters_.resize(cubes_.size());
+				for (size_t n=0; n<cubes_.size(); ++n) {
+					matters_[n] = toMatter_[cubes_[n]];
+				}
+				ChunkEntry &entry = entries[i + nbX*(j + nbY*k)];
+				if (std::count(matters_.begin(), matters_.end(), matters_[0]) == static_cast<std::ptrdiff_t>(matters_.size())) {
+					entry.uniform = matters_[0];
+					continue;
+				}
+				entry.offset = offset;
+				entry.isUniform = 0;
+				file.write(reinterpret_cast<const char*>(&matters_[0]), matters_.size()*sizeof(std::uint16_t));
+				offset += matters_.size()*sizeof(std::uint16_t);
+				++nbStored;
+			}
+		}
+	}
+	file.seekp(sizeof(header));
+	file.write(reinterpret_cast<const char*>(&entries[0]), entries.size()*sizeof(ChunkEntry));
+	//the palette of an open map may differ
+	toMatter_.clear();
+	if (!file) {
+		LOG(WARNING) << "Unable to write the paged map: " << filename;
+		return false;
+	}
+	LOG(INFO) << "Paged map saved: " << filename << " (" << entries.size() << " chunks, " << nbStored << " not uniform, " << offset << " bytes)";
+	return true;
+}
+
+std::unique_ptr<CubeMap<Voxel>> PagedMap::open(const std::string &filename, size_t maxBytes)
+{
+	if (file_.is_open()) {
+		file_.close();
+	}
+	file_.clear();
+	filename_ = filename;
+	maxBytes_ = maxBytes;
+	resident_.clear();
+	residentBytes_ = 0;
+	toMatter_.clear();
+	overBudget_ = false;
+	file_.open(filename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+	FileHeader header;
+	if (!file_.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0 || header.version != fileVersion
+		|| header.chunkBits != CubeMap<Voxel>::chunkBits || header.sizeX <= 0 || header.sizeY <= 0 || header.sizeZ <= 0) {
+		LOG(ERROR) << "Not a paged map: " << filename;
+		file_.close();
+		return nullptr;
+	}
+	//every chunk empty until it is loaded
+	std::unique_ptr<CubeMap<Voxel>> map(new CubeMap<Voxel>(header.sizeX, header.sizeY, header.sizeZ));
+	nbChunks_[0] = map->getNbChunksX();
+	nbChunks_[1] = map->getNbChunksY();
+	nbChunks_[2] = map->getNbChunksZ();
+	toIndex_.assign(materials_->size(), CubeMap<Voxel>::emptyIndex);
+	for (MatterId id=0; id<materials_->size(); ++id) {
+		toIndex_[id] = map->getPaletteIndex(materials_->getVoxel(id));
+	}
+	LOG(INFO) << "Paged map opened: " << filename << " (" << header.sizeX << "*" << header.sizeY << "*" << header.sizeZ
+		<< ", budget " << maxBytes_ << " bytes)";
+	return map;
+}
+
+void PagedMap::update(CubeMap<Voxel> &map, int x, int z, int radius, int maxLoads, std::vector<ChangeSet> &changes)
+{
+	if (!isOpen()) {
+		return;
+	}
+	++tick_;
+	const int bits = CubeMap<Voxel>::chunkBits;
+	int centerX = x >> bits;
+	int centerZ = z >> bits;
+	int chunkRadius = (radius + CubeMap<Voxel>::chunkSize-1) >> bits;
+	//missing chunks of the view, by distance
+	std::vector<std::pair<int, int>> missing;
+	for (int k=std::max(centerZ-chunkRadius, 0); k<=std::min(centerZ+chunkRadius, nbChunks_[2]-1); ++k) {
+		for (int i=std::max(centerX-chunkRadius, 0); i<=std::min(centerX+chunkRadius, nbChunks_[0]-1); ++i) {
+			int distance = (i-centerX)*(i-centerX) + (k-centerZ)*(k-centerZ);
+			if (distance > chunkRadius*chunkRadius) {
+				continue;
+			}
+			for (int j=0; j<nbChunks_[1]; ++j) {
+				int id = i + nbChunks_[0]*(j + nbChunks_[1]*k);
+				auto found = resident_.find(id);
+				if (found != resident_.end()) {
+					found->second = tick_;
+				} else {
+					missing.push_back(std::make_pair(distance, id));
+				}
+			}
+		}
+	}
+	std::sort(missing.begin(), missing.end());
+	for (size_t n=0; n<missing.size() && n<static_cast<size_t>(maxLoads); ++n) {
+		int id = missing[n].second;
+		int i = id % nbChunks_[0];
+		int j = (id / nbChunks_[0]) % nbChunks_[1];
+		int k = id / (nbChunks_[0]*nbChunks_[1]);
+		loadChunk(map, i, j, k);
+		resident_[id] = tick_;
+		changes.push_back(chunkBox(map, i, j, k));
+	}
+	evict(map, changes);
+	Metrics::setGauge("paging.residentChunks", resident_.size());
+	Metrics::setGauge("paging.residentBytes", residentBytes_);
+}
+
+size_t PagedMap::flush(CubeMap<Voxel> &map)
+{
+	if (!isOpen()) {
+		return 0;
+	}
+	//chunks modified without being loaded (scripts, fills, flood fills) are merged with the file first,
+	//they stay loaded until they are evicted
+	for (int k=0; k<nbChunks_[2]; ++k) {
+		for (int j=0; j<nbChunks_[1]; ++j) {
+			for (int i=0; i<nbChunks_[0]; ++i) {
+				int id = i + nbChunks_[0]*(j + nbChunks_[1]*k);
+				if (map.isChunkDirty(i, j, k) && resident_.find(id) == resident_.end()) {
+					loadChunk(map, i, j, k);
+					resident_[id] = tick_;
+				}
+			}
+		}
+	}
+	size_t nbWritten = 0;
+	for (auto &chunk : resident_) {
+		int id = chunk.first;
+		int i = id % nbChunks_[0];
+		int j = (id / nbChunks_[0]) % nbChunks_[1];
+		int k = id / (nbChunks_[0]*nbChunks_[1]);
+		if (map.isChunkDirty(i, j, k) && writeBack(map, i, j, k)) {
+			++nbWritten;
+		}
+	}
+	file_.flush();
+	LOG(INFO) << "Paged map flushed: " << nbWritten << " chunks written to " << filename_;
+	return nbWritten;
+}
+
+bool PagedMap::readEntry(int id, ChunkEntry &entry)
+{
+	file_.seekg(sizeof(FileHeader) + static_cast<std::uint64_t>(id)*sizeof(ChunkEntry));
+	if (!file_.read(reinterpret_cast<char*>(&entry), sizeof(entry))) {
+		file_.clear();
+		return false;
+	}
+	return true;
+}
+
+bool PagedMap::writeEntry(int id, const ChunkEntry &entry)
+{
+	file_.seekp(sizeof(FileHeader) + static_cast<std::uint64_t>(id)*sizeof(ChunkEntry));
+	if (!file_.write(reinterpret_cast<const char*>(&entry), sizeof(entry))) {
+		file_.clear();
+		return false;
+	}
+	return true;
+}
+
+//cubes set while the chunk wasn't loaded (it was empty) are kept over the ones of the file
+void PagedMap::loadChunk(CubeMap<Voxel> &map, int i, int j, int k)
+{
+	int id = i + nbChunks_[0]*(j + nbChunks_[1]*k);
+	bool edited = map.isChunkDirty(i, j, k);
+	std::vector<CubeMap<Voxel>::PaletteIndex> edits;
+	if (edited) {
+		map.readChunk(i, j, k, edits);
+	}
+	size_t size = static_cast<size_t>(map.getChunkLayers(j))*CubeMap<Voxel>::chunkSize*CubeMap<Voxel>::chunkSize;
+	ChunkEntry entry;
+	if (!readEntry(id, entry)) {
+		LOG(WARNING) << "Chunk " << i << "-" << j << "-" << k << " missing in the paged map, it is left empty";
+		entry.isUniform = 1;
+		entry.uniform = emptyMatter;
+	}
+	if (entry.isUniform) {
+		matters_.assign(size, entry.uniform);
+	} else {
+		matters_.resize(size);
+		file_.seekg(entry.offset);
+		if (!file_.read(reinterpret_cast<char*>(&matters_[0]), size*sizeof(std::uint16_t))) {
+			LOG(WARNING) << "Chunk " << i << "-" << j << "-" << k << " cut in the paged map, it is left empty";
+			file_.clear();
+			matters_.assign(size, emptyMatter);
+		}
+	}
+	cubes_.resize(size);
+	for (size_t n=0; n<size; ++n) {
+		std::uint16_t matter = matters_[n];
+		if (matter == emptyMatter) {
+			cubes_[n] = CubeMap<Voxel>::emptyIndex;
+		} else {
+			cubes_[n] = toIndex_[matter < toIndex_.size() ? matter : MaterialRegistry::unknownId];
+		}
+	}
+	if (edited) {
+		size_t nbKept = 0;
+		for (size_t n=0; n<size; ++n) {
+			if (edits[n] != CubeMap<Voxel>::emptyIndex) {
+				cubes_[n] = edits[n];
+				++nbKept;
+			}
+		}
+		LOG(INFO) << "Chunk " << i << "-" << j << "-" << k << " modified before being loaded: " << nbKept << " cubes kept";
+	}
+	//still to be written back if it was modified
+	map.writeChunk(i, j, k, cubes_, edited);
+	Metrics::increment("paging.loads");
+}
+
+bool PagedMap::writeBack(CubeMap<Voxel> &map, int i, int j, int k)
+{
+	int id = i + nbChunks_[0]*(j + nbChunks_[1]*k);
+	updateMatterTables(map);
+	map.readChunk(i, j, k, cubes_);
+	matters_.resize(cubes_.size());
+	for (size_t n=0; n<cubes_.size(); ++n) {
+		matters_[n] = toMatter_[cubes_[n]];
+	}
+	ChunkEntry entry;
+	if (!readEntry(id, entry)) {
+		LOG(WARNING) << "Chunk " << i << "-" << j << "-" << k << " missing in the paged map, it is not written";
+		return false;
+	}
+	if (std::count(matters_.begin(), matters_.end(), matters_[0]) == static_cast<std::ptrdiff_t>(matters_.size())) {
+		//the place of its cubes is kept for the next time
+		entry.isUniform = 1;
+		entry.uniform = matters_[0];
+	} else {
+		if (entry.offset == 0) {
+			file_.seekp(0, std::ios::end);
+			entry.offset = file_.tellp();
+		}
+		entry.isUniform = 0;
+		file_.seekp(entry.offset);
+		if (!file_.write(reinterpret_cast<const char*>(&matters_[0]), matters_.size()*sizeof(std::uint16_t))) {
+			LOG(WARNING) << "Unable to write the chunk " << i << "-" << j << "-" << k << " to the paged map";
+			file_.clear();
+			return false;
+		}
+	}
+	if (!writeEntry(id, entry)) {
+		return false;
+	}
+	map.setChunkClean(i, j, k);
+	Metrics::increment("paging.writes");
+	return true;
+}
+
+//matter id of each voxel of the palette, rebuilt when the palette changed
+void PagedMap::updateMatterTables(const CubeMap<Voxel> &map)
+{
+	if (toMatter_.size() == map.getPaletteSize()) {
+		return;
+	}
+	toMatter_.assign(map.getPaletteSize(), emptyMatter);
+	for (size_t index=1; index<toMatter_.size(); ++index) {
+		Voxel *vox = map.getPaletteVoxel(static_cast<CubeMap<Voxel>::PaletteIndex>(index));
+		if (vox && vox->getId() == "matter") {
+			toMatter_[index] = static_cast<MatterVoxel*>(vox)->getMatterId();
+		} else if (vox) {
+			toMatter_[index] = MaterialRegistry::unknownId;
+		}
+	}
+}
+
+//least recently viewed chunks first, the ones of the current view are kept
+void PagedMap::evict(CubeMap<Voxel> &map, std::vector<ChangeSet> &changes)
+{
+	residentBytes_ = 0;
+	std::vector<std::pair<unsigned long, int>> unused;
+	for (auto &chunk : resident_) {
+		int id = chunk.first;
+		residentBytes_ += residentOverhead + map.getChunkBytes(id % nbChunks_[0], (id / nbChunks_[0]) % nbChunks_[1], id / (nbChunks_[0]*nbChunks_[1]));
+		if (chunk.second < tick_) {
+			unused.push_back(std::make_pair(chunk.second, id));
+		}
+	}
+	if (residentBytes_ <= maxBytes_) {
+		return;
+	}
+	std::sort(unused.begin(), unused.end());
+	for (size_t n=0; n<unused.size() && residentBytes_ > maxBytes_; ++n) {
+		int id = unused[n].second;
+		int i = id % nbChunks_[0];
+		int j = (id / nbChunks_[0]) % nbChunks_[1];
+		int k = id / (nbChunks_[0]*nbChunks_[1]);
+		if (map.isChunkDirty(i, j, k) && !writeBack(map, i, j, k)) {
+			//its edits would be lost, it stays loaded
+			continue;
+		}
+		residentBytes_ -= residentOverhead + map.getChunkBytes(i, j, k);
+		map.clearChunk(i, j, k);
+		resident_.erase(id);
+		changes.push_back(chunkBox(map, i, j, k));
+		Metrics::increment("paging.evictions");
+	}
+	if (residentBytes_ > maxBytes_ && !overBudget_) {
+		LOG(WARNING) << "The chunks in view use more memory than the paging budget: " << residentBytes_ << " bytes";
+		overBudget_ = true;
+	}
+}
@@ -0,0 +1,95 @@
+#ifndef PAGEDMAP_H
+#define PAGEDMAP_H
+
+////////////////////////////////////////
+// World map bigger than the memory:
+// chunks of a CubeMap loaded from a map
+// file around a point, and written back
+////////////////////////////////////////
+//use:
+//
+//PagedMap paged(materials);
+//paged.save("big.pmap", map); //whole map to a paged file
+//std::unique_ptr<CubeMap<Voxel>> map = paged.open("big.pmap", 256*1024*1024);
+//std::vector<ChangeSet> changes;
+//paged.update(*map, cameraX, cameraZ, 512, 32, changes); //each frame, changes to redraw
+//paged.flush(*map); //before the map is destroyed
+//
+//The map returned by open has the size of the file, with every chunk empty.
+//update loads the missing chunks (all their layers) closer than radius cubes,
+//the nearest first and at most maxLoads of them, so the cost of a frame and
+//the memory only depend on the view. When the cubes of the loaded chunks use
+//more than the budget, the least recently viewed ones are unloaded (emptied),
+//after being written back if they were modified (a chunk that can't be written
+//stays loaded). The chunk headers of the CubeMap (64 bytes for 16^3 cubes on
+//64 bits) stay in memory for the whole map.
+//Operations on the whole map (scripts, resize) only see the loaded chunks.
+//The cubes they set in a chunk that isn't loaded are merged with the cubes of
+//the file when the chunk is loaded, or by flush (emptying a cube there does
+//nothing: the chunk is already empty).
+//
+//File: a header, one entry per chunk (matter of a uniform chunk, or offset
+//of its cubes), then the cubes of the chunks that aren't uniform, as 16 bits
+//matter ids (emptyMatter for an empty cube) ordered like inside a CubeMap
+//chunk. A chunk written back keeps its place in the file.
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <unordered_map>
+#include <cstdint>
+#include "cubeMap.h"
+#include "voxel.h"
+#include "materialRegistry.h"
+#include "brush.h"
+
+class PagedMap
+{
+	public:
+		explicit PagedMap(const MaterialRegistry *materials);
+		~PagedMap();
+
+		bool save(const std::string &filename, const CubeMap<Voxel> &map);
+		std::unique_ptr<CubeMap<Voxel>> open(const std::string &filename, size_t maxBytes);
+		void update(CubeMap<Voxel> &map, int x, int z, int radius, int maxLoads, std::vector<ChangeSet> &changes);
+		size_t flush(CubeMap<Voxel> &map); //writes back every modified chunk, returns their number
+		bool isOpen() const { return file_.is_open(); }
+		const std::string& getFilename() const { return filename_; }
+		size_t getResidentBytes() const { return residentBytes_; }
+		size_t getNbResident() const { return resident_.size(); }
+
+		static bool isPagedFile(const std::string &filename); //by extension (.pmap)
+		static const std::uint16_t emptyMatter = 0xFFFF;
+
+	private:
+		struct ChunkEntry {
+			std::uint64_t offset; //of the cubes in the file, 0 if never written
+			std::uint16_t uniform; //matter of every cube if the chunk is uniform
+			std::uint16_t isUniform;
+			std::uint32_t padding;
+		};
+
+		bool readEntry(int id, ChunkEntry &entry);
+		bool writeEntry(int id, const ChunkEntry &entry);
+		void loadChunk(CubeMap<Voxel> &map, int i, int j, int k);
+		bool writeBack(CubeMap<Voxel> &map, int i, int j, int k);
+		void updateMatterTables(const CubeMap<Voxel> &map);
+		void evict(CubeMap<Voxel> &map, std::vector<ChangeSet> &changes);
+
+		const MaterialRegistry *materials_;
+		std::string filename_;
+		std::fstream file_;
+		size_t maxBytes_;
+		int nbChunks_[3];
+		std::unordered_map<int, unsigned long> resident_; //chunk id -> last update viewing it
+		unsigned long tick_;
+		size_t residentBytes_;
+		std::vector<CubeMap<Voxel>::PaletteIndex> toIndex_; //by matter id
+		std::vector<std::uint16_t> toMatter_; //by palette index
+		std::vector<CubeMap<Voxel>::PaletteIndex> cubes_; //chunk being loaded or written
+		std::vector<std::uint16_t> matters_;
+		bool overBudget_; //warned once when the view alone is over the budget
+};
+
+#endif /* PAGEDMAP_H */
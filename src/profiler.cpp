@@ -0,0 +1,206 @@
+#include "profiler.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <unordered_map>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Sample {
+	int zone;
+	Clock::time_point start;
+	Clock::time_point end;
+};
+
+struct Zone {
+	std::string name;
+	std::vector<float> history; //ms per frame, ring buffer
+	size_t nbFrames;
+	double frameTime;
+	unsigned int calls;
+	double lastTime;
+	unsigned int lastCalls;
+};
+
+std::unordered_map<std::string, int> zoneIds;
+std::vector<Zone> zones;
+std::vector<Sample> frameSamples;
+std::vector<size_t> openZones; //indices in frameSamples
+std::deque<std::vector<Sample>> traceFrames;
+Clock::time_point origin = Clock::now();
+Clock::time_point frameStart = origin;
+
+double toMs(Clock::duration duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+int getZoneId(const char *name)
+{
+	auto found = zoneIds.find(name);
+	if (found != zoneIds.end()) {
+		return found->second;
+	}
+	int id = zones.size();
+	Zone zone;
+	zone.name = name;
+	zone.history.assign(Profiler::historySize, 0.0f);
+	zone.nbFrames = 0;
+	zone.frameTime = 0;
+	zone.calls = 0;
+	zone.lastTime = 0;
+	zone.lastCalls = 0;
+	zones.push_back(zone);
+	zoneIds[name] = id;
+	return id;
+}
+
+std::string escapeJson(const std::string &text)
+{
+	std::string escaped;
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+		}
+		escaped += c;
+	}
+	return escaped;
+}
+
+}
+
+bool Profiler::enabled_ = false;
+const size_t Profiler::historySize;
+const size_t Profiler::traceSize;
+
+void Profiler::setEnabled(bool enabled)
+{
+	if (enabled == enabled_) {
+		return;
+	}
+	LOG(INFO) << "Profiler " << (enabled ? "enabled" : "disabled");
+	enabled_ = enabled;
+	frameSamples.clear();
+	openZones.clear();
+	frameStart = Clock::now();
+}
+
+void Profiler::beginZone(const char *name)
+{
+	if (!enabled_) {
+		return;
+	}
+	openZones.push_back(frameSamples.size());
+	Clock::time_point now = Clock::now();
+	frameSamples.push_back(Sample{getZoneId(name), now, now});
+}
+
+void Profiler::endZone()
+{
+	if (openZones.empty()) {
+		return;
+	}
+	Sample &sample = frameSamples[openZones.back()];
+	openZones.pop_back();
+	sample.end = Clock::now();
+	Zone &zone = zones[sample.zone];
+	zone.frameTime += toMs(sample.end - sample.start);
+	++zone.calls;
+}
+
+void Profiler::endFrame()
+{
+	if (!enabled_ || !openZones.empty()) {
+		return;
+	}
+	//the whole frame is a zone too
+	Clock::time_point now = Clock::now();
+	frameSamples.insert(frameSamples.begin(), Sample{getZoneId("frame"), frameStart, now});
+	Zone &frame = zones[frameSamples.front().zone];
+	frame.frameTime = toMs(now - frameStart);
+	frame.calls = 1;
+	frameStart = now;
+	for (Zone &zone : zones) {
+		zone.history[zone.nbFrames % historySize] = zone.frameTime;
+		++zone.nbFrames;
+		zone.lastTime = zone.frameTime;
+		zone.lastCalls = zone.calls;
+		zone.frameTime = 0;
+		zone.calls = 0;
+	}
+	traceFrames.push_back(std::vector<Sample>());
+	traceFrames.back().swap(frameSamples);
+	if (traceFrames.size() > traceSize) {
+		//its memory is reused for the next frame
+		frameSamples.swap(traceFrames.front());
+		frameSamples.clear();
+		traceFrames.pop_front();
+	}
+}
+
+std::vector<Profiler::ZoneStats> Profiler::getStats()
+{
+	std::vector<ZoneStats> stats;
+	std::vector<float> times;
+	for (const Zone &zone : zones) {
+		if (zone.nbFrames == 0) {
+			continue;
+		}
+		times.assign(zone.history.begin(), zone.history.begin() + std::min(zone.nbFrames, historySize));
+		std::sort(times.begin(), times.end());
+		ZoneStats zoneStats;
+		zoneStats.name = zone.name;
+		zoneStats.calls = zone.lastCalls;
+		zoneStats.last = zone.lastTime;
+		zoneStats.median = times[times.size()/2];
+		zoneStats.p95 = times[std::min(times.size()-1, times.size()*95/100)];
+		zoneStats.max = times.back();
+		stats.push_back(zoneStats);
+	}
+	return stats;
+}
+
+std::string Profiler::getReport()
+{
+	if (!enabled_) {
+		return "Profiler disabled";
+	}
+	std::string report = "zone                  last   p50   p95   max (ms)  calls\n";
+	char line[128];
+	for (const ZoneStats &zone : getStats()) {
+		std::snprintf(line, sizeof(line), "%-20.20s %5.2f %5.2f %5.2f %5.2f %6u\n",
+			zone.name.c_str(), zone.last, zone.median, zone.p95, zone.max, zone.calls);
+		report += line;
+	}
+	return report;
+}
+
+bool Profiler::writeChromeTrace(const std::string &filename)
+{
+	std::ofstream file(filename.c_str());
+	if (!file.is_open()) {
+		LOG(WARNING) << "Unable to open file: " << filename;
+		return false;
+	}
+	//complete events ("X"), times in microseconds
+	file << std::fixed << std::setprecision(3);
+	file << "{\"traceEvents\":[\n";
+	bool first = true;
+	for (const std::vector<Sample> &frame : traceFrames) {
+		for (const Sample &sample : frame) {
+			file << (first ? "" : ",\n") << "{\"name\":\"" << escapeJson(zones[sample.zone].name)
+				<< "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << toMs(sample.start - origin)*1000
+				<< ",\"dur\":" << toMs(sample.end - sample.start)*1000 << "}";
+			first = false;
+		}
+	}
+	file << "\n]}\n";
+	LOG(INFO) << "Profiler trace of " << traceFrames.size() << " frames written to: " << filename;
+	return true;
+}
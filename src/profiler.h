@@ -0,0 +1,72 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+////////////////////////////////////////
+// Timings of named zones of code,
+// aggregated per frame
+////////////////////////////////////////
+//use:
+//
+//Profiler::setEnabled(true);
+//{
+//	PROFILE_ZONE("renderFrame"); //timed until the end of the scope
+//	...
+//}
+//Profiler::endFrame(); //once per rendered frame
+//Profiler::getReport(); //text with the percentiles of each zone
+//Profiler::writeChromeTrace("trace.json"); //open it in chrome://tracing
+//
+//Zones can be nested. For each zone the time spent in a frame is kept for the
+//last frames (rolling percentiles), and the last frames are kept in full for
+//the trace. Only the main thread must use it. When disabled a zone costs a test.
+
+#include <string>
+#include <vector>
+
+class Profiler
+{
+	public:
+		struct ZoneStats {
+			std::string name;
+			unsigned int calls; //in the last frame
+			double last; //ms in the last frame
+			double median;
+			double p95;
+			double max;
+		};
+
+		static void setEnabled(bool enabled);
+		static bool isEnabled() { return enabled_; }
+		static void beginZone(const char *name);
+		static void beginZone(const std::string &name) { if (enabled_) beginZone(name.c_str()); }
+		static void endZone();
+		static void endFrame();
+
+		static std::vector<ZoneStats> getStats();
+		static std::string getReport();
+		static bool writeChromeTrace(const std::string &filename);
+
+		static const size_t historySize = 240; //frames kept for the percentiles
+		static const size_t traceSize = 120; //frames kept for the trace
+
+	private:
+		static bool enabled_;
+};
+
+class ProfileZone
+{
+	public:
+		explicit ProfileZone(const char *name) : active_{Profiler::isEnabled()} { if (active_) Profiler::beginZone(name); }
+		explicit ProfileZone(const std::string &name) : active_{Profiler::isEnabled()} { if (active_) Profiler::beginZone(name); }
+		~ProfileZone() { if (active_) Profiler::endZone(); }
+
+	private:
+		ProfileZone(const ProfileZone&) = delete;
+		ProfileZone& operator=(const ProfileZone&) = delete;
+
+		bool active_; //the zone is closed even if the profiler is disabled inside it
+};
+
+#define PROFILE_ZONE(name) ProfileZone profileZone_(name)
+
+#endif /* PROFILER_H */
@@ -0,0 +1,129 @@
+#include "scriptEngine.h"
+#include <glog/logging.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <cstring>
+#include "metrics.h"
+
+ScriptEngine::ScriptEngine():
+	L_{luaL_newstate()},
+	cache_{}
+{
+	openSandbox();
+}
+
+ScriptEngine::~ScriptEngine()
+{
+	lua_close(L_);
+}
+
+void ScriptEngine::openSandbox()
+{
+	static const luaL_Reg libs[] = {
+		{"", luaopen_base},
+		{LUA_TABLIBNAME, luaopen_table},
+		{LUA_STRLIBNAME, luaopen_string},
+		{LUA_MATHLIBNAME, luaopen_math},
+		{nullptr, nullptr}
+	};
+	for (const luaL_Reg *lib = libs; lib->func; ++lib) {
+		lua_pushcfunction(L_, lib->func);
+		lua_pushstring(L_, lib->name);
+		lua_call(L_, 1, 0);
+	}
+	//no access to files, to other environments nor to the shared tables
+	static const char *removed[] = { "dofile", "loadfile", "load", "loadstring", "getfenv", "setfenv",
+		"_G", "rawget", "rawset", "getmetatable", "setmetatable", nullptr };
+	for (const char **name = removed; *name; ++name) {
+		lua_pushnil(L_);
+		lua_setglobal(L_, *name);
+	}
+}
+
+bool ScriptEngine::runFile(const std::string &filename)
+{
+	int top = lua_gettop(L_);
+	if (!loadFile(filename)) {
+		LOG(ERROR) << lua_tostring(L_, -1);
+		lua_settop(L_, top);
+		return false;
+	}
+	//fresh environment reading the shared globals, the libraries are copied so they can't be patched
+	static const char *libs[] = { LUA_COLIBNAME, LUA_TABLIBNAME, LUA_STRLIBNAME, LUA_MATHLIBNAME, nullptr };
+	lua_newtable(L_);
+	for (const char **lib = libs; *lib; ++lib) {
+		pushLibraryCopy(*lib);
+		lua_setfield(L_, -2, *lib);
+	}
+	lua_newtable(L_);
+	lua_pushvalue(L_, LUA_GLOBALSINDEX);
+	lua_setfield(L_, -2, "__index");
+	lua_setmetatable(L_, -2);
+	lua_pushvalue(L_, -1);
+	lua_insert(L_, -3);
+	lua_setfenv(L_, -2);
+	if (lua_pcall(L_, 0, 0, 0)) {
+		LOG(ERROR) << lua_tostring(L_, -1);
+		lua_settop(L_, top);
+		return false;
+	}
+	return true;
+}
+
+//shallow copy of a library table of the globals
+void ScriptEngine::pushLibraryCopy(const char *name)
+{
+	lua_newtable(L_);
+	lua_getglobal(L_, name);
+	lua_pushnil(L_);
+	while (lua_next(L_, -2)) {
+		lua_pushvalue(L_, -2);
+		lua_insert(L_, -2);
+		lua_settable(L_, -5);
+	}
+	lua_pop(L_, 1);
+}
+
+bool ScriptEngine::loadFile(const std::string &filename)
+{
+	struct stat infos;
+	if (stat(filename.c_str(), &infos) != 0) {
+		lua_pushstring(L_, ("cannot open " + filename).c_str());
+		return false;
+	}
+	std::string chunkName = "@" + filename;
+	auto cached = cache_.find(filename);
+	if (cached != cache_.end() && cached->second.modified == infos.st_mtime && cached->second.size == infos.st_size) {
+		const std::string &bytecode = cached->second.bytecode;
+		Metrics::increment("scripts.cacheHits");
+		return luaL_loadbuffer(L_, bytecode.data(), bytecode.size(), chunkName.c_str()) == 0;
+	}
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	char signature[sizeof(LUA_SIGNATURE)-1] = {};
+	file.read(signature, sizeof(signature));
+	if (std::memcmp(signature, LUA_SIGNATURE, sizeof(signature)) == 0) {
+		lua_pushstring(L_, (filename + ": precompiled scripts are refused").c_str());
+		cache_.erase(filename);
+		return false;
+	}
+	file.close();
+	if (luaL_loadfile(L_, filename.c_str())) {
+		cache_.erase(filename);
+		return false;
+	}
+	CompiledScript compiled;
+	compiled.modified = infos.st_mtime;
+	compiled.size = infos.st_size;
+	if (lua_dump(L_, writeBytecode, &compiled.bytecode) == 0) {
+		cache_[filename] = compiled;
+		Metrics::increment("scripts.compiled");
+		LOG(INFO) << "Script compiled: " << filename << " (" << compiled.bytecode.size() << " bytes)";
+	}
+	return true;
+}
+
+int ScriptEngine::writeBytecode(lua_State *L, const void *data, size_t size, void *bytecode)
+{
+	static_cast<std::string*>(bytecode)->append(static_cast<const char*>(data), size);
+	return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef SCRIPTENGINE_H
+#define SCRIPTENGINE_H
+
+////////////////////////////////////////
+// Lua state kept for the whole life of
+// a game state, running map scripts
+// from a cache of compiled chunks
+////////////////////////////////////////
+//use:
+//
+//ScriptEngine scripts;
+//luaWorld.open(scripts.getState()); //bindings go in the shared globals
+//if (scripts.runFile("../media/mapGenSquare.lua")) {
+//	lua_getfield(scripts.getState(), -1, "mapDef"); //globals set by the script
+//	...
+//	lua_pop(scripts.getState(), 2); //the value and the script environment
+//}
+//
+//Scripts only get the base, table, string and math libraries (no io, os,
+//package, debug, functions loading code, nor raw or metatable access). Each
+//run has its own environment with its own copy of the library tables: what
+//a script defines or patches doesn't leak to the next one. Only source files
+//are run (unchecked bytecode can crash Lua 5.1). Files are compiled once, the
+//bytecode is reused until their modification time or size changes.
+
+#include <string>
+#include <unordered_map>
+#include <ctime>
+#include <sys/types.h>
+extern "C" {
+	#include "lua.h"
+	#include "lualib.h"
+	#include "lauxlib.h"
+}
+
+class ScriptEngine
+{
+	public:
+		ScriptEngine();
+		~ScriptEngine();
+
+		lua_State* getState() { return L_; }
+		//on success the environment of the script is left on the stack
+		bool runFile(const std::string &filename);
+		void clearCache() { cache_.clear(); }
+
+	private:
+		struct CompiledScript {
+			std::time_t modified;
+			off_t size; //several saves can happen within the same second
+			std::string bytecode;
+		};
+
+		ScriptEngine(const ScriptEngine&) = delete;
+		ScriptEngine& operator=(const ScriptEngine&) = delete;
+
+		void openSandbox();
+		void pushLibraryCopy(const char *name);
+		bool loadFile(const std::string &filename);
+		static int writeBytecode(lua_State *L, const void *data, size_t size, void *bytecode);
+
+		lua_State *L_;
+		std::unordered_map<std::string, CompiledScript> cache_;
+};
+
+#endif /* SCRIPTENGINE_H */
@@ -0,0 +1,295 @@
+////////////////////////////////////////
+// Regression tests of the map storage,
+// without graphics
+////////////////////////////////////////
+//use:
+//
+//mapTests [materials.lua] (run from dist/bin, like the game)
+//
+//Each test logs its failures and the program returns 1 if any failed.
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include "../cubeMap.h"
+#include "../voxel.h"
+#include "../materialRegistry.h"
+#include "../pagedMap.h"
+#include "../voxelRay.h"
+#include "../graphics/chunkMesher.h"
+#include "../graphics/chunkMeshCache.h"
+#include "../graphics/chunkGrid.h"
+
+namespace {
+
+int nbFailures = 0;
+
+void check(bool condition, const std::string &message)
+{
+	if (!condition) {
+		LOG(ERROR) << "FAILED: " << message;
+		++nbFailures;
+	}
+}
+
+struct TestVoxel {
+	int value;
+	std::string getInfos() const { return std::to_string(value); }
+};
+
+//more different voxels than the palette holds: the unused ones are dropped, the empty cubes stay empty
+void testPaletteCompaction()
+{
+	CubeMap<TestVoxel> map(40, 3, 40);
+	std::shared_ptr<TestVoxel> kept(new TestVoxel{-1});
+	map.setVoxel(kept, 5, 1, 5);
+	std::shared_ptr<TestVoxel> last;
+	for (int i=0; i<0x10000 + 10; ++i) {
+		last = std::shared_ptr<TestVoxel>(new TestVoxel{i});
+		check(map.setVoxel(last, 20, 2, 20), "setVoxel with a new voxel " + std::to_string(i));
+	}
+	check(map.getPaletteSize() < 0x100, "palette compacted, size " + std::to_string(map.getPaletteSize()));
+	check(map.getVoxel(5, 1, 5) == kept.get(), "used voxel kept by the compaction");
+	check(map.getVoxel(20, 2, 20) == last.get(), "last voxel set");
+	int nbFilled = 0;
+	for (int z=0; z<40; ++z) {
+		for (int y=0; y<3; ++y) {
+			for (int x=0; x<40; ++x) {
+				nbFilled += map.getVoxel(x, y, z) != nullptr;
+			}
+		}
+	}
+	check(nbFilled == 2, "empty cubes stay empty after the compaction, " + std::to_string(nbFilled) + " filled");
+}
+
+//compressed chunks still count as allocated
+void testAllocatedChunks()
+{
+	CubeMap<TestVoxel> map(40, 3, 40);
+	std::shared_ptr<TestVoxel> voxel(new TestVoxel{1});
+	map.setVoxel(voxel, 5, 1, 5);
+	map.setVoxel(voxel, 30, 1, 30);
+	check(map.getNbAllocatedChunks() == 2, "chunks allocated by setVoxel, " + std::to_string(map.getNbAllocatedChunks()));
+	map.compressColdChunks(0);
+	check(map.getNbCompressedChunks() == 2, "cold chunks compressed, " + std::to_string(map.getNbCompressedChunks()));
+	check(map.getNbAllocatedChunks() == 2, "compressed chunks allocated, " + std::to_string(map.getNbAllocatedChunks()));
+}
+
+//rays hitting a face, missing the cubes, and starting outside of the map
+void testPickVoxel()
+{
+	CubeMap<TestVoxel> map(10, 10, 10);
+	std::shared_ptr<TestVoxel> voxel(new TestVoxel{1});
+	map.setVoxel(voxel, 5, 5, 5);
+	VoxelHit hit;
+	const float inside[3] = {0.5f, 5.5f, 5.5f};
+	const float right[3] = {1.0f, 0.0f, 0.0f};
+	check(pickVoxel(map, inside, right, 1.0f, hit) && hit.x == 5 && hit.y == 5 && hit.z == 5, "ray hitting a cube");
+	check(hit.face == 1 && std::abs(hit.distance - 4.5f) < 1e-4f, "cube entered by its left face, " + std::to_string(hit.face));
+	const float up[3] = {0.0f, 1.0f, 0.0f};
+	check(!pickVoxel(map, inside, up, 1.0f, hit), "ray missing the cubes");
+	const float above[3] = {5.5f, 20.0f, 5.5f};
+	const float down[3] = {0.0f, -2.0f, 0.0f};
+	check(pickVoxel(map, above, down, 1.0f, hit) && hit.x == 5 && hit.y == 5 && hit.z == 5, "ray from outside of the map hitting a cube");
+	check(hit.face == 0 && std::abs(hit.distance - 7.0f) < 1e-4f, "cube entered by its top face from outside, " + std::to_string(hit.face));
+	check(!pickVoxel(map, above, up, 1.0f, hit), "ray from outside of the map going away from it");
+}
+
+//cubes set in chunks that aren't loaded survive their loading, and a flush without loading them
+void testPagedEdits(const std::string &materialsFile)
+{
+	MaterialRegistry materials;
+	if (!materials.loadFromFile(materialsFile)) {
+		check(false, "materials loaded from " + materialsFile);
+		return;
+	}
+	std::shared_ptr<Voxel> ocean = materials.getVoxel(materials.getId("ocean"));
+	std::shared_ptr<Voxel> plain = materials.getVoxel(materials.getId("plain"));
+	const std::string filename = "mapTests.pmap";
+	CubeMap<Voxel> source(128, 4, 128);
+	source.fillBox(ocean, 0, 0, 0, 127, 1, 127);
+	PagedMap paged(&materials);
+	check(paged.save(filename, source), "paged map saved");
+	std::unique_ptr<CubeMap<Voxel>> map = paged.open(filename, 1 << 30);
+	check(map != nullptr, "paged map opened");
+	if (!map) {
+		return;
+	}
+	std::vector<ChangeSet> changes;
+	paged.update(*map, 8, 8, 16, 1000, changes);
+	check(map->getVoxel(100, 0, 100) == nullptr, "far chunk not loaded");
+	map->setVoxel(plain, 100, 3, 100);
+	map->setVoxel(plain, 120, 3, 8);
+	//the view moves over the first edit only
+	paged.update(*map, 100, 100, 16, 1000, changes);
+	check(map->getVoxel(100, 3, 100) == plain.get(), "edit kept when its chunk is loaded");
+	check(map->getVoxel(100, 0, 100) == ocean.get(), "cubes of the file loaded around the edit");
+	check(map->getVoxel(120, 0, 8) == nullptr, "chunk of the second edit not loaded");
+	check(paged.flush(*map) == 2, "modified chunks written by flush");
+	check(paged.flush(*map) == 0, "chunks written back are clean");
+
+	PagedMap reopened(&materials);
+	std::unique_ptr<CubeMap<Voxel>> map2 = reopened.open(filename, 1 << 30);
+	check(map2 != nullptr, "paged map reopened");
+	if (map2) {
+		reopened.update(*map2, 64, 64, 256, 100000, changes);
+		check(map2->getVoxel(100, 3, 100) == plain.get(), "loaded edit written back");
+		check(map2->getVoxel(120, 3, 8) == plain.get(), "edit of a chunk never loaded written back");
+		check(map2->getVoxel(120, 0, 8) == ocean.get(), "cubes of the file kept around the edit never loaded");
+	}
+	std::remove(filename.c_str());
+}
+
+//the palette tables of a mesher follow the map hashed and the voxels added to its palette
+void testMesherPaletteTables(const MaterialRegistry &materials)
+{
+	std::shared_ptr<Voxel> ocean = materials.getVoxel(materials.getId("ocean"));
+	std::shared_ptr<Voxel> plain = materials.getVoxel(materials.getId("plain"));
+	CubeMap<Voxel> first(16, 4, 16);
+	first.fillBox(ocean, 0, 0, 0, 15, 0, 15);
+	CubeMap<Voxel> second(16, 4, 16);
+	second.fillBox(plain, 0, 0, 0, 15, 0, 15);
+	ChunkMesher mesher(50.0f, materials.getNbAtlasRows(), VertexFormat::Float);
+	ChunkHash ocean1 = mesher.hashChunk(first, 0, 0, 0, 7, 7, 7);
+	//same palette index, another matter
+	ChunkMesher fresh(50.0f, materials.getNbAtlasRows(), VertexFormat::Float);
+	check(mesher.hashChunk(second, 0, 0, 0, 7, 7, 7) == fresh.hashChunk(second, 0, 0, 0, 7, 7, 7), "tables built again for another map");
+	check(!(mesher.hashChunk(second, 0, 0, 0, 7, 7, 7) == ocean1), "other matter, other hash");
+	mesher.hashChunk(first, 0, 0, 0, 7, 7, 7);
+	first.setVoxel(plain, 3, 1, 3);
+	ChunkMesher fresh2(50.0f, materials.getNbAtlasRows(), VertexFormat::Float);
+	check(mesher.hashChunk(first, 0, 0, 0, 7, 7, 7) == fresh2.hashChunk(first, 0, 0, 0, 7, 7, 7), "tables built again for a voxel added to the palette");
+}
+
+//the deduplicated float vertices of a chunk wider than 256 cubes keep their own position
+void testWideChunkVertices(const MaterialRegistry &materials)
+{
+	const float cubeSize = 50.0f;
+	CubeMap<Voxel> map(300, 1, 1);
+	map.fillBox(materials.getVoxel(materials.getId("ocean")), 0, 0, 0, 299, 0, 0);
+	ChunkMesher mesher(cubeSize, materials.getNbAtlasRows(), VertexFormat::Float);
+	mesher.setDedupVertices(true);
+	ChunkMesh mesh;
+	mesher.buildChunk(map, 0, 0, 0, 299, 0, 0, mesh);
+	check(!mesh.empty(), "wide chunk meshed");
+	int nbStretched = 0;
+	const float *vertices = reinterpret_cast<const float*>(mesh.vertices.data());
+	for (size_t face=0; face+5<mesh.indices.size(); face+=6) {
+		float minX = vertices[mesh.indices[face]*5];
+		float maxX = minX;
+		for (size_t i=face; i<face+6; ++i) {
+			minX = std::min(minX, vertices[mesh.indices[i]*5]);
+			maxX = std::max(maxX, vertices[mesh.indices[i]*5]);
+		}
+		nbStretched += maxX - minX > cubeSize;
+	}
+	check(nbStretched == 0, "faces of a wide chunk one cube wide, " + std::to_string(nbStretched) + " stretched");
+}
+
+//a mesh cut at the end of the cache file is truncated without dropping the meshes under the limit
+void testMeshCacheCutMesh(const MaterialRegistry &materials)
+{
+	const std::string filename = "mapTests.cache";
+	CubeMap<Voxel> map(8, 2, 8);
+	map.fillBox(materials.getVoxel(materials.getId("ocean")), 0, 0, 0, 7, 0, 7);
+	ChunkMesher mesher(50.0f, materials.getNbAtlasRows(), VertexFormat::Float);
+	ChunkMesh mesh;
+	mesher.buildChunk(map, 0, 0, 0, 7, 7, 7, mesh);
+	ChunkHash hash = mesher.hashChunk(map, 0, 0, 0, 7, 7, 7);
+	size_t size = 0;
+	{
+		ChunkMeshCache cache;
+		check(cache.open(filename, 1 << 20, mesher.getCacheKey()), "mesh cache created");
+		cache.store(hash, mesh);
+		check(cache.save(), "mesh cache saved");
+		size = cache.getSize();
+	}
+	{
+		std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+		file.write("cut mesh", 8);
+	}
+	//the mesh is over 3/4 of this limit
+	ChunkMeshCache cache;
+	check(cache.open(filename, size + 8, mesher.getCacheKey()), "mesh cache reopened");
+	check(cache.getNbMeshes() == 1 && cache.getSize() == size, "mesh kept, cut mesh truncated, " + std::to_string(cache.getSize()) + " bytes");
+	ChunkMesh loaded;
+	check(cache.load(hash, loaded) && loaded.vertices == mesh.vertices && loaded.indices == mesh.indices, "mesh loaded after the truncation");
+	cache.close();
+	std::remove(filename.c_str());
+}
+
+//the chunks of the scene kept by an anchored resize have the same mesh as before, even in a map lower than a chunk
+void testResizeKeepsChunks(const MaterialRegistry &materials, const Coordinates &oldSize, const Coordinates &newSize, const Coordinates &offset, int expectedMoved)
+{
+	const int chunkSize = 8;
+	std::shared_ptr<Voxel> ocean = materials.getVoxel(materials.getId("ocean"));
+	std::shared_ptr<Voxel> plain = materials.getVoxel(materials.getId("plain"));
+	CubeMap<Voxel> map(oldSize.x, oldSize.y, oldSize.z);
+	map.fillBox(ocean, 0, 0, 0, oldSize.x-1, 0, oldSize.z-1);
+	unsigned int random = 12345;
+	for (int i=0; i<oldSize.x*oldSize.z/4; ++i) {
+		random = random*1103515245 + 12345;
+		map.setVoxel(plain, (random >> 8) % oldSize.x, (random >> 4) % oldSize.y, (random >> 16) % oldSize.z);
+	}
+	ChunkMesher mesher(50.0f, materials.getNbAtlasRows(), VertexFormat::Float);
+	std::vector<ChunkHash> oldHashes;
+	for (int z=0; z<oldSize.z; z+=chunkSize) {
+		for (int y=0; y<oldSize.y; y+=chunkSize) {
+			for (int x=0; x<oldSize.x; x+=chunkSize) {
+				oldHashes.push_back(mesher.hashChunk(map, x, y, z, x+chunkSize-1, y+chunkSize-1, z+chunkSize-1));
+			}
+		}
+	}
+	map.resize(newSize.x, newSize.y, newSize.z, offset.x, offset.y, offset.z, ocean);
+	ChunkMoves moves;
+	if (!planChunkMoves(oldSize, newSize, offset, chunkSize, moves)) {
+		check(false, "chunk moves planned");
+		return;
+	}
+	std::string sizes = std::to_string(oldSize.x) + "x" + std::to_string(oldSize.y) + "x" + std::to_string(oldSize.z) + " to "
+		+ std::to_string(newSize.x) + "x" + std::to_string(newSize.y) + "x" + std::to_string(newSize.z);
+	check(moves.nbMoved == expectedMoved, "chunks kept by the resize " + sizes + ", " + std::to_string(moves.nbMoved));
+	int nbKept = 0;
+	for (int z=0; z<moves.nbChunks.z; ++z) {
+		for (int y=0; y<moves.nbChunks.y; ++y) {
+			for (int x=0; x<moves.nbChunks.x; ++x) {
+				int id = x + y*moves.nbChunks.x + z*moves.nbChunks.x*moves.nbChunks.y;
+				if (moves.from[id] < 0 || moves.redraw[id]) {
+					continue;
+				}
+				++nbKept;
+				ChunkHash hash = mesher.hashChunk(map, x*chunkSize, y*chunkSize, z*chunkSize, (x+1)*chunkSize-1, (y+1)*chunkSize-1, (z+1)*chunkSize-1);
+				check(hash == oldHashes[moves.from[id]], "mesh of a kept chunk unchanged " + sizes + ", chunk " + std::to_string(id));
+			}
+		}
+	}
+	check(nbKept > 0, "chunks not redrawn after the resize " + sizes);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	FLAGS_logtostderr = true;
+	google::InitGoogleLogging(argv[0]);
+	std::string materialsFile = argc > 1 ? argv[1] : "../media/materials.lua";
+	testPaletteCompaction();
+	testAllocatedChunks();
+	testPickVoxel();
+	testPagedEdits(materialsFile);
+	MaterialRegistry materials;
+	if (materials.loadFromFile(materialsFile)) {
+		testMesherPaletteTables(materials);
+		testWideChunkVertices(materials);
+		testMeshCacheCutMesh(materials);
+		testResizeKeepsChunks(materials, {40, 1, 40}, {56, 1, 56}, {8, 0, 8}, 25);
+		testResizeKeepsChunks(materials, {37, 3, 37}, {45, 3, 29}, {8, 0, 0}, 15);
+	}
+	LOG(INFO) << (nbFailures == 0 ? "All tests passed" : std::to_string(nbFailures) + " failures");
+	return nbFailures == 0 ? 0 : 1;
+}
@@ -12,7 +12,7 @@ std::shared_ptr<Voxel> Voxel::createVoxel(const float red, const float green, co
 	return std::shared_ptr<Voxel>(new ColouredVoxel(red, green, blue));
 }
 
-std::shared_ptr<Voxel> Voxel::createMatterVoxel(const std::string type)
+std::shared_ptr<Voxel> Voxel::createMatterVoxel(const MatterInfos *infos)
 {
-		return std::make_shared<MatterVoxel>(type);
+		return std::make_shared<MatterVoxel>(infos);
 }
@@ -4,6 +4,8 @@
 #include <string>
 #include <memory>
 
+struct MatterInfos;
+
 class Voxel
 {
 	public:
@@ -13,7 +15,7 @@ class Voxel
 		std::string getId() const { return id_; }
 		virtual std::string getInfos();
 		static std::shared_ptr<Voxel> createVoxel(const float red, const float green, const float blue);
-		static std::shared_ptr<Voxel> createMatterVoxel(const std::string type);
+		static std::shared_ptr<Voxel> createMatterVoxel(const MatterInfos *infos);
 	
 	private:
 		std::string id_;
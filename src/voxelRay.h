@@ -0,0 +1,127 @@
+#ifndef VOXELRAY_H
+#define VOXELRAY_H
+
+////////////////////////////////////////
+// Find the first voxel of a CubeMap hit
+// by a ray, walking the grid cell by cell
+// (3D DDA, Amanatides & Woo)
+////////////////////////////////////////
+//use:
+//
+//VoxelHit hit;
+//if (pickVoxel(map, origin, direction, cubeSize, hit)) {
+//	map.getVoxel(hit.x, hit.y, hit.z);
+//}
+//
+//Origin and direction are in world units (cube i spans [i*cubeSize, (i+1)*cubeSize[),
+//the direction doesn't need to be normalised. No allocation is done.
+
+#include <cmath>
+#include <limits>
+#include <utility>
+#include "cubeMap.h"
+
+struct VoxelHit {
+	int x;
+	int y;
+	int z;
+	int face; //face the ray entered by (same order as the ChunkMesher faces), -1 if it started inside
+	float distance; //in units of the direction vector
+};
+
+template <typename T>
+bool pickVoxel(const CubeMap<T> &map, const float origin[3], const float direction[3], float cubeSize, VoxelHit &hit)
+{
+	const int size[3] = { map.getSizeX(), map.getSizeY(), map.getSizeZ() };
+	//faces entered when stepping in the positive/negative direction of each axis
+	const int facePositive[3] = { 1, 2, 3 }; //left, bottom, back
+	const int faceNegative[3] = { 4, 0, 5 }; //right, top, front
+	const float infinity = std::numeric_limits<float>::infinity();
+
+	//clip the ray against the bounds of the map
+	float tEnter = 0.0f;
+	float tExit = infinity;
+	int enterAxis = -1;
+	for (int a=0; a<3; ++a) {
+		float low = 0.0f;
+		float high = size[a]*cubeSize;
+		if (direction[a] == 0.0f) {
+			if (origin[a] < low || origin[a] >= high) {
+				return false;
+			}
+			continue;
+		}
+		float t0 = (low - origin[a]) / direction[a];
+		float t1 = (high - origin[a]) / direction[a];
+		if (t0 > t1) {
+			std::swap(t0, t1);
+		}
+		if (t0 > tEnter) {
+			tEnter = t0;
+			enterAxis = a;
+		}
+		if (t1 < tExit) {
+			tExit = t1;
+		}
+	}
+	if (tEnter > tExit) {
+		return false;
+	}
+
+	//first cell and parameters of the walk
+	int cell[3];
+	int step[3];
+	float tMax[3];
+	float tDelta[3];
+	for (int a=0; a<3; ++a) {
+		float pos = (origin[a] + direction[a]*tEnter) / cubeSize;
+		cell[a] = static_cast<int>(std::floor(pos));
+		if (cell[a] < 0) cell[a] = 0;
+		if (cell[a] >= size[a]) cell[a] = size[a]-1;
+		if (direction[a] > 0.0f) {
+			step[a] = 1;
+			tDelta[a] = cubeSize / direction[a];
+			tMax[a] = ((cell[a]+1)*cubeSize - origin[a]) / direction[a];
+		} else if (direction[a] < 0.0f) {
+			step[a] = -1;
+			tDelta[a] = -cubeSize / direction[a];
+			tMax[a] = (cell[a]*cubeSize - origin[a]) / direction[a];
+		} else {
+			step[a] = 0;
+			tDelta[a] = infinity;
+			tMax[a] = infinity;
+		}
+	}
+	int face = -1;
+	if (enterAxis != -1) {
+		face = (step[enterAxis] > 0) ? facePositive[enterAxis] : faceNegative[enterAxis];
+	}
+	float t = tEnter;
+
+	while (true) {
+		if (map.getVoxel(cell[0], cell[1], cell[2])) {
+			hit.x = cell[0];
+			hit.y = cell[1];
+			hit.z = cell[2];
+			hit.face = face;
+			hit.distance = t;
+			return true;
+		}
+		//go to the next cell along the axis whose boundary is the closest
+		int a = 0;
+		if (tMax[1] < tMax[a]) a = 1;
+		if (tMax[2] < tMax[a]) a = 2;
+		t = tMax[a];
+		if (t > tExit) {
+			return false;
+		}
+		cell[a] += step[a];
+		if (cell[a] < 0 || cell[a] >= size[a]) {
+			return false;
+		}
+		tMax[a] += tDelta[a];
+		face = (step[a] > 0) ? facePositive[a] : faceNegative[a];
+	}
+}
+
+#endif /* VOXELRAY_H */
@@ -0,0 +1,206 @@
+#include "worldGenerator.h"
+#include <glog/logging.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+//integer hash of a lattice point, the same on every platform and thread
+std::uint32_t hashPoint(std::uint32_t seed, int x, int z)
+{
+	std::uint32_t h = seed ^ 0x9E3779B9u;
+	h ^= static_cast<std::uint32_t>(x) * 0x85EBCA6Bu;
+	h = (h << 13) | (h >> 19);
+	h ^= static_cast<std::uint32_t>(z) * 0xC2B2AE35u;
+	h ^= h >> 16;
+	h *= 0x7FEB352Du;
+	h ^= h >> 15;
+	h *= 0x846CA68Bu;
+	h ^= h >> 16;
+	return h;
+}
+
+//2D gradient noise (Perlin), roughly between -0.7 and 0.7
+float gradientNoise(std::uint32_t seed, float x, float z)
+{
+	static const float gradients[8][2] = {
+		{1,0}, {-1,0}, {0,1}, {0,-1},
+		{0.7071f,0.7071f}, {-0.7071f,0.7071f}, {0.7071f,-0.7071f}, {-0.7071f,-0.7071f}
+	};
+	int x0 = static_cast<int>(std::floor(x));
+	int z0 = static_cast<int>(std::floor(z));
+	float fx = x - x0;
+	float fz = z - z0;
+	float dots[4];
+	for (int c=0; c<4; ++c) {
+		int cx = c & 1;
+		int cz = c >> 1;
+		const float *g = gradients[hashPoint(seed, x0+cx, z0+cz) & 7];
+		dots[c] = g[0]*(fx-cx) + g[1]*(fz-cz);
+	}
+	float u = fx*fx*fx*(fx*(fx*6-15)+10);
+	float v = fz*fz*fz*(fz*(fz*6-15)+10);
+	float bottom = dots[0] + u*(dots[1]-dots[0]);
+	float top = dots[2] + u*(dots[3]-dots[2]);
+	return bottom + v*(top-bottom);
+}
+
+//sum of octaves of noise, each one twice as detailed and half as strong
+float fractalNoise(std::uint32_t seed, float x, float z, int octaves)
+{
+	float sum = 0;
+	float amplitude = 1;
+	float total = 0;
+	for (int o=0; o<octaves; ++o) {
+		sum += amplitude*gradientNoise(seed + o*1013u, x, z);
+		total += amplitude;
+		amplitude *= 0.5f;
+		x *= 2;
+		z *= 2;
+	}
+	return sum / total;
+}
+
+const char *biomeMatters[] = { "ocean", "sea", "plain", "mountain", "desert", "forest", "ice" };
+
+}
+
+GeneratorSettings::GeneratorSettings():
+	seed{0},
+	sizeX{256},
+	sizeY{1},
+	sizeZ{256},
+	featureSize{128.0f},
+	octaves{6},
+	seaLevel{0.5f},
+	nbThreads{0}
+{
+
+}
+
+WorldGenerator::WorldGenerator(const MaterialRegistry *materials):
+	materials_{materials}
+{
+
+}
+
+WorldGenerator::~WorldGenerator()
+{
+
+}
+
+std::unique_ptr<CubeMap<Voxel>> WorldGenerator::generate(const GeneratorSettings &settings) const
+{
+	if (settings.sizeX <= 0 || settings.sizeY <= 0 || settings.sizeZ <= 0 || settings.featureSize <= 0) {
+		LOG(WARNING) << "Cannot generate a map with the given settings: x=" << settings.sizeX << " y=" << settings.sizeY << " z=" << settings.sizeZ;
+		return nullptr;
+	}
+	auto start = std::chrono::steady_clock::now();
+	std::unique_ptr<CubeMap<Voxel>> map(new CubeMap<Voxel>(settings.sizeX, settings.sizeY, settings.sizeZ));
+	//the palette is filled before the threads start, they only write indices
+	PaletteIndex biomeIndices[NB_BIOMES];
+	for (int b=0; b<NB_BIOMES; ++b) {
+		biomeIndices[b] = map->getPaletteIndex(materials_->getVoxel(materials_->getId(biomeMatters[b])));
+	}
+
+	//each thread takes the next column of chunks until there is none left
+	const int chunkSize = CubeMap<Voxel>::chunkSize;
+	int nbChunksX = (settings.sizeX+chunkSize-1) / chunkSize;
+	int nbChunksZ = (settings.sizeZ+chunkSize-1) / chunkSize;
+	int nbColumns = nbChunksX*nbChunksZ;
+	std::atomic<int> nextColumn(0);
+	auto worker = [&]() {
+		for (int column=nextColumn++; column<nbColumns; column=nextColumn++) {
+			generateChunkColumn(*map, settings, biomeIndices, column % nbChunksX, column / nbChunksX);
+		}
+	};
+	int nbThreads = settings.nbThreads > 0 ? settings.nbThreads : std::thread::hardware_concurrency();
+	nbThreads = std::max(1, std::min(nbThreads, nbColumns));
+	std::vector<std::thread> threads;
+	for (int t=1; t<nbThreads; ++t) {
+		threads.push_back(std::thread(worker));
+	}
+	worker();
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	LOG(INFO) << "Map of " << settings.sizeX << "*" << settings.sizeY << "*" << settings.sizeZ << " generated (seed " << settings.seed
+		<< ") in " << duration.count() << "ms with " << nbThreads << " threads";
+	return map;
+}
+
+void WorldGenerator::generateChunkColumn(CubeMap<Voxel> &map, const GeneratorSettings &settings, const PaletteIndex *biomeIndices, int chunkX, int chunkZ) const
+{
+	const int chunkSize = CubeMap<Voxel>::chunkSize;
+	int startX = chunkX*chunkSize;
+	int endX = std::min(startX+chunkSize, settings.sizeX);
+	int startZ = chunkZ*chunkSize;
+	int endZ = std::min(startZ+chunkSize, settings.sizeZ);
+	int seaLayer = static_cast<int>(settings.seaLevel*(settings.sizeY-1));
+	for (int z=startZ; z<endZ; ++z) {
+		//neighbour columns with the same biome and height are written as one row
+		int runStart = startX;
+		PaletteIndex runIndex = 0;
+		int runTop = -1;
+		for (int x=startX; x<=endX; ++x) {
+			PaletteIndex index = 0;
+			int top = -1;
+			if (x < endX) {
+				float elevation;
+				Biome biome = getBiome(settings, x, z, elevation);
+				index = biomeIndices[biome];
+				top = seaLayer;
+				if (elevation > settings.seaLevel) {
+					float land = (elevation-settings.seaLevel) / (1.0f-settings.seaLevel);
+					top += static_cast<int>(land*(settings.sizeY-1-seaLayer));
+				}
+			}
+			if (x == endX || index != runIndex || top != runTop) {
+				if (x > runStart) {
+					map.fillBox(runIndex, runStart, 0, z, x-1, runTop, z);
+				}
+				runStart = x;
+				runIndex = index;
+				runTop = top;
+			}
+		}
+	}
+}
+
+WorldGenerator::Biome WorldGenerator::getBiome(const GeneratorSettings &settings, int x, int z, float &elevation) const
+{
+	float fx = x / settings.featureSize;
+	float fz = z / settings.featureSize;
+	elevation = std::max(0.0f, std::min(1.0f, 0.5f + fractalNoise(settings.seed, fx, fz, settings.octaves)));
+	//cold near the poles (top and bottom of the map) and on high ground
+	float latitude = std::fabs(2.0f*(z+0.5f)/settings.sizeZ - 1.0f);
+	float land = std::max(0.0f, (elevation-settings.seaLevel) / (1.0f-settings.seaLevel));
+	float temperature = 1.0f - latitude - 0.5f*land + 0.3f*fractalNoise(settings.seed+1, 2*fx, 2*fz, 3);
+	if (temperature < 0.1f) {
+		return ICE;
+	}
+	if (elevation < settings.seaLevel*0.7f) {
+		return OCEAN;
+	}
+	if (elevation < settings.seaLevel) {
+		return SEA;
+	}
+	if (land > 0.5f) {
+		return MOUNTAIN;
+	}
+	float moisture = 0.5f + fractalNoise(settings.seed+2, 1.5f*fx, 1.5f*fz, 3);
+	if (moisture < 0.4f && temperature > 0.5f) {
+		return DESERT;
+	}
+	if (moisture > 0.55f) {
+		return FOREST;
+	}
+	return PLAIN;
+}
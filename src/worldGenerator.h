@@ -0,0 +1,59 @@
+#ifndef WORLDGENERATOR_H
+#define WORLDGENERATOR_H
+
+////////////////////////////////////////
+// Procedural generation of a world map:
+// noise heightmap, then one biome
+// (matter type) per column
+////////////////////////////////////////
+//use:
+//
+//WorldGenerator generator(materials);
+//GeneratorSettings settings;
+//settings.sizeX = 4096;
+//settings.sizeZ = 4096;
+//settings.seed = 42;
+//std::unique_ptr<CubeMap<Voxel>> map = generator.generate(settings);
+//
+//The map is split in columns of chunks that are generated by several threads.
+//The result only depends on the settings (not on the number of threads).
+//Biomes use the matters ocean, sea, plain, mountain, desert, forest and ice.
+
+#include <memory>
+#include <string>
+#include "cubeMap.h"
+#include "voxel.h"
+#include "materialRegistry.h"
+
+struct GeneratorSettings {
+	unsigned int seed;
+	int sizeX;
+	int sizeY; //1 for a flat map, otherwise land rises above the sea level
+	int sizeZ;
+	float featureSize; //size of the continents, in cubes
+	int octaves; //details added to the heightmap
+	float seaLevel; //part of the map under water, between 0 and 1
+	int nbThreads; //0 for one per core
+
+	GeneratorSettings();
+};
+
+class WorldGenerator
+{
+	public:
+		WorldGenerator(const MaterialRegistry *materials);
+		~WorldGenerator();
+
+		std::unique_ptr<CubeMap<Voxel>> generate(const GeneratorSettings &settings) const;
+
+	private:
+		enum Biome { OCEAN=0, SEA, PLAIN, MOUNTAIN, DESERT, FOREST, ICE, NB_BIOMES };
+		typedef CubeMap<Voxel>::PaletteIndex PaletteIndex;
+
+		void generateChunkColumn(CubeMap<Voxel> &map, const GeneratorSettings &settings, const PaletteIndex *biomeIndices, int chunkX, int chunkZ) const;
+		Biome getBiome(const GeneratorSettings &settings, int x, int z, float &elevation) const;
+
+		const MaterialRegistry *materials_;
+};
+
+#endif /* WORLDGENERATOR_H */
@@ -2,52 +2,177 @@
 #include "eventManager.h"
 #include <glog/logging.h>
 #include "matterVoxel.h"
+#include "metrics.h"
+#include <chrono>
+#include <limits>
 
+//chunks of a paged map loaded at most on each update, to keep frames short
+static const int pagedLoadsPerUpdate = 32;
 
-WorldMapState::WorldMapState(Ogre::Root* ogre, Ogre::RenderWindow* window):
+
+#ifndef PIGELL_HEADLESS
+WorldMapState::WorldMapState(const Options *config, Ogre::Root* ogre, Ogre::RenderWindow* window):
+#else
+WorldMapState::WorldMapState(const Options *config):
+#endif
+	materials_{std::unique_ptr<MaterialRegistry>(new MaterialRegistry())},
 	worldMap_{},
-	scene_{std::unique_ptr<WorldMapScene>(new WorldMapScene(ogre, window, &worldMap_))}
+	pagedMap_{},
+	pagedMapBudget_{config->getValue<size_t>("pagedMapBudget")*1024*1024},
+	pagedMapRadius_{config->getValue<int>("pagedMapRadius")},
+#ifndef PIGELL_HEADLESS
+	scene_{},
+#endif
+	brush_{},
+	generatorThreads_{config->getValue<int>("generatorThreads")},
+	scripts_{},
+	luaWorld_{&worldMap_, materials_.get()},
+	metricsFile_{config->getValue<std::string>("metricsFile")},
+	metricsInterval_{config->getValue<unsigned long>("metricsInterval")},
+	metricsTimer_{0},
+	coldChunkDelay_{config->getValue<unsigned int>("coldChunkDelay")},
+	compressTimer_{0}
 {
 	LOG(INFO) << "Creating a new state: WorldMap";
+	//matter types must be known before the scene (and its gui) is created
+	materials_->loadFromFile(config->getValue<std::string>("materialsFile"));
+#ifndef PIGELL_HEADLESS
+	scene_ = std::unique_ptr<WorldMapScene>(new WorldMapScene(config, ogre, window, &worldMap_, materials_.get()));
+#endif
+	luaWorld_.open(scripts_.getState());
 	subscribe("loadWorldMap", [this](std::string eventName, Arguments args){
 		loadWorldMap(boost::any_cast<std::string>(args["data"]));
 	});
+	subscribe("dumpMetrics", [this](std::string eventName, Arguments args){
+		dumpMetrics();
+	});
 	subscribe("saveWorldMap", [this](std::string eventName, Arguments args){
-		saveWorldMapToLua(boost::any_cast<std::string>(args["filename"]));
+		saveWorldMap(boost::any_cast<std::string>(args["filename"]));
 	});
 	subscribe("resizeWorldMap", [this](std::string eventName, Arguments args){
-		resizeWorldMap(boost::any_cast<int>(args["X"]), boost::any_cast<int>(args["Y"]), boost::any_cast<int>(args["Z"]));
+		//optional offsets of the old map in the new one (to grow it westwards for example)
+		int offsetX = args.count("offsetX") ? boost::any_cast<int>(args["offsetX"]) : 0;
+		int offsetY = args.count("offsetY") ? boost::any_cast<int>(args["offsetY"]) : 0;
+		int offsetZ = args.count("offsetZ") ? boost::any_cast<int>(args["offsetZ"]) : 0;
+		resizeWorldMap(boost::any_cast<int>(args["X"]), boost::any_cast<int>(args["Y"]), boost::any_cast<int>(args["Z"]), offsetX, offsetY, offsetZ);
+	});
+	subscribe("generateWorldMap", [this](std::string eventName, Arguments args){
+		generateWorldMap(boost::any_cast<int>(args["X"]), boost::any_cast<int>(args["Y"]), boost::any_cast<int>(args["Z"]),
+						static_cast<unsigned int>(boost::any_cast<int>(args["seed"])));
 	});
 	subscribe("changeVoxelType", [this](std::string eventName, Arguments args){
 		changeVoxelType(boost::any_cast<std::string>(args["matter"]),
 						boost::any_cast<int>(args["x"]),
 						boost::any_cast<int>(args["y"]),
 						boost::any_cast<int>(args["z"]),
-						boost::any_cast<int>(args["radius"]));
+						boost::any_cast<int>(args["radius"]),
+						boost::any_cast<std::string>(args["shape"]));
+	});
+	subscribe("fillVoxelBox", [this](std::string eventName, Arguments args){
+		fillVoxelBox(boost::any_cast<std::string>(args["matter"]),
+					boost::any_cast<int>(args["x0"]), boost::any_cast<int>(args["y0"]), boost::any_cast<int>(args["z0"]),
+					boost::any_cast<int>(args["x1"]), boost::any_cast<int>(args["y1"]), boost::any_cast<int>(args["z1"]));
+	});
+	subscribe("floodFillVoxels", [this](std::string eventName, Arguments args){
+		floodFillVoxels(boost::any_cast<std::string>(args["matter"]),
+						boost::any_cast<int>(args["x"]),
+						boost::any_cast<int>(args["y"]),
+						boost::any_cast<int>(args["z"]));
 	});
 }
 
 WorldMapState::~WorldMapState()
 {
 	LOG(INFO) << "Deleting state: WorldMap";
+	closePagedMap();
 }
 
 void WorldMapState::update(unsigned long delta)
 {
+#ifndef PIGELL_HEADLESS
+	updatePagedMap();
 	scene_->update(delta);
+#endif
+	//once a second: the delay is counted in calls of compressColdChunks
+	if (coldChunkDelay_ > 0) {
+		compressTimer_ += delta;
+		if (compressTimer_ >= 1000) {
+			compressTimer_ = 0;
+			compressColdChunks();
+		}
+	}
+	if (metricsInterval_ > 0) {
+		metricsTimer_ += delta;
+		if (metricsTimer_ >= metricsInterval_) {
+			metricsTimer_ = 0;
+			dumpMetrics();
+		}
+	}
+}
+
+void WorldMapState::dumpMetrics()
+{
+	//the map is measured only when dumping, not on each modification
+	if (worldMap_) {
+		Metrics::setGauge("map.cubes", static_cast<double>(worldMap_->getSizeX())*worldMap_->getSizeY()*worldMap_->getSizeZ());
+		Metrics::setGauge("map.chunks", worldMap_->getNbChunks());
+		Metrics::setGauge("map.allocatedChunks", worldMap_->getNbAllocatedChunks());
+		Metrics::setGauge("map.palette", worldMap_->getPaletteSize());
+		Metrics::setGauge("map.memoryBytes", worldMap_->getMemoryUsage());
+		Metrics::setGauge("map.compressedChunks", worldMap_->getNbCompressedChunks());
+		Metrics::setGauge("map.residentBytes", worldMap_->getResidentBytes());
+		Metrics::setGauge("map.compressedBytes", worldMap_->getCompressedBytes());
+	}
+	if (Metrics::writeToFile(metricsFile_)) {
+		LOG(INFO) << "Metrics written to: " << metricsFile_;
+	}
+}
+
+void WorldMapState::compressColdChunks()
+{
+	if (!worldMap_) {
+		return;
+	}
+	size_t nbCompressed = worldMap_->compressColdChunks(coldChunkDelay_);
+	if (nbCompressed > 0) {
+		Metrics::increment("map.chunksCompressed", nbCompressed);
+		LOG(INFO) << nbCompressed << " cold chunks compressed, cubes use " << worldMap_->getResidentBytes()
+			<< " bytes, " << worldMap_->getCompressedBytes() << " bytes compressed";
+	}
 }
 
 bool WorldMapState::loadWorldMap(std::string filename)
 {
 	LOG(INFO) << "trying to load a map from file: " << filename;
+	if (PagedMap::isPagedFile(filename)) {
+		return openPagedMap(filename);
+	}
 	//read from a file and create a MapDefinition
-	lua_State *L = lua_open();
-	if (luaL_loadfile(L, filename.c_str()) || lua_pcall(L, 0, 0, 0)) {
-		LOG(ERROR) << lua_tostring(L, -1);
+	lua_State *L = scripts_.getState();
+	luaWorld_.resetChanges();
+	Metrics::increment("loader.scripts");
+	auto start = std::chrono::steady_clock::now();
+	bool done = scripts_.runFile(filename);
+	Metrics::observe("loader.scriptMs", std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+	if (!done) {
+		Metrics::increment("loader.errors");
+		//show what the script did before failing
+		sendLuaChanges();
+		return false;
+	}
+	lua_getfield(L, -1, "mapDef");
+	if (lua_isnil(L, -1)) {
+		//no map definition: the script worked on the map through the world object
+		lua_pop(L, 2);
+		sendLuaChanges();
+		return worldMap_ != nullptr;
+	}
+	if (!lua_istable(L, -1)) {
+		LOG(ERROR) << "mapDef is not a table in: " << filename;
+		lua_pop(L, 2);
 		return false;
-    }
+	}
 	MapDefinition newMap;    
-	lua_getglobal(L, "mapDef");
 	lua_pushnil(L);
 	while(lua_next(L, -2)) {
 	    //cycle through all the plots
@@ -86,8 +211,8 @@ bool WorldMapState::loadWorldMap(std::string filename)
 	    }
 	    lua_pop(L, 1);
 	}
-	lua_pop(L, 1);
-	lua_close(L);
+	//mapDef and the environment of the script
+	lua_pop(L, 2);
 	return loadWorldMap(newMap);
 }
 
@@ -115,13 +240,15 @@ bool WorldMapState::loadWorldMap(MapDefinition mapDefinition)
 	ySize++;
 	zSize++;
 	LOG(INFO) << "The new world map to create is of size: " << xSize << "*" << ySize << "*" << zSize;
+	Metrics::increment("loader.plots", mapDefinition.size());
+	closePagedMap();
 	worldMap_ = std::unique_ptr<CubeMap<Voxel>>(new CubeMap<Voxel>(xSize, ySize, zSize));
 
 	//create the right voxels and fil the map
 	for (Plot &elem : mapDefinition) {
 		if (elem.id == "matter") {
 			if (elem.properties["matterType"] != "") {
-				auto vox = Voxel::createMatterVoxel(elem.properties["matterType"]);
+				auto vox = materials_->getVoxel(materials_->getId(elem.properties["matterType"]));
 				worldMap_->setVoxel(vox, elem.x, elem.y, elem.z);				
 			} else {
 				LOG(WARNING) << "A matter plot doesn't have a matterType field: " << elem.x << "*" << elem.y << "*" << elem.z;
@@ -134,6 +261,23 @@ bool WorldMapState::loadWorldMap(MapDefinition mapDefinition)
 	return true;
 }
 
+bool WorldMapState::saveWorldMap(std::string filename)
+{
+	if (pagedMap_) {
+		//only the loaded chunks are in memory: the paged file is the map
+		if (filename == pagedMap_->getFilename()) {
+			pagedMap_->flush(*worldMap_);
+			return true;
+		}
+		LOG(WARNING) << "A paged map can only be saved to its own file: " << pagedMap_->getFilename();
+		return false;
+	}
+	if (PagedMap::isPagedFile(filename)) {
+		return PagedMap(materials_.get()).save(filename, *worldMap_);
+	}
+	return saveWorldMapToLua(filename);
+}
+
 bool WorldMapState::saveWorldMapToLua(std::string filename)
 {
 	std::ofstream file(filename.c_str());
@@ -173,12 +317,66 @@ bool WorldMapState::saveWorldMapToLua(std::string filename)
 }
 
 
+bool WorldMapState::openPagedMap(const std::string &filename)
+{
+	std::unique_ptr<PagedMap> paged(new PagedMap(materials_.get()));
+#ifndef PIGELL_HEADLESS
+	std::unique_ptr<CubeMap<Voxel>> newMap = paged->open(filename, pagedMapBudget_);
+#else
+	//no camera: batch jobs work on the whole map
+	std::unique_ptr<CubeMap<Voxel>> newMap = paged->open(filename, std::numeric_limits<size_t>::max());
+#endif
+	if (!newMap) {
+		return false;
+	}
+	closePagedMap();
+	worldMap_ = std::move(newMap);
+	pagedMap_ = std::move(paged);
+	//chunks are found in the file by their position
+	luaWorld_.setFixedSize(true);
+#ifdef PIGELL_HEADLESS
+	std::vector<ChangeSet> changes;
+	int radius = worldMap_->getSizeX() + worldMap_->getSizeZ();
+	pagedMap_->update(*worldMap_, 0, 0, radius, std::numeric_limits<int>::max(), changes);
+#endif
+	EventMgrFactory::getCurrentEvtMgr()->sendEvent("mapCreated");
+	return true;
+}
+
+//loads the chunks around the camera, the scene redraws them like any modification
+void WorldMapState::updatePagedMap()
+{
+#ifndef PIGELL_HEADLESS
+	if (!pagedMap_) {
+		return;
+	}
+	Coordinates camera = scene_->getCameraCube();
+	std::vector<ChangeSet> changes;
+	pagedMap_->update(*worldMap_, camera.x, camera.z, pagedMapRadius_, pagedLoadsPerUpdate, changes);
+	for (const ChangeSet &change : changes) {
+		sendChanges(change);
+	}
+#endif
+}
+
+//modified chunks are written back before the map is replaced
+void WorldMapState::closePagedMap()
+{
+	if (!pagedMap_) {
+		return;
+	}
+	pagedMap_->flush(*worldMap_);
+	pagedMap_.reset();
+	luaWorld_.setFixedSize(false);
+}
+
 int WorldMapState::getIntFieldLua(const char *key, lua_State *L)
 {
 	lua_pushstring(L, key);
 	lua_gettable(L, -2);
 	if (!lua_isnumber(L, -1)) {
 		LOG(WARNING) << "Trying to access a field in Lua that is not an int: " << key;
+		lua_pop(L, 1);
 		return -1;
 	}
 	int value = (int)lua_tonumber(L, -1);
@@ -192,6 +390,7 @@ std::string WorldMapState::getStringFieldLua(const char *key, lua_State *L)
 	lua_gettable(L, -2);
 	if (!lua_isstring(L, -1)) {
 		LOG(WARNING) << "Trying to access a field in Lua that is not a string: " << key;
+		lua_pop(L, 1);
 		return "";
 	}
 	std::string value = (std::string)lua_tostring(L, -1);
@@ -199,52 +398,103 @@ std::string WorldMapState::getStringFieldLua(const char *key, lua_State *L)
 	return value;
 }
 
-bool WorldMapState::resizeWorldMap(int x, int y, int z)
+bool WorldMapState::resizeWorldMap(int x, int y, int z, int offsetX, int offsetY, int offsetZ)
 {
 	//check values are correct
 	if ((x <= 0) || (y <= 0) || (z <= 0)) {
 		LOG(WARNING) << "Map resized failed: size <=0";
 		return false;
 	}
+	if (!worldMap_) {
+		LOG(WARNING) << "Map resized failed: there is no map";
+		return false;
+	}
+	if (pagedMap_) {
+		LOG(WARNING) << "Map resized failed: a paged map keeps the size of its file";
+		return false;
+	}
 	LOG(INFO) << "Trying to resize the world map";
-	if ((x > worldMap_->getSizeX()) || (y > worldMap_->getSizeY()) || (z > worldMap_->getSizeZ())) {
-		//map bigger then before --> have to fill the new space
-		worldMap_->resize(x, y, z);
-		for (int i=0; i<x; ++i) {
-			for (int j=0; j<y; ++j) {
-				for (int k=0; k<z; ++k) {
-					if (!worldMap_->getVoxel(i, j, k)) {
-						//create a new voxel
-						auto vox = Voxel::createMatterVoxel("ocean");
-						worldMap_->setVoxel(vox, i, j, k);
-					}
-				}
-			}
-		}
-	} else {
-		//map smaller then before
-		worldMap_->resize(x, y, z);
+	//only the cubes out of the old map become ocean
+	auto ocean = materials_->getVoxel(materials_->getId("ocean"));
+	if (!worldMap_->resize(x, y, z, offsetX, offsetY, offsetZ, ocean)) {
+		return false;
 	}
-	EventMgrFactory::getCurrentEvtMgr()->sendEvent("mapResized");
+	Metrics::increment("map.resizes");
+	//the scene moves the chunks it already drew by the offset
+	Arguments arg;
+	arg["offsetX"] = offsetX;
+	arg["offsetY"] = offsetY;
+	arg["offsetZ"] = offsetZ;
+	EventMgrFactory::getCurrentEvtMgr()->sendEvent("mapResized", arg);
 	return true;
 }
 
-void WorldMapState::changeVoxelType(std::string newType, int x, int y, int z, int radius)
+bool WorldMapState::generateWorldMap(int x, int y, int z, unsigned int seed)
+{
+	LOG(INFO) << "Generating a new world map with seed " << seed;
+	GeneratorSettings settings;
+	settings.sizeX = x;
+	settings.sizeY = y;
+	settings.sizeZ = z;
+	settings.seed = seed;
+	settings.nbThreads = generatorThreads_;
+	WorldGenerator generator(materials_.get());
+	std::unique_ptr<CubeMap<Voxel>> newMap = generator.generate(settings);
+	if (!newMap) {
+		return false;
+	}
+	closePagedMap();
+	worldMap_ = std::move(newMap);
+	EventMgrFactory::getCurrentEvtMgr()->sendEvent("mapCreated");
+	return true;
+}
+
+void WorldMapState::changeVoxelType(std::string newType, int x, int y, int z, int radius, std::string shape)
 {
 	//~ LOG(INFO) << "Change voxel " << x << "-" << y << "-" << z << " to type " << newType;
-	int xSize = radius-1;
-	for (int i=-xSize; i<=xSize; ++i) {
-		int ySize = xSize - std::abs(i);
-		LOG(INFO) << "xSize: " << xSize << " ySize: " << ySize;
-		for (int j=-ySize; j<=ySize; ++j) {
-		LOG(INFO) << "x=" << i << " y=" << j;
-		auto vox = Voxel::createMatterVoxel(newType);
-		worldMap_->setVoxel(vox, x+i, y, z+j);
-		Arguments arg;
-		arg["x"] = x+i;
-		arg["y"] = y;
-		arg["z"] = z+j;
-		EventMgrFactory::getCurrentEvtMgr()->sendEvent("cubeModified", arg);
-		}
+	BrushShape brushShape = BrushShape::Diamond;
+	if (!Brush::stringToShape(shape, brushShape)) {
+		LOG(WARNING) << "Unknown brush shape: " << shape;
+	}
+	brush_.setShape(brushShape);
+	brush_.setRadius(radius);
+	sendChanges(brush_.paint(*worldMap_, materials_->getVoxel(materials_->getId(newType)), x, y, z));
+}
+
+void WorldMapState::fillVoxelBox(std::string newType, int x0, int y0, int z0, int x1, int y1, int z1)
+{
+	sendChanges(Brush::fillBox(*worldMap_, materials_->getVoxel(materials_->getId(newType)), x0, y0, z0, x1, y1, z1));
+}
+
+void WorldMapState::floodFillVoxels(std::string newType, int x, int y, int z)
+{
+	sendChanges(brush_.floodFill(*worldMap_, materials_->getVoxel(materials_->getId(newType)), x, y, z));
+}
+
+void WorldMapState::sendLuaChanges()
+{
+	if (luaWorld_.wasResized()) {
+		EventMgrFactory::getCurrentEvtMgr()->sendEvent("mapCreated");
+	} else {
+		sendChanges(luaWorld_.getChanges());
+	}
+}
+
+//one event for the whole edit, with the box containing all the modified cubes
+void WorldMapState::sendChanges(const ChangeSet &changes)
+{
+	if (changes.empty()) {
+		return;
 	}
+	LOG(INFO) << changes.nbCubes << " cubes modified between " << changes.minX << "-" << changes.minY << "-" << changes.minZ
+		<< " and " << changes.maxX << "-" << changes.maxY << "-" << changes.maxZ;
+	Arguments arg;
+	arg["minX"] = changes.minX;
+	arg["minY"] = changes.minY;
+	arg["minZ"] = changes.minZ;
+	arg["maxX"] = changes.maxX;
+	arg["maxY"] = changes.maxY;
+	arg["maxZ"] = changes.maxZ;
+	arg["nbCubes"] = static_cast<int>(changes.nbCubes);
+	EventMgrFactory::getCurrentEvtMgr()->sendEvent("cubesModified", arg);
 }
@@ -2,8 +2,17 @@
 #define WORLDMAPSTATE_H
 #include "cubeMap.h"
 #include "voxel.h"
+#ifndef PIGELL_HEADLESS
 #include "graphics/worldMapScene.h"
+#endif
 #include "eventManager.h"
+#include "materialRegistry.h"
+#include "brush.h"
+#include "worldGenerator.h"
+#include "luaWorldMap.h"
+#include "pagedMap.h"
+#include "scriptEngine.h"
+#include "options.h"
 #include <memory>
 #include <vector>
 #include <map>
@@ -15,9 +24,16 @@ extern "C" {
 class WorldMapState: public Subscribable
 {
 	public:
-		WorldMapState(Ogre::Root* ogre, Ogre::RenderWindow* window);
+#ifndef PIGELL_HEADLESS
+		WorldMapState(const Options *config, Ogre::Root* ogre, Ogre::RenderWindow* window);
+#else
+		//no scene: the map is only modified through events (batch jobs)
+		explicit WorldMapState(const Options *config);
+#endif
 		~WorldMapState();
 		void update(unsigned long delta);
+		const CubeMap<Voxel>* getWorldMap() const { return worldMap_.get(); }
+		const MaterialRegistry* getMaterials() const { return materials_.get(); }
 		
 		
 	private:
@@ -32,14 +48,40 @@ class WorldMapState: public Subscribable
 	
 		bool loadWorldMap(std::string filename);
 		bool loadWorldMap(MapDefinition mapDefinition);
+		bool saveWorldMap(std::string filename);
 		bool saveWorldMapToLua(std::string filename);
+		bool openPagedMap(const std::string &filename);
+		void updatePagedMap();
+		void closePagedMap();
 		int getIntFieldLua(const char *key, lua_State *L);
 		std::string getStringFieldLua(const char *key, lua_State *L);
-		bool resizeWorldMap(int x, int y, int z);
-		void changeVoxelType(std::string newType, int x, int y, int z, int radius);
+		bool resizeWorldMap(int x, int y, int z, int offsetX, int offsetY, int offsetZ);
+		bool generateWorldMap(int x, int y, int z, unsigned int seed);
+		void changeVoxelType(std::string newType, int x, int y, int z, int radius, std::string shape);
+		void fillVoxelBox(std::string newType, int x0, int y0, int z0, int x1, int y1, int z1);
+		void floodFillVoxels(std::string newType, int x, int y, int z);
+		void sendChanges(const ChangeSet &changes);
+		void sendLuaChanges();
+		void dumpMetrics();
+		void compressColdChunks();
 			
+		std::unique_ptr<MaterialRegistry> materials_;
 		std::unique_ptr<CubeMap<Voxel>> worldMap_;
+		std::unique_ptr<PagedMap> pagedMap_; //null unless worldMap_ comes from a paged file
+		size_t pagedMapBudget_; //bytes of loaded chunks
+		int pagedMapRadius_; //cubes around the camera
+#ifndef PIGELL_HEADLESS
 		std::unique_ptr<WorldMapScene> scene_;
+#endif
+		Brush brush_;
+		int generatorThreads_;
+		ScriptEngine scripts_;
+		LuaWorldMap luaWorld_;
+		std::string metricsFile_;
+		unsigned long metricsInterval_; //ms between two dumps, 0 for none
+		unsigned long metricsTimer_;
+		unsigned int coldChunkDelay_; //s without access before a chunk is compressed, 0 for never
+		unsigned long compressTimer_;
 		
 };
 